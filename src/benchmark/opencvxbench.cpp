@@ -0,0 +1,349 @@
+/** @file
+ * Throughput of the opencvx kernels used by imageclipper
+ *
+ * Every kernel runs on synthetic inputs of a few sizes. One line is
+ * printed per kernel, case and size, tab separated with a header:
+ *
+ *   kernel  case  width  height  items  usec_per_call  mitems_per_s
+ *
+ * items is what the kernel works through per call: output pixels for
+ * image kernels, samples for the PDFs and particles for the particle
+ * filter step.
+ *
+ * Usage: opencvxbench [iterations = 20] [kernel name filter]
+ *
+ * The MIT License
+ *
+ * Copyright (c) OpenALPR contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "cv.h"
+#include "cxcore.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+using namespace std;
+#include "opencvx/cvcropimageroi.h"
+#include "opencvx/cvdrawrectangle.h"
+#include "opencvx/cvcreateaffineimage.h"
+#include "opencvx/cvgausspdf.h"
+#include "opencvx/cvgmmpdf.h"
+#include "opencvx/cvgmmem.h"
+#include "opencvx/cvskincolorgmm.h"
+#include "opencvx/cvpcadiffs.h"
+#include "opencvx/cvmultiparticle.h"
+#include "cvdrawwatershed.h"
+
+/**
+ * One benchmark case. run() is called once to warm up and then
+ * iterations times under the timer
+ */
+typedef struct BenchCase {
+    const char* kernel;
+    const char* name;
+    CvSize size;
+    double items;
+    void (*run)( struct BenchCase* c );
+    // inputs, set up by each kernel
+    IplImage* img;
+    IplImage* dst;
+    CvMat* samples;
+    CvMat* mat0;
+    CvMat* mat1;
+    CvMat* mat2;
+    CvMat* probs;
+    CvRect32f rect32f;
+    CvPoint2D32f shear;
+    CvGmmModel* gmm;
+    CvPcaDiffsModel* pca;
+    CvMultiParticle* mp;
+} BenchCase;
+
+static int iterations = 20;
+static const char* filter = NULL;
+static CvRNG rng = cvRNG( 0x12345 );
+
+void icvBenchRun( BenchCase* c )
+{
+    if( filter && !strstr( c->kernel, filter ) ) return;
+    c->run( c ); // warm up
+    double start = (double)cvGetTickCount();
+    for( int i = 0; i < iterations; i++ )
+        c->run( c );
+    double usec = ( (double)cvGetTickCount() - start ) / cvGetTickFrequency() / iterations;
+    printf( "%s\t%s\t%d\t%d\t%.0f\t%.2f\t%.3f\n", c->kernel, c->name, c->size.width, c->size.height,
+            c->items, usec, c->items / usec );
+    fflush( stdout );
+}
+
+BenchCase icvBenchCase( const char* kernel, const char* name, CvSize size, void (*run)( BenchCase* ) )
+{
+    BenchCase c;
+    memset( &c, 0, sizeof(c) );
+    c.kernel = kernel;
+    c.name = name;
+    c.size = size;
+    c.run = run;
+    return c;
+}
+
+/**
+ * Random 8 bit image with some large scale structure, so that watershed
+ * and tracking have edges to find
+ */
+IplImage* icvBenchImage( CvSize size, int channels )
+{
+    IplImage* img = cvCreateImage( size, IPL_DEPTH_8U, channels );
+    cvRandArr( &rng, img, CV_RAND_UNI, cvScalarAll(0), cvScalarAll(256) );
+    cvSmooth( img, img, CV_GAUSSIAN, 5, 5 );
+    for( int i = 0; i < 8; i++ )
+    {
+        CvPoint pt = cvPoint( cvRandInt( &rng ) % size.width, cvRandInt( &rng ) % size.height );
+        cvRectangle( img, pt, cvPoint( pt.x + size.width / 8, pt.y + size.height / 12 ),
+                     cvScalarAll( cvRandInt( &rng ) % 256 ), CV_FILLED );
+    }
+    return img;
+}
+
+/**************************** Image kernels **********************************/
+
+void icvRunCrop( BenchCase* c ) { cvCropImageROI( c->img, c->dst, c->rect32f, c->shear ); }
+
+void icvBenchCrop( CvSize size )
+{
+    const char* names[] = { "axis", "rotated", "sheared" };
+    float angles[] = { 0, 30, 0 };
+    CvPoint2D32f shears[] = { cvPoint2D32f( 0, 0 ), cvPoint2D32f( 0, 0 ), cvPoint2D32f( 0.2, 0.1 ) };
+    for( int k = 0; k < 3; k++ )
+    {
+        BenchCase c = icvBenchCase( "cvCropImageROI", names[k], size, icvRunCrop );
+        c.img = icvBenchImage( size, 3 );
+        c.rect32f = cvRect32f( size.width / 3, size.height / 3, size.width / 4, size.height / 4, angles[k] );
+        c.shear = shears[k];
+        c.dst = cvCreateImage( cvSize( (int)c.rect32f.width, (int)c.rect32f.height ), IPL_DEPTH_8U, 3 );
+        c.items = (double)c.dst->width * c.dst->height;
+        icvBenchRun( &c );
+        cvReleaseImage( &c.img );
+        cvReleaseImage( &c.dst );
+    }
+}
+
+void icvRunDrawRectangle( BenchCase* c )
+{
+    cvDrawRectangle( c->img, c->rect32f, c->shear, CV_RGB(255, 0, 0), 2 );
+}
+
+void icvBenchDrawRectangle( CvSize size )
+{
+    BenchCase c = icvBenchCase( "cvDrawRectangle", "rotated", size, icvRunDrawRectangle );
+    c.img = icvBenchImage( size, 3 );
+    c.rect32f = cvRect32f( size.width / 4, size.height / 4, size.width / 2, size.height / 2, 15 );
+    c.shear = cvPoint2D32f( 0.1, 0 );
+    c.items = 2.0 * ( c.rect32f.width + c.rect32f.height ); // perimeter pixels
+    icvBenchRun( &c );
+    cvReleaseImage( &c.img );
+}
+
+void icvRunAffineImage( BenchCase* c )
+{
+    IplImage* out = cvCreateAffineImage( c->img, c->mat0, CV_AFFINE_FULL );
+    cvReleaseImage( &out );
+}
+
+void icvBenchAffineImage( CvSize size )
+{
+    BenchCase c = icvBenchCase( "cvCreateAffineImage", "full", size, icvRunAffineImage );
+    c.img = icvBenchImage( size, 3 );
+    c.mat0 = cvCreateMat( 2, 3, CV_32FC1 );
+    cvCreateAffine( c.mat0, cvRect32f( 0, 0, 1, 1, 30 ), cvPoint2D32f( 0.1, 0 ) );
+    c.items = (double)size.width * size.height;
+    icvBenchRun( &c );
+    cvReleaseImage( &c.img );
+    cvReleaseMat( &c.mat0 );
+}
+
+// cvDrawWatershed draws into its input, so each call starts from a copy
+void icvRunWatershed( BenchCase* c )
+{
+    cvCopy( c->img, c->dst );
+    cvDrawWatershed( c->dst, cvRect( c->size.width / 2, c->size.height / 2, c->size.height / 16, 0 ) );
+}
+
+void icvBenchWatershed( CvSize size )
+{
+    BenchCase c = icvBenchCase( "cvDrawWatershed", "circle", size, icvRunWatershed );
+    c.img = icvBenchImage( size, 3 );
+    c.dst = cvCloneImage( c.img );
+    c.items = (double)size.width * size.height;
+    icvBenchRun( &c );
+    cvReleaseImage( &c.img );
+    cvReleaseImage( &c.dst );
+}
+
+void icvRunSkinColorGmm( BenchCase* c ) { cvSkinColorGmm( c->img, c->dst ); }
+
+void icvBenchSkinColorGmm( CvSize size )
+{
+    BenchCase c = icvBenchCase( "cvSkinColorGmm", "default", size, icvRunSkinColorGmm );
+    c.img = icvBenchImage( size, 3 );
+    c.dst = cvCreateImage( size, IPL_DEPTH_8U, 1 );
+    c.items = (double)size.width * size.height;
+    icvBenchRun( &c );
+    cvReleaseImage( &c.img );
+    cvReleaseImage( &c.dst );
+}
+
+/***************************** PDF kernels ***********************************/
+
+void icvRunGaussPdf( BenchCase* c ) { cvMatGaussPdf( c->samples, c->mat0, c->mat1, c->probs, true ); }
+
+void icvBenchGaussPdf( int D, int N )
+{
+    BenchCase c = icvBenchCase( "cvMatGaussPdf", "full", cvSize( D, N ), icvRunGaussPdf );
+    c.samples = cvCreateMat( D, N, CV_64FC1 );
+    c.mat0 = cvCreateMat( D, 1, CV_64FC1 );
+    c.mat1 = cvCreateMat( D, D, CV_64FC1 );
+    c.probs = cvCreateMat( 1, N, CV_64FC1 );
+    cvRandArr( &rng, c.samples, CV_RAND_UNI, cvScalarAll(0), cvScalarAll(256) );
+    cvSet( c.mat0, cvScalarAll(128) );
+    cvSetIdentity( c.mat1, cvScalarAll(400) );
+    c.items = N;
+    icvBenchRun( &c );
+    cvReleaseMat( &c.samples );
+    cvReleaseMat( &c.mat0 );
+    cvReleaseMat( &c.mat1 );
+    cvReleaseMat( &c.probs );
+}
+
+void icvRunGmmPdf( BenchCase* c )
+{
+    cvMatGmmPdf( c->samples, c->gmm->means, c->gmm->covs, c->gmm->weights, c->probs, true );
+}
+
+void icvBenchGmmPdf( int K, int N )
+{
+    BenchCase c = icvBenchCase( "cvMatGmmPdf", "rgb", cvSize( K, N ), icvRunGmmPdf );
+    c.samples = cvCreateMat( 3, N, CV_64FC1 );
+    c.probs = cvCreateMat( 1, N, CV_64FC1 );
+    cvRandArr( &rng, c.samples, CV_RAND_UNI, cvScalarAll(0), cvScalarAll(256) );
+    c.gmm = cvCreateGmmModel( 3, K );
+    cvRandArr( &rng, c.gmm->means, CV_RAND_UNI, cvScalarAll(0), cvScalarAll(256) );
+    for( int k = 0; k < K; k++ )
+        cvSetIdentity( c.gmm->covs[k], cvScalarAll(400) );
+    c.items = N;
+    icvBenchRun( &c );
+    cvReleaseMat( &c.samples );
+    cvReleaseMat( &c.probs );
+    cvReleaseGmmModel( &c.gmm );
+}
+
+void icvRunPcaDiffs( BenchCase* c )
+{
+    cvMatPcaDiffs( c->samples, c->mat0, c->mat1, c->mat2, c->probs );
+}
+
+void icvRunPcaDiffs32f( BenchCase* c ) { cvMatPcaDiffs32f( c->samples, c->pca, c->probs ); }
+
+void icvBenchPcaDiffs( int D, int N )
+{
+    int M = 16;
+    BenchCase c = icvBenchCase( "cvMatPcaDiffs", "64f", cvSize( D, N ), icvRunPcaDiffs );
+    c.mat0 = cvCreateMat( D, 1, CV_64FC1 );
+    c.mat1 = cvCreateMat( M, 1, CV_64FC1 );
+    c.mat2 = cvCreateMat( M, D, CV_64FC1 );
+    c.probs = cvCreateMat( 1, N, CV_64FC1 );
+    cvRandArr( &rng, c.mat0, CV_RAND_UNI, cvScalarAll(0), cvScalarAll(1) );
+    cvRandArr( &rng, c.mat1, CV_RAND_UNI, cvScalarAll(0.1), cvScalarAll(1) );
+    cvRandArr( &rng, c.mat2, CV_RAND_NORMAL, cvScalarAll(0), cvScalarAll(1) );
+    CvMat* samples = cvCreateMat( D, N, CV_64FC1 );
+    cvRandArr( &rng, samples, CV_RAND_UNI, cvScalarAll(0), cvScalarAll(1) );
+    c.samples = samples;
+    c.items = N;
+    icvBenchRun( &c );
+
+    c.name = "32f";
+    c.run = icvRunPcaDiffs32f;
+    c.samples = cvCreateMat( D, N, CV_32FC1 );
+    cvConvert( samples, c.samples );
+    c.pca = cvCreatePcaDiffsModel( c.mat0, c.mat1, c.mat2 );
+    icvBenchRun( &c );
+
+    cvReleasePcaDiffsModel( &c.pca );
+    cvReleaseMat( &c.samples );
+    cvReleaseMat( &samples );
+    cvReleaseMat( &c.mat0 );
+    cvReleaseMat( &c.mat1 );
+    cvReleaseMat( &c.mat2 );
+    cvReleaseMat( &c.probs );
+}
+
+/**************************** Particle filter ********************************/
+
+// transition, NCC observation at the pyramid octave and resampling
+void icvRunParticle( BenchCase* c ) { cvMultiParticleUpdate( c->mp, c->dst ); }
+
+void icvBenchParticle( CvSize size, int num_particles )
+{
+    BenchCase c = icvBenchCase( "cvMultiParticleUpdate", "ncc", size, icvRunParticle );
+    c.img = icvBenchImage( size, 3 );
+    c.dst = icvBenchImage( size, 3 );
+    CvRect32f rect = cvRect32f( size.width / 3, size.height / 3, size.width / 6, size.height / 12, 0 );
+    c.mp = cvCreateMultiParticle( size, 1, num_particles,
+                                  cvParticleState( rect.width / 4, rect.height / 4,
+                                                   rect.width / 32, rect.height / 32, 2 ) );
+    cvMultiParticleAdd( c.mp, c.img, rect );
+    c.items = num_particles;
+    icvBenchRun( &c );
+    cvReleaseMultiParticle( &c.mp );
+    cvReleaseImage( &c.img );
+    cvReleaseImage( &c.dst );
+}
+
+int main( int argc, char** argv )
+{
+    iterations = argc > 1 ? atoi( argv[1] ) : 20;
+    filter = argc > 2 ? argv[2] : NULL;
+    CvSize sizes[] = { cvSize(640, 480), cvSize(1280, 720), cvSize(1920, 1080) };
+    int nsizes = sizeof(sizes) / sizeof(sizes[0]);
+    int s;
+
+    printf( "# kernel\tcase\twidth\theight\titems\tusec_per_call\tmitems_per_s\n" );
+    for( s = 0; s < nsizes; s++ )
+    {
+        icvBenchCrop( sizes[s] );
+        icvBenchDrawRectangle( sizes[s] );
+        icvBenchAffineImage( sizes[s] );
+        icvBenchWatershed( sizes[s] );
+        icvBenchSkinColorGmm( sizes[s] );
+    }
+    // width x height is D x N for the PDFs
+    icvBenchGaussPdf( 3, 307200 );
+    icvBenchGaussPdf( 64, 10000 );
+    icvBenchGmmPdf( 4, 307200 );
+    icvBenchGmmPdf( 16, 307200 );
+    icvBenchPcaDiffs( 24 * 24, 100 );
+    icvBenchPcaDiffs( 24 * 24, 1000 );
+    // width x height is the frame size
+    icvBenchParticle( sizes[0], 100 );
+    icvBenchParticle( sizes[0], 1000 );
+    icvBenchParticle( sizes[2], 1000 );
+    return 0;
+}
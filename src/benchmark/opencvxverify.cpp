@@ -0,0 +1,400 @@
+/** @file
+ * Golden output check of the opencvx kernels
+ *
+ * Runs the live kernels and the frozen copies in reference.h on the
+ * same randomized inputs (image sizes, channel counts, rectangles,
+ * angles, shears, affine matrices, masks, dimensions and covariances)
+ * and compares the outputs. Image kernels must match exactly; the PDFs
+ * must match within a relative tolerance. cvMatPcaDiffs32f is checked
+ * against cvMatPcaDiffs the same way.
+ *
+ * One line per kernel is printed, tab separated with a header:
+ *
+ *   kernel  cases  mismatches  max_error  tolerance
+ *
+ * and the exit status is 1 if any kernel has a mismatch.
+ *
+ * Usage: opencvxverify [cases = 200] [seed = 12345]
+ *
+ * The MIT License
+ *
+ * Copyright (c) OpenALPR contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "cv.h"
+#include "cxcore.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <float.h>
+#include <limits.h>
+#include <algorithm>
+using namespace std;
+#include "opencvx/cvcropimageroi.h"
+#include "opencvx/cvdrawrectangle.h"
+#include "opencvx/cvcreateaffineimage.h"
+#include "opencvx/cvsandwichfill.h"
+#include "opencvx/cvgausspdf.h"
+#include "opencvx/cvgmmpdf.h"
+#include "opencvx/cvpcadiffs.h"
+#include "benchmark/reference.h"
+
+typedef struct VerifyStat {
+    const char* kernel;
+    int cases;
+    int mismatches;
+    double max_error;
+    double tolerance;
+    int first_case;    // first mismatching case, -1 if none
+} VerifyStat;
+
+static CvRNG rng;
+
+VerifyStat icvVerifyStat( const char* kernel, double tolerance )
+{
+    VerifyStat s = { kernel, 0, 0, 0.0, tolerance, -1 };
+    return s;
+}
+
+void icvVerifyAdd( VerifyStat* s, double error )
+{
+    if( error > s->max_error ) s->max_error = error;
+    if( error > s->tolerance )
+    {
+        if( s->mismatches == 0 ) s->first_case = s->cases;
+        s->mismatches++;
+    }
+    s->cases++;
+}
+
+bool icvVerifyPrint( const VerifyStat* s )
+{
+    printf( "%s\t%d\t%d\t%g\t%g\n", s->kernel, s->cases, s->mismatches, s->max_error, s->tolerance );
+    if( s->mismatches > 0 )
+        fprintf( stderr, "%s: first mismatch at case %d\n", s->kernel, s->first_case );
+    return s->mismatches == 0;
+}
+
+double icvUniform( double a, double b ) { return a + ( b - a ) * cvRandReal( &rng ); }
+
+/**
+ * Largest difference of two images, INT_MAX if their sizes differ
+ */
+double icvImageError( const IplImage* a, const IplImage* b )
+{
+    if( a->width != b->width || a->height != b->height || a->nChannels != b->nChannels )
+        return INT_MAX;
+    return cvNorm( a, b, CV_C );
+}
+
+/**
+ * Largest relative difference, |a - b| / max( 1, |b| )
+ */
+double icvMatError( const CvMat* a, const CvMat* b )
+{
+    double err = 0;
+    for( int i = 0; i < a->rows; i++ )
+    {
+        for( int j = 0; j < a->cols; j++ )
+        {
+            double va = cvmGet( a, i, j ), vb = cvmGet( b, i, j );
+            double e = fabs( va - vb ) / MAX( 1.0, fabs( vb ) );
+            if( e != e ) e = ( va != va && vb != vb ) ? 0 : DBL_MAX; // NaN
+            err = MAX( err, e );
+        }
+    }
+    return err;
+}
+
+IplImage* icvRandomImage( int channels )
+{
+    // odd widths keep the row padding cvSandwichFill reads into
+    CvSize size = cvSize( ( cvRandInt( &rng ) % 300 + 8 ) | 1, cvRandInt( &rng ) % 300 + 8 );
+    IplImage* img = cvCreateImage( size, IPL_DEPTH_8U, channels );
+    cvRandArr( &rng, img, CV_RAND_UNI, cvScalarAll(0), cvScalarAll(256) );
+    return img;
+}
+
+/**
+ * A rectangle partly outside of the image now and then, axis aligned,
+ * rotated or sheared in about equal parts
+ */
+void icvRandomRect( const IplImage* img, CvRect32f* rect32f, CvPoint2D32f* shear )
+{
+    float w = (float)( cvRandInt( &rng ) % ( img->width / 2 ) + 1 );
+    float h = (float)( cvRandInt( &rng ) % ( img->height / 2 ) + 1 );
+    float x = (float)icvUniform( -img->width / 4, img->width - w / 2 );
+    float y = (float)icvUniform( -img->height / 4, img->height - h / 2 );
+    int kind = cvRandInt( &rng ) % 3;
+    float angle = kind == 0 ? 0 : (float)icvUniform( -180, 180 );
+    *rect32f = cvRect32f( cvRound( x ), cvRound( y ), w, h, angle );
+    *shear = kind == 2 ? cvPoint2D32f( icvUniform( -0.5, 0.5 ), icvUniform( -0.5, 0.5 ) )
+                       : cvPoint2D32f( 0, 0 );
+}
+
+/****************************** Image kernels ********************************/
+
+bool icvVerifyCropImageROI( int cases )
+{
+    VerifyStat s = icvVerifyStat( "cvCropImageROI", 0 );
+    for( int i = 0; i < cases; i++ )
+    {
+        IplImage* img = icvRandomImage( cvRandInt( &rng ) % 2 ? 3 : 1 );
+        CvRect32f rect32f;
+        CvPoint2D32f shear;
+        icvRandomRect( img, &rect32f, &shear );
+        CvRect rect = cvRectFromRect32f( rect32f );
+        IplImage* live = cvCreateImage( cvSize( rect.width, rect.height ), img->depth, img->nChannels );
+        IplImage* ref = cvCloneImage( live );
+        cvCropImageROI( img, live, rect32f, shear );
+        icvCropImageROIReference( img, ref, rect32f, shear );
+        icvVerifyAdd( &s, icvImageError( live, ref ) );
+        cvReleaseImage( &img );
+        cvReleaseImage( &live );
+        cvReleaseImage( &ref );
+    }
+    return icvVerifyPrint( &s );
+}
+
+bool icvVerifyDrawRectangle( int cases )
+{
+    VerifyStat s = icvVerifyStat( "cvDrawRectangle", 0 );
+    for( int i = 0; i < cases; i++ )
+    {
+        IplImage* live = icvRandomImage( cvRandInt( &rng ) % 2 ? 3 : 1 );
+        IplImage* ref = cvCloneImage( live );
+        CvRect32f rect32f;
+        CvPoint2D32f shear;
+        icvRandomRect( live, &rect32f, &shear );
+        CvScalar color = cvScalar( cvRandInt( &rng ) % 256, cvRandInt( &rng ) % 256, cvRandInt( &rng ) % 256 );
+        int thickness = cvRandInt( &rng ) % 3 + 1;
+        cvDrawRectangle( live, rect32f, shear, color, thickness );
+        icvDrawRectangleReference( ref, rect32f, shear, color, thickness );
+        icvVerifyAdd( &s, icvImageError( live, ref ) );
+        cvReleaseImage( &live );
+        cvReleaseImage( &ref );
+    }
+    return icvVerifyPrint( &s );
+}
+
+bool icvVerifyCreateAffineImage( int cases )
+{
+    VerifyStat s = icvVerifyStat( "cvCreateAffineImage", 0 );
+    for( int i = 0; i < cases; i++ )
+    {
+        IplImage* img = icvRandomImage( cvRandInt( &rng ) % 2 ? 3 : 1 );
+        CvMat* affine = cvCreateMat( 2, 3, cvRandInt( &rng ) % 2 ? CV_32FC1 : CV_64FC1 );
+        CvRect32f rect32f = cvRect32f( icvUniform( -50, 50 ), icvUniform( -50, 50 ),
+                                       icvUniform( 0.5, 2 ), icvUniform( 0.5, 2 ), icvUniform( -180, 180 ) );
+        CvPoint2D32f shear = cvPoint2D32f( icvUniform( -0.3, 0.3 ), icvUniform( -0.3, 0.3 ) );
+        cvCreateAffine( affine, rect32f, shear );
+        int flags = cvRandInt( &rng ) % 2 ? CV_AFFINE_FULL : CV_AFFINE_SAME;
+        CvScalar color = cvScalarAll( cvRandInt( &rng ) % 256 );
+        CvPoint o_live, o_ref;
+        IplImage* live = cvCreateAffineImage( img, affine, flags, &o_live, color );
+        IplImage* ref = icvCreateAffineImageReference( img, affine, flags, &o_ref, color );
+        double err = icvImageError( live, ref );
+        if( o_live.x != o_ref.x || o_live.y != o_ref.y ) err = INT_MAX;
+        icvVerifyAdd( &s, err );
+        cvReleaseImage( &img );
+        cvReleaseImage( &live );
+        cvReleaseImage( &ref );
+        cvReleaseMat( &affine );
+    }
+    return icvVerifyPrint( &s );
+}
+
+bool icvVerifySandwichFill( int cases )
+{
+    VerifyStat s = icvVerifyStat( "cvSandwichFill", 0 );
+    for( int i = 0; i < cases; i++ )
+    {
+        IplImage* mask = icvRandomImage( 1 );
+        // sparse 0/1 mask with a density between 0.1% and 10%
+        cvThreshold( mask, mask, 255 - icvUniform( 0.255, 25.5 ), 1, CV_THRESH_BINARY );
+        IplImage* live = cvCloneImage( mask );
+        IplImage* ref = cvCloneImage( mask );
+        cvSandwichFill( mask, live );
+        icvSandwichFillReference( mask, ref );
+        icvVerifyAdd( &s, icvImageError( live, ref ) );
+        cvReleaseImage( &mask );
+        cvReleaseImage( &live );
+        cvReleaseImage( &ref );
+    }
+    return icvVerifyPrint( &s );
+}
+
+/******************************* PDF kernels *********************************/
+
+/**
+ * Random symmetric positive definite D x D matrix
+ */
+void icvRandomCov( CvMat* cov )
+{
+    int D = cov->rows;
+    CvMat* A = cvCreateMat( D, D, CV_64FC1 );
+    cvRandArr( &rng, A, CV_RAND_NORMAL, cvScalarAll(0), cvScalarAll( icvUniform( 1, 20 ) ) );
+    cvMulTransposed( A, cov, 0 );
+    for( int d = 0; d < D; d++ )
+        cvmSet( cov, d, d, cvmGet( cov, d, d ) + 1.0 );
+    cvReleaseMat( &A );
+}
+
+bool icvVerifyMatGaussPdf( int cases )
+{
+    VerifyStat s = icvVerifyStat( "cvMatGaussPdf", 1e-9 );
+    for( int i = 0; i < cases; i++ )
+    {
+        int D = cvRandInt( &rng ) % 8 + 1;
+        int N = cvRandInt( &rng ) % 200 + 1;
+        CvMat* samples = cvCreateMat( D, N, CV_64FC1 );
+        CvMat* mean = cvCreateMat( D, 1, CV_64FC1 );
+        CvMat* cov = cvCreateMat( D, D, CV_64FC1 );
+        CvMat* live = cvCreateMat( 1, N, CV_64FC1 );
+        CvMat* ref = cvCreateMat( 1, N, CV_64FC1 );
+        cvRandArr( &rng, samples, CV_RAND_UNI, cvScalarAll(0), cvScalarAll(256) );
+        cvRandArr( &rng, mean, CV_RAND_UNI, cvScalarAll(0), cvScalarAll(256) );
+        icvRandomCov( cov );
+        bool normalize = cvRandInt( &rng ) % 2 != 0;
+        bool logprob = cvRandInt( &rng ) % 2 != 0;
+        cvMatGaussPdf( samples, mean, cov, live, normalize, logprob );
+        icvMatGaussPdfReference( samples, mean, cov, ref, normalize, logprob );
+        icvVerifyAdd( &s, icvMatError( live, ref ) );
+        cvReleaseMat( &samples );
+        cvReleaseMat( &mean );
+        cvReleaseMat( &cov );
+        cvReleaseMat( &live );
+        cvReleaseMat( &ref );
+    }
+    return icvVerifyPrint( &s );
+}
+
+bool icvVerifyMatGmmPdf( int cases )
+{
+    VerifyStat s = icvVerifyStat( "cvMatGmmPdf", 1e-9 );
+    for( int i = 0; i < cases; i++ )
+    {
+        int D = cvRandInt( &rng ) % 4 + 1;
+        int K = cvRandInt( &rng ) % 8 + 1;
+        int N = cvRandInt( &rng ) % 200 + 1;
+        int rows = cvRandInt( &rng ) % 2 ? K : 1;
+        CvMat* samples = cvCreateMat( D, N, CV_64FC1 );
+        CvMat* means = cvCreateMat( D, K, CV_64FC1 );
+        CvMat* weights = cvCreateMat( 1, K, CV_64FC1 );
+        CvMat** covs = (CvMat**)cvAlloc( K * sizeof(CvMat*) );
+        CvMat* live = cvCreateMat( rows, N, CV_64FC1 );
+        CvMat* ref = cvCreateMat( rows, N, CV_64FC1 );
+        cvRandArr( &rng, samples, CV_RAND_UNI, cvScalarAll(0), cvScalarAll(256) );
+        cvRandArr( &rng, means, CV_RAND_UNI, cvScalarAll(0), cvScalarAll(256) );
+        cvRandArr( &rng, weights, CV_RAND_UNI, cvScalarAll(0), cvScalarAll(1) );
+        cvConvertScale( weights, weights, 1.0 / cvSum( weights ).val[0] );
+        for( int k = 0; k < K; k++ )
+        {
+            covs[k] = cvCreateMat( D, D, CV_64FC1 );
+            icvRandomCov( covs[k] );
+        }
+        bool normalize = cvRandInt( &rng ) % 2 != 0;
+        cvMatGmmPdf( samples, means, covs, weights, live, normalize );
+        icvMatGmmPdfReference( samples, means, covs, weights, ref, normalize );
+        // densities are tiny, compare them relative to the largest one
+        double scale = MAX( cvNorm( ref, NULL, CV_C ), DBL_MIN );
+        cvConvertScale( live, live, 1.0 / scale );
+        cvConvertScale( ref, ref, 1.0 / scale );
+        icvVerifyAdd( &s, icvMatError( live, ref ) );
+        for( int k = 0; k < K; k++ )
+            cvReleaseMat( &covs[k] );
+        cvFree( &covs );
+        cvReleaseMat( &samples );
+        cvReleaseMat( &means );
+        cvReleaseMat( &weights );
+        cvReleaseMat( &live );
+        cvReleaseMat( &ref );
+    }
+    return icvVerifyPrint( &s );
+}
+
+/**
+ * The float GEMM path against the double precision original
+ */
+bool icvVerifyMatPcaDiffs32f( int cases )
+{
+    VerifyStat s = icvVerifyStat( "cvMatPcaDiffs32f", 1e-3 );
+    for( int i = 0; i < cases; i++ )
+    {
+        int D = cvRandInt( &rng ) % 400 + 8;
+        int M = cvRandInt( &rng ) % MIN( D, 32 ) + 1;
+        int nEig = M + 1 + cvRandInt( &rng ) % 8; // rho needs a residual eigenvalue
+        int N = cvRandInt( &rng ) % 300 + 1;
+        CvMat* samples = cvCreateMat( D, N, CV_64FC1 );
+        CvMat* samples32f = cvCreateMat( D, N, CV_32FC1 );
+        CvMat* avg = cvCreateMat( D, 1, CV_64FC1 );
+        CvMat* eigenvalues = cvCreateMat( nEig, 1, CV_64FC1 );
+        CvMat* eigenvectors = cvCreateMat( M, D, CV_64FC1 );
+        CvMat* live = cvCreateMat( 1, N, CV_64FC1 );
+        CvMat* ref = cvCreateMat( 1, N, CV_64FC1 );
+        cvRandArr( &rng, samples, CV_RAND_UNI, cvScalarAll(0), cvScalarAll(1) );
+        cvRandArr( &rng, avg, CV_RAND_UNI, cvScalarAll(0), cvScalarAll(1) );
+        cvRandArr( &rng, eigenvalues, CV_RAND_UNI, cvScalarAll(0.01), cvScalarAll(1) );
+        cvRandArr( &rng, eigenvectors, CV_RAND_NORMAL, cvScalarAll(0), cvScalarAll(1) );
+        cvSort( eigenvalues, eigenvalues, NULL, CV_SORT_EVERY_COLUMN + CV_SORT_DESCENDING );
+        // orthonormal rows, as PCA gives
+        CvMat* w = cvCreateMat( M, 1, CV_64FC1 );
+        CvMat* v = cvCreateMat( D, D, CV_64FC1 );
+        CvMat* u = cvCreateMat( M, M, CV_64FC1 );
+        cvSVD( eigenvectors, w, u, v, CV_SVD_V_T );
+        CvMat rows;
+        cvGetRows( v, &rows, 0, M );
+        cvCopy( &rows, eigenvectors );
+        cvConvert( samples, samples32f );
+        int normalize = cvRandInt( &rng ) % 2;
+        cvMatPcaDiffs( samples, avg, eigenvalues, eigenvectors, ref, normalize, true );
+        CvPcaDiffsModel* model = cvCreatePcaDiffsModel( avg, eigenvalues, eigenvectors );
+        cvMatPcaDiffs32f( samples32f, model, live, normalize, true );
+        icvVerifyAdd( &s, icvMatError( live, ref ) );
+        cvReleasePcaDiffsModel( &model );
+        cvReleaseMat( &w );
+        cvReleaseMat( &v );
+        cvReleaseMat( &u );
+        cvReleaseMat( &samples );
+        cvReleaseMat( &samples32f );
+        cvReleaseMat( &avg );
+        cvReleaseMat( &eigenvalues );
+        cvReleaseMat( &eigenvectors );
+        cvReleaseMat( &live );
+        cvReleaseMat( &ref );
+    }
+    return icvVerifyPrint( &s );
+}
+
+int main( int argc, char** argv )
+{
+    int cases = argc > 1 ? atoi( argv[1] ) : 200;
+    rng = cvRNG( argc > 2 ? (int64)atoi( argv[2] ) : 12345 );
+    bool ok = true;
+
+    printf( "# kernel\tcases\tmismatches\tmax_error\ttolerance\n" );
+    ok &= icvVerifyCropImageROI( cases );
+    ok &= icvVerifyDrawRectangle( cases );
+    ok &= icvVerifyCreateAffineImage( cases );
+    ok &= icvVerifySandwichFill( cases );
+    ok &= icvVerifyMatGaussPdf( cases );
+    ok &= icvVerifyMatGmmPdf( cases );
+    ok &= icvVerifyMatPcaDiffs32f( cases / 4 + 1 );
+    return ok ? 0 : 1;
+}
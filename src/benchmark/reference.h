@@ -0,0 +1,448 @@
+/** @file
+ * Frozen reference copies of the opencvx kernels
+ *
+ * These are the implementations of cvCropImageROI, cvDrawRectangle,
+ * cvCreateAffineImage, cvSandwichFill, cvMatGaussPdf and cvMatGmmPdf as
+ * they were when the training data was cropped. Do not optimize them:
+ * opencvxverify compares the live kernels against these, so any change
+ * of output shows up there. The helpers they call (cvCreateAffine,
+ * cvInvAffine, cvRectFromRect32f) are not frozen.
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2008, Naotoshi Seo <sonots(at)sonots.com>
+ * Copyright (c) OpenALPR contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CV_BENCHMARK_REFERENCE_INCLUDED
+#define CV_BENCHMARK_REFERENCE_INCLUDED
+
+#include "cv.h"
+#include "cxcore.h"
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <limits.h>
+#include <algorithm>
+using namespace std;
+#include "opencvx/cvrect32f.h"
+#include "opencvx/cvcreateaffine.h"
+#include "opencvx/cvinvaffine.h"
+#include "opencvx/cvcreateaffineimage.h"
+
+/**
+ * cvCropImageROI
+ */
+void icvCropImageROIReference( const IplImage* img, IplImage* dst, CvRect32f rect32f, CvPoint2D32f shear )
+{
+    CvRect rect = cvRectFromRect32f( rect32f );
+    float angle = rect32f.angle;
+    CV_FUNCNAME( "icvCropImageROIReference" );
+    __BEGIN__;
+    CV_ASSERT( rect.width > 0 && rect.height > 0 );
+    CV_ASSERT( dst->width == rect.width );
+    CV_ASSERT( dst->height == rect.height );
+
+    if( angle == 0 && shear.x == 0 && shear.y == 0 &&
+        rect.x >= 0 && rect.y >= 0 &&
+        rect.x + rect.width < img->width && rect.y + rect.height < img->height )
+    {
+        CvMat subimg;
+        cvGetSubRect( img, &subimg, rect );
+        cvConvert( &subimg, dst );
+    }
+    else if( shear.x == 0 && shear.y == 0 )
+    {
+        int x, y, ch, xp, yp;
+        double c = cos( -M_PI / 180 * angle );
+        double s = sin( -M_PI / 180 * angle );
+        cvZero( dst );
+
+        for( x = 0; x < rect.width; x++ )
+        {
+            for( y = 0; y < rect.height; y++ )
+            {
+                xp = cvRound( c * x + -s * y ) + rect.x;
+                yp = cvRound( s * x + c * y ) + rect.y;
+                if( xp < 0 || xp >= img->width || yp < 0 || yp >= img->height ) continue;
+                for( ch = 0; ch < img->nChannels; ch++ )
+                {
+                    dst->imageData[dst->widthStep * y + x * dst->nChannels + ch]
+                        = img->imageData[img->widthStep * yp + xp * img->nChannels + ch];
+                }
+            }
+        }
+    }
+    else
+    {
+        int x, y, ch, xp, yp;
+        CvMat* affine = cvCreateMat( 2, 3, CV_32FC1 );
+        CvMat* xy     = cvCreateMat( 3, 1, CV_32FC1 );
+        CvMat* xyp    = cvCreateMat( 2, 1, CV_32FC1 );
+        cvCreateAffine( affine, rect32f, shear );
+        cvmSet( xy, 2, 0, 1.0 );
+        cvZero( dst );
+
+        for( x = 0; x < rect.width; x++ )
+        {
+            cvmSet( xy, 0, 0, x / rect32f.width );
+            for( y = 0; y < rect.height; y++ )
+            {
+                cvmSet( xy, 1, 0, y / rect32f.height );
+                cvMatMul( affine, xy, xyp );
+                xp = cvRound( cvmGet( xyp, 0, 0 ) );
+                yp = cvRound( cvmGet( xyp, 1, 0 ) );
+                if( xp < 0 || xp >= img->width || yp < 0 || yp >= img->height ) continue;
+                for( ch = 0; ch < img->nChannels; ch++ )
+                {
+                    dst->imageData[dst->widthStep * y + x * dst->nChannels + ch]
+                        = img->imageData[img->widthStep * yp + xp * img->nChannels + ch];
+                }
+            }
+        }
+        cvReleaseMat( &affine );
+        cvReleaseMat( &xy );
+        cvReleaseMat( &xyp );
+    }
+    __END__;
+}
+
+// one pixel of the rotated or sheared outline
+CV_INLINE void icvDrawRectangleReferencePixel( IplImage* img, int xp, int yp, CvScalar color )
+{
+    if( xp < 0 || xp >= img->width || yp < 0 || yp >= img->height ) return;
+    for( int ch = 0; ch < img->nChannels; ch++ )
+        img->imageData[img->widthStep * yp + xp * img->nChannels + ch] = (char)color.val[ch];
+}
+
+/**
+ * cvDrawRectangle
+ */
+void icvDrawRectangleReference( IplImage* img, CvRect32f rect32f, CvPoint2D32f shear, CvScalar color,
+                                int thickness = 1, int line_type = 8, int shift = 0 )
+{
+    CvRect rect = cvRectFromRect32f( rect32f );
+    float angle = rect32f.angle;
+    CV_FUNCNAME( "icvDrawRectangleReference" );
+    __BEGIN__;
+    CV_ASSERT( rect.width > 0 && rect.height > 0 );
+
+    if( angle == 0 && shear.x == 0 && shear.y == 0 )
+    {
+        CvPoint pt1 = cvPoint( rect.x, rect.y );
+        CvPoint pt2 = cvPoint( rect.x + rect.width - 1, rect.y + rect.height - 1 );
+        cvRectangle( img, pt1, pt2, color, thickness, line_type, shift );
+    }
+    else if( shear.x == 0 && shear.y == 0 )
+    {
+        int x, y;
+        double c = cos( -M_PI / 180 * angle );
+        double s = sin( -M_PI / 180 * angle );
+        for( x = 0; x < rect.width; x++ )
+            for( y = 0; y < rect.height; y += max(1, rect.height - 1) )
+                icvDrawRectangleReferencePixel( img, cvRound( c * x + -s * y ) + rect.x,
+                                                cvRound( s * x + c * y ) + rect.y, color );
+        for( y = 0; y < rect.height; y++ )
+            for( x = 0; x < rect.width; x += max( 1, rect.width - 1) )
+                icvDrawRectangleReferencePixel( img, cvRound( c * x + -s * y ) + rect.x,
+                                                cvRound( s * x + c * y ) + rect.y, color );
+    }
+    else
+    {
+        int x, y;
+        CvMat* affine = cvCreateMat( 2, 3, CV_32FC1 );
+        CvMat* xy     = cvCreateMat( 3, 1, CV_32FC1 );
+        CvMat* xyp    = cvCreateMat( 2, 1, CV_32FC1 );
+        cvmSet( xy, 2, 0, 1.0 );
+        cvCreateAffine( affine, rect32f, shear );
+
+        for( x = 0; x < rect.width; x++ )
+        {
+            cvmSet( xy, 0, 0, x / rect32f.width );
+            for( y = 0; y < rect.height; y += max(1, rect.height - 1) )
+            {
+                cvmSet( xy, 1, 0, y / rect32f.height );
+                cvMatMul( affine, xy, xyp );
+                icvDrawRectangleReferencePixel( img, cvRound( cvmGet( xyp, 0, 0 ) ),
+                                                cvRound( cvmGet( xyp, 1, 0 ) ), color );
+            }
+        }
+        for( y = 0; y < rect.height; y++ )
+        {
+            cvmSet( xy, 1, 0, y / rect32f.height );
+            for( x = 0; x < rect.width; x += max( 1, rect.width - 1) )
+            {
+                cvmSet( xy, 0, 0, x / rect32f.width );
+                cvMatMul( affine, xy, xyp );
+                icvDrawRectangleReferencePixel( img, cvRound( cvmGet( xyp, 0, 0 ) ),
+                                                cvRound( cvmGet( xyp, 1, 0 ) ), color );
+            }
+        }
+        cvReleaseMat( &affine );
+        cvReleaseMat( &xy );
+        cvReleaseMat( &xyp );
+    }
+    __END__;
+}
+
+/**
+ * cvCreateAffineImage
+ */
+IplImage* icvCreateAffineImageReference( const IplImage* src, const CvMat* affine,
+                                         int flags, CvPoint* origin, CvScalar color )
+{
+    IplImage* dst = NULL;
+    int minx = INT_MAX;
+    int miny = INT_MAX;
+    int maxx = INT_MIN;
+    int maxy = INT_MIN;
+    int i, x, y, xx, yy, xp, yp;
+    int ch, width = 0, height = 0;
+    CvPoint pt[4];
+    CvMat* invaffine;
+    CV_FUNCNAME( "icvCreateAffineImageReference" );
+    __BEGIN__;
+    CV_ASSERT( src->depth == IPL_DEPTH_8U );
+    CV_ASSERT( affine->rows == 2 && affine->cols == 3 );
+
+    pt[0].x = 0;              pt[0].y = 0;
+    pt[1].x = src->width - 1; pt[1].y = 0;
+    pt[2].x = 0;              pt[2].y = src->height - 1;
+    pt[3].x = src->width - 1; pt[3].y = src->height - 1;
+    for( i = 0; i < 4; i++ )
+    {
+        x = cvRound( pt[i].x * cvmGet( affine, 0, 0 ) +
+                     pt[i].y * cvmGet( affine, 0, 1 ) +
+                     cvmGet( affine, 0, 2 ) );
+        y = cvRound( pt[i].x * cvmGet( affine, 1, 0 ) +
+                     pt[i].y * cvmGet( affine, 1, 1 ) +
+                     cvmGet( affine, 1, 2 ) );
+        pt[i].x = x; pt[i].y = y;
+    }
+    for( i = 0; i < 4; i++ )
+    {
+        minx = MIN( pt[i].x, minx );
+        miny = MIN( pt[i].y, miny );
+        maxx = MAX( pt[i].x, maxx );
+        maxy = MAX( pt[i].y, maxy );
+    }
+    if( flags == CV_AFFINE_FULL )
+    {
+        width = maxx - minx + 1;
+        height = maxy - miny + 1;
+    }
+    else if( flags == CV_AFFINE_SAME )
+    {
+        width = src->width;
+        height = src->height;
+        minx = miny = 0;
+        maxx = src->width - 1;
+        maxy = src->height - 1;
+    }
+    if( origin != NULL )
+    {
+        origin->x = minx;
+        origin->y = miny;
+    }
+    dst = cvCreateImage( cvSize(width, height), src->depth, src->nChannels );
+    cvSet( dst, color );
+
+    invaffine = cvCreateMat( 2, 3, affine->type );
+    cvInvAffine( affine, invaffine );
+
+    for( x = 0; x < width; x++ )
+    {
+        xx = x + minx;
+        for( y = 0; y < height; y++ )
+        {
+            yy = y + miny;
+            xp = cvRound( xx * cvmGet( invaffine, 0, 0 ) +
+                              yy * cvmGet( invaffine, 0, 1 ) +
+                              cvmGet( invaffine, 0, 2 ) );
+            yp = cvRound( xx * cvmGet( invaffine, 1, 0 ) +
+                              yy * cvmGet( invaffine, 1, 1 ) +
+                              cvmGet( invaffine, 1, 2 ) );
+            if( xp < 0 || xp >= src->width || yp < 0 || yp >= src->height ) continue;
+            for( ch = 0; ch < src->nChannels; ch++ )
+            {
+                dst->imageData[dst->widthStep * y + x * dst->nChannels + ch]
+                    = src->imageData[src->widthStep * yp + xp * src->nChannels + ch];
+            }
+        }
+    }
+    cvReleaseMat( &invaffine );
+    __END__;
+    return dst;
+}
+
+/**
+ * cvSandwichFill
+ *
+ * Reads one byte past the end of each row (and, in the column pass, of
+ * the image), so callers keep odd widths to stay inside the row padding.
+ */
+void icvSandwichFillReference( const IplImage* src, IplImage* dst )
+{
+    cvCopy( src, dst );
+    for( int y = 0; y < dst->height; y++ )
+    {
+        int start = -1;
+        int end = -1;
+        for( int x = 0; x < dst->width - 1; x++)
+        {
+            int p1 = dst->imageData[dst->widthStep * y + x];
+            int p2 = dst->imageData[dst->widthStep * y + x + 1];
+            if( p1 > 0 && p2 > 0 )
+            {
+                start = x;
+                break;
+            }
+        }
+        for( int x = dst->width - 1; x > start; x--)
+        {
+            int p1 = dst->imageData[dst->widthStep * y + x];
+            int p2 = dst->imageData[dst->widthStep * y + x + 1];
+            if( p1 > 0 && p2 > 0 )
+            {
+                end = x;
+                break;
+            }
+        }
+        if( start != -1 && end != -1 )
+        {
+            for( int x = start; x <= end; x++)
+            {
+                dst->imageData[dst->widthStep * y + x] = 1;
+            }
+        }
+    }
+    for( int x = 0; x < dst->width; x++ )
+    {
+        int start = -1;
+        int end = -1;
+        for( int y = 0; y < dst->height - 1; y++)
+        {
+            int p1 = dst->imageData[dst->widthStep * y + x];
+            int p2 = dst->imageData[dst->widthStep * y + x + 1];
+            if( p1 > 0 && p2 > 0 )
+            {
+                start = y;
+                break;
+            }
+        }
+        for( int y = dst->height - 1; y > start; y--)
+        {
+            int p1 = dst->imageData[dst->widthStep * y + x];
+            int p2 = dst->imageData[dst->widthStep * y + x + 1];
+            if( p1 > 0 && p2 > 0 )
+            {
+                end = y;
+                break;
+            }
+        }
+        if( start != -1 && end != -1 )
+        {
+            for( int y = start; y <= end; y++)
+            {
+                dst->imageData[dst->widthStep * y + x] = 1;
+            }
+        }
+    }
+}
+
+/**
+ * cvMatGaussPdf
+ */
+void icvMatGaussPdfReference( const CvMat* samples, const CvMat* mean, const CvMat* cov, CvMat* probs,
+                              bool normalize = false, bool logprob = false )
+{
+    int D = samples->rows;
+    int N = samples->cols;
+    int type = samples->type;
+    CvMat *invcov = cvCreateMat( D, D, type );
+    cvInvert( cov, invcov, CV_SVD );
+
+    CvMat *sample = cvCreateMat( D, 1, type );
+    CvMat *subsample   = cvCreateMat( D, 1, type );
+    CvMat *subsample_T = cvCreateMat( 1, D, type );
+    CvMat *value       = cvCreateMat( 1, 1, type );
+    double prob;
+    for( int n = 0; n < N; n++ )
+    {
+        cvGetCol( samples, sample, n );
+
+        cvSub( sample, mean, subsample );
+        cvTranspose( subsample, subsample_T );
+        cvMatMul( subsample_T, invcov, subsample_T );
+        cvMatMul( subsample_T, subsample, value );
+        prob = -0.5 * cvmGet(value, 0, 0);
+        if( !logprob ) prob = exp( prob );
+
+        cvmSet( probs, 0, n, prob );
+    }
+    if( normalize )
+    {
+        double norm = pow( 2* M_PI, D/2.0 ) * sqrt( cvDet( cov ) );
+        if( logprob ) cvSubS( probs, cvScalar( log( norm ) ), probs );
+        else cvConvertScale( probs, probs, 1.0 / norm );
+    }
+
+    cvReleaseMat( &invcov );
+    cvReleaseMat( &sample );
+    cvReleaseMat( &subsample );
+    cvReleaseMat( &subsample_T );
+    cvReleaseMat( &value );
+}
+
+/**
+ * cvMatGmmPdf
+ */
+void icvMatGmmPdfReference( const CvMat* samples, const CvMat* means, CvMat** covs, const CvMat* weights,
+                            CvMat* probs, bool normalize = false )
+{
+    int D = samples->rows;
+    int N = samples->cols;
+    int K = means->cols;
+    int type = samples->type;
+    CvMat *mean = cvCreateMat( D, 1, type );
+    CvMat *_probs = cvCreateMat( 1, N, type );
+    cvZero( probs );
+    for( int k = 0; k < K; k++ )
+    {
+        cvGetCol( means, mean, k );
+        icvMatGaussPdfReference( samples, mean, covs[k], _probs, normalize );
+        cvConvertScale( _probs, _probs, cvmGet( weights, 0, k ) );
+        if( 1 == probs->rows )
+        {
+            cvAdd( probs, _probs, probs );
+        }
+        else
+        {
+            for( int n = 0; n < N; n++ )
+            {
+                cvmSet( probs, k, n, cvmGet( _probs, 0, n ) );
+            }
+        }
+    }
+    cvReleaseMat( &mean );
+    cvReleaseMat( &_probs );
+}
+
+
+#endif
@@ -0,0 +1,137 @@
+/** @file
+ * Throughput of the rule based skin color detectors
+ *
+ * Compares cvSkinColorPeer and cvSkinColorCrCb against the scalar
+ * implementations they replaced and prints megapixels per second.
+ *
+ * Usage: skincolorbench [iterations = 20]
+ *
+ * The MIT License
+ *
+ * Copyright (c) OpenALPR contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "cv.h"
+#include "cxcore.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include "opencvx/cvskincolorpeer.h"
+#include "opencvx/cvskincolorcbcr.h"
+
+/**
+ * The per-pixel branchy loop cvSkinColorPeer used before vectorization
+ */
+void icvSkinColorPeerLegacy( const IplImage* img, IplImage* mask )
+{
+    int x, y;
+    uchar r, g, b;
+    cvSet( mask, cvScalarAll(0) );
+    for( y = 0; y < img->height; y++ )
+    {
+        for( x = 0; x < img->width; x++ )
+        {
+            b = img->imageData[img->widthStep * y + x * 3];
+            g = img->imageData[img->widthStep * y + x * 3 + 1];
+            r = img->imageData[img->widthStep * y + x * 3 + 2];
+
+            if( r > 95 && g > 40 && b > 20 && 
+                max( r, max( g, b ) ) - min( r, min( g, b ) ) > 15 &&
+                abs( r - g ) > 15 && r > g && r > b )
+            {
+                mask->imageData[mask->widthStep * y + x] = 1;
+            }
+        }
+    }
+}
+
+/**
+ * cvCvtColor pass followed by the scalar ellipse test, as cvSkinColorCrCb
+ * did before the conversion was fused
+ */
+void icvSkinColorCrCbLegacy( const IplImage* _img, IplImage* mask )
+{
+    double Cx = 109.38, Cy = 152.02, theta = 2.53;
+    double ecx = 1.6, ecy = 2.41, a = 25.39, b = 14.03;
+    IplImage* img = cvCreateImage( cvGetSize(_img), IPL_DEPTH_8U, 3 );
+    cvCvtColor( _img, img, CV_BGR2YCrCb );
+    cvSet( mask, cvScalarAll(0) );
+    for( int row = 0; row < img->height; row++ )
+    {
+        for( int col = 0; col < img->width; col++ )
+        {
+            uchar Cr = img->imageData[img->widthStep * row + col * 3 + 1];
+            uchar Cb = img->imageData[img->widthStep * row + col * 3 + 2];
+            double x = cos(theta) * (Cb - Cx) + sin(theta) * (Cr - Cy);
+            double y = -1 * sin(theta) * (Cb - Cx) + cos(theta) * (Cr - Cy);
+            double distort = pow(x-ecx,2) / pow(a,2) + pow(y-ecy,2) / pow(b,2);
+            if( distort <= 1 )
+                mask->imageData[mask->widthStep * row + col] = 1;
+        }
+    }
+    cvReleaseImage( &img );
+}
+
+typedef void (*SkinColorFunc)( const IplImage* img, IplImage* mask );
+
+void icvCrCbNew( const IplImage* img, IplImage* mask ) { cvSkinColorCrCb( img, mask ); }
+
+/**
+ * @return megapixels per second
+ */
+double icvMeasure( SkinColorFunc func, const IplImage* img, IplImage* mask, int iterations )
+{
+    func( img, mask ); // warm up
+    double start = (double)cvGetTickCount();
+    for( int i = 0; i < iterations; i++ )
+        func( img, mask );
+    double sec = ( (double)cvGetTickCount() - start ) / ( cvGetTickFrequency() * 1e6 );
+    return (double)img->width * img->height * iterations / 1e6 / sec;
+}
+
+int main( int argc, char** argv )
+{
+    int iterations = argc > 1 ? atoi( argv[1] ) : 20;
+    CvSize sizes[] = { cvSize(640, 480), cvSize(1280, 720), cvSize(1920, 1080), cvSize(4096, 2160) };
+    const char* names[] = { "cvSkinColorPeer", "cvSkinColorCrCb" };
+    SkinColorFunc legacy[] = { icvSkinColorPeerLegacy, icvSkinColorCrCbLegacy };
+    SkinColorFunc current[] = { cvSkinColorPeer, icvCrCbNew };
+    CvRNG rng = cvRNG( 0x12345 );
+
+    printf( "# kernel\twidth\theight\tlegacy_mpix_s\tcurrent_mpix_s\tspeedup\tidentical\n" );
+    for( size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++ )
+    {
+        IplImage* img = cvCreateImage( sizes[s], IPL_DEPTH_8U, 3 );
+        IplImage* mask0 = cvCreateImage( sizes[s], IPL_DEPTH_8U, 1 );
+        IplImage* mask1 = cvCreateImage( sizes[s], IPL_DEPTH_8U, 1 );
+        cvRandArr( &rng, img, CV_RAND_UNI, cvScalarAll(0), cvScalarAll(256) );
+        for( int k = 0; k < 2; k++ )
+        {
+            double before = icvMeasure( legacy[k], img, mask0, iterations );
+            double after  = icvMeasure( current[k], img, mask1, iterations );
+            bool identical = cvNorm( mask0, mask1, CV_L1 ) == 0;
+            printf( "%s\t%d\t%d\t%.1f\t%.1f\t%.2f\t%s\n", names[k], sizes[s].width, sizes[s].height, 
+                    before, after, after / before, identical ? "yes" : "no" );
+        }
+        cvReleaseImage( &img );
+        cvReleaseImage( &mask0 );
+        cvReleaseImage( &mask1 );
+    }
+    return 0;
+}
@@ -0,0 +1,214 @@
+/** @file
+ * Background tracking of the clipping rectangle between video frames
+ *
+ * The rectangle set on one frame seeds a particle filter
+ * (cvmultiparticle.h, NCC observation) which is run into the next frame
+ * on a worker thread, so the next frame can be shown at once and the
+ * rectangle follows when tracking finishes.
+ *
+ * Example)
+ * <code>
+ * CvRectTracker* tracker = cvCreateRectTracker( 300 );
+ * cvRectTrackerSeed( tracker, img, rect32f );  // before the frame buffer is reused
+ * img = cvQueryFrame( cap );
+ * cvRectTrackerStart( tracker, img );          // img must stay valid until finished
+ * // ... show img, poll cvRectTrackerDone( tracker ) ...
+ * if( cvRectTrackerFinish( tracker, &rect32f ) ) // joins
+ * cvReleaseRectTracker( &tracker );
+ * </code>
+ *
+ * The MIT License
+ *
+ * Copyright (c) OpenALPR contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CV_RECTTRACKER_INCLUDED
+#define CV_RECTTRACKER_INCLUDED
+
+#include "cv.h"
+#include "cvaux.h"
+#include "cxcore.h"
+#include <iostream>
+using namespace std;
+#include "opencvx/cvrect32f.h"
+#include "opencvx/cvmultiparticle.h"
+#include "opencvx/cvthread.h"
+
+typedef struct CvRectTracker {
+    int num_particles;
+    CvMultiParticle* mp;     // created on the first seed, one target
+    IplImage* prev;          // copy of the frame the seed was set on
+    const IplImage* next;    // frame being tracked into, owned by the caller
+    CvRect32f seed;
+    CvRect32f result;
+    bool seeded;
+    bool busy;               // a result is pending
+    bool threaded;           // the pending result comes from a worker to join
+    bool done;               // the worker has stored result. Read with cvRectTrackerDone
+    icvMutex mutex;          // guards done
+    icvThread thread;
+} CvRectTracker;
+
+CvRectTracker* cvCreateRectTracker( int num_particles );
+void cvReleaseRectTracker( CvRectTracker** tracker );
+void cvRectTrackerSeed( CvRectTracker* tracker, const IplImage* frame, CvRect32f rect32f );
+void cvRectTrackerStart( CvRectTracker* tracker, const IplImage* next );
+bool cvRectTrackerDone( CvRectTracker* tracker );
+bool cvRectTrackerFinish( CvRectTracker* tracker, CvRect32f* result );
+
+/**
+ * Allocate a rectangle tracker
+ *
+ * @param num_particles
+ * @return CvRectTracker*
+ */
+CvRectTracker* cvCreateRectTracker( int num_particles )
+{
+    CvRectTracker* t = new CvRectTracker;
+    t->num_particles = num_particles;
+    t->mp       = NULL;
+    t->prev     = NULL;
+    t->next     = NULL;
+    t->seeded   = false;
+    t->busy     = false;
+    t->threaded = false;
+    t->done     = false;
+    icvInitMutex( &t->mutex );
+    return t;
+}
+
+/**
+ * Release a rectangle tracker. A running worker is joined first
+ *
+ * @param tracker
+ */
+void cvReleaseRectTracker( CvRectTracker** _t )
+{
+    CvRectTracker* t = *_t;
+    CvRect32f dummy;
+    if( !t ) return;
+    cvRectTrackerFinish( t, &dummy );
+    cvReleaseMultiParticle( &t->mp );
+    cvReleaseImage( &t->prev );
+    icvDestroyMutex( &t->mutex );
+    delete t;
+    *_t = NULL;
+}
+
+/**
+ * Remember the rectangle of the current frame
+ *
+ * The frame is copied since video capture reuses its buffer.
+ *
+ * @param tracker
+ * @param frame
+ * @param rect32f
+ */
+void cvRectTrackerSeed( CvRectTracker* t, const IplImage* frame, CvRect32f rect32f )
+{
+    CvRect32f dummy;
+    cvRectTrackerFinish( t, &dummy );
+    if( t->prev && ( t->prev->width != frame->width || t->prev->height != frame->height ||
+                     t->prev->nChannels != frame->nChannels ) )
+    {
+        cvReleaseImage( &t->prev );
+        cvReleaseMultiParticle( &t->mp );
+    }
+    if( !t->prev )
+        t->prev = cvCreateImage( cvGetSize( frame ), frame->depth, frame->nChannels );
+    if( !t->mp )
+        t->mp = cvCreateMultiParticle( cvGetSize( frame ), 1, t->num_particles,
+                                       cvParticleState( 0, 0, 0, 0, 0 ) );
+    cvCopy( frame, t->prev );
+    t->seed = rect32f;
+    t->seeded = true;
+}
+
+// Worker: re-seed the filter on prev and run one step into next
+void icvRectTrackerRun( void* _t )
+{
+    CvRectTracker* t = (CvRectTracker*)_t;
+    CvMultiParticle* mp = t->mp;
+    // search a quarter of the size around, a few percent of scale and degrees
+    mp->std = cvParticleState( t->seed.width / 4, t->seed.height / 4,
+                               t->seed.width / 32, t->seed.height / 32, 2 );
+    while( mp->num_targets > 0 )
+        cvMultiParticleRemove( mp, mp->ids[0] );
+    int id = cvMultiParticleAdd( mp, t->prev, t->seed );
+    cvMultiParticleUpdate( mp, t->next );
+    t->result = cvMultiParticleGet( mp, id );
+    icvLockMutex( &t->mutex );
+    t->done = true;
+    icvUnlockMutex( &t->mutex );
+}
+
+/**
+ * Track the seeded rectangle into the next frame in the background
+ *
+ * Runs in the calling thread if no thread can be created.
+ *
+ * @param tracker
+ * @param next     Must not change until cvRectTrackerFinish
+ */
+void cvRectTrackerStart( CvRectTracker* t, const IplImage* next )
+{
+    if( !t->seeded || t->busy ) return;
+    t->seeded   = false;
+    t->next = next;
+    t->done = false;
+    t->busy = true;
+    t->threaded = icvStartThread( &t->thread, icvRectTrackerRun, t );
+    if( !t->threaded )
+        icvRectTrackerRun( t );
+}
+
+/**
+ * Check without blocking whether the tracking result is ready
+ *
+ * @param tracker
+ * @return bool    true if cvRectTrackerFinish would not wait
+ */
+bool cvRectTrackerDone( CvRectTracker* t )
+{
+    icvLockMutex( &t->mutex );
+    bool done = t->done;
+    icvUnlockMutex( &t->mutex );
+    return done;
+}
+
+/**
+ * Wait for the tracking result
+ *
+ * @param tracker
+ * @param result   [out] Tracked rectangle
+ * @return bool    false if nothing was being tracked
+ */
+bool cvRectTrackerFinish( CvRectTracker* t, CvRect32f* result )
+{
+    if( !t->busy ) return false;
+    if( t->threaded )
+        icvJoinThread( &t->thread );
+    t->busy = t->threaded = false;
+    *result = t->result;
+    return true;
+}
+
+
+#endif
@@ -0,0 +1,589 @@
+/** @file
+ * Headless imageclipper driven by newline-delimited JSON
+ *
+ * Every line read from the input is one command object, and every command
+ * is answered by one line on the output, in order:
+ *
+ *   {"cmd":"open","path":"imgdir"}                  directory, image or video
+ *   {"cmd":"seek","index":12} / {"cmd":"seek","frame":300}
+ *   {"cmd":"rect","x":10,"y":20,"width":120,"height":40,"rotate":5,"shear_x":0,"shear_y":0}
+ *   {"cmd":"save"}                                   crop and save as the GUI's S key does
+ *   {"cmd":"next"} / {"cmd":"prev"}
+ *   {"cmd":"delete"}                                 delete the current image and go to the next
+ *   {"cmd":"status"} / {"cmd":"flush"} / {"cmd":"quit"}
+ *
+ *   {"ok":true,"id":7,"file":"/data/a.jpg","index":0,"frame":1,"width":1280,"height":720}
+ *   {"ok":false,"id":8,"error":"no source is open"}
+ *
+ * Fields of "rect" that are left out keep their values. An "id" field of
+ * a command is echoed in its response. Responses are flushed only when no
+ * further input is already buffered, so a batch of commands costs one
+ * write.
+ *
+ * Decoding and saving run beside command processing: after each move in
+ * a directory the next image is decoded on a worker thread, and a saved
+ * crop is encoded and written on another while the following commands
+ * are read. "flush" waits for the pending write and reports failed writes.
+ *
+ * The MIT License
+ *
+ * Copyright (c) OpenALPR contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef IC_HEADLESS_INCLUDED
+#define IC_HEADLESS_INCLUDED
+
+#include "cv.h"
+#include "cxcore.h"
+#include "highgui.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+using namespace std;
+#include "filesystem.h"
+#include "icformat.h"
+#include "icjson.h"
+#include "icmetrics.h"
+#include "opencvx/cvrect32f.h"
+#include "opencvx/cvcropimageroi.h"
+#include "opencvx/cvthread.h"
+
+/******************************** Session ************************************/
+
+typedef struct IcHeadless {
+    // config
+    vector<string> imtypes;
+    string imgout_format;
+    string vidout_format;
+    string output_format;      // overrides both when not empty
+    // source
+    string source;             // opened path, empty if none
+    vector<string> filelist;   // directory or image source
+    int index;
+    CvCapture* cap;            // video source
+    int frame;
+    bool reseek;               // capture position unknown after a failed query
+    IplImage* img;             // current image. capture buffer for video
+    // rectangle
+    CvRect rect;
+    int rotate;
+    CvPoint shear;
+    // decode ahead (directories)
+    icvThread prefetch_thread;
+    bool prefetching;
+    int prefetch_index;
+    string prefetch_path;
+    IplImage* prefetch_img;
+    // write behind
+    icvThread save_thread;
+    bool saving;
+    string save_path;
+    IplImage* save_img;
+    bool save_ok;
+    int write_errors;
+} IcHeadless;
+
+IcHeadless* icCreateHeadless( const vector<string>& imtypes, const string& imgout_format,
+                              const string& vidout_format, const string& output_format );
+void icReleaseHeadless( IcHeadless** hl );
+int icHeadlessLoop( IcHeadless* hl, istream& in, ostream& out );
+
+IcHeadless* icCreateHeadless( const vector<string>& imtypes, const string& imgout_format,
+                              const string& vidout_format, const string& output_format )
+{
+    IcHeadless* hl = new IcHeadless;
+    hl->imtypes = imtypes;
+    hl->imgout_format = imgout_format;
+    hl->vidout_format = vidout_format;
+    hl->output_format = output_format;
+    hl->index = 0;
+    hl->cap = NULL;
+    hl->frame = 1;
+    hl->reseek = false;
+    hl->img = NULL;
+    hl->rect = cvRect( 0, 0, 0, 0 );
+    hl->rotate = 0;
+    hl->shear = cvPoint( 0, 0 );
+    hl->prefetching = false;
+    hl->prefetch_index = -1;
+    hl->prefetch_img = NULL;
+    hl->saving = false;
+    hl->save_img = NULL;
+    hl->save_ok = true;
+    hl->write_errors = 0;
+    return hl;
+}
+
+void icHeadlessPrefetchRun( void* _hl )
+{
+    IcHeadless* hl = (IcHeadless*)_hl;
+    int64 start = icMetricsStart();
+    hl->prefetch_img = cvLoadImage( hl->prefetch_path.c_str() );
+    if( hl->prefetch_img )
+    {
+        icMetricsObserve( IC_STAGE_DECODE, start );
+        icMetricsCount( IC_IMAGES_DECODED );
+    }
+    icMetricsThreadExit();
+}
+
+void icHeadlessWriteRun( void* _hl )
+{
+    IcHeadless* hl = (IcHeadless*)_hl;
+    int64 start = icMetricsStart();
+    hl->save_ok = cvSaveImage( hl->save_path.c_str(), hl->save_img ) != 0;
+    cvReleaseImage( &hl->save_img );
+    if( hl->save_ok )
+    {
+        struct stat st;
+        icMetricsObserve( IC_STAGE_WRITE, start );
+        icMetricsCount( IC_CROPS_SAVED );
+        if( stat( hl->save_path.c_str(), &st ) == 0 ) icMetricsCount( IC_BYTES_WRITTEN, st.st_size );
+    }
+    else
+        icMetricsCount( IC_WRITE_ERRORS );
+    icMetricsThreadExit();
+}
+
+// wait for the pending decode. Its image is kept for a matching load
+void icHeadlessJoinPrefetch( IcHeadless* hl )
+{
+    if( !hl->prefetching ) return;
+    icvJoinThread( &hl->prefetch_thread );
+    hl->prefetching = false;
+    icMetricsGauge( IC_PREFETCH_QUEUE, 0 );
+}
+
+void icHeadlessDropPrefetch( IcHeadless* hl )
+{
+    icHeadlessJoinPrefetch( hl );
+    if( hl->prefetch_img ) cvReleaseImage( &hl->prefetch_img );
+    hl->prefetch_index = -1;
+}
+
+void icHeadlessJoinWrite( IcHeadless* hl )
+{
+    if( !hl->saving ) return;
+    icvJoinThread( &hl->save_thread );
+    hl->saving = false;
+    icMetricsGauge( IC_WRITE_QUEUE, 0 );
+    if( !hl->save_ok )
+    {
+        cerr << "Cannot write " << hl->save_path << endl;
+        hl->write_errors++;
+    }
+}
+
+void icHeadlessClose( IcHeadless* hl )
+{
+    icHeadlessDropPrefetch( hl );
+    if( hl->cap ) cvReleaseCapture( &hl->cap ); // owns img
+    else if( hl->img ) cvReleaseImage( &hl->img );
+    hl->img = NULL;
+    hl->filelist.clear();
+    hl->source.clear();
+}
+
+void icReleaseHeadless( IcHeadless** _hl )
+{
+    IcHeadless* hl = *_hl;
+    if( !hl ) return;
+    icHeadlessJoinWrite( hl );
+    icHeadlessClose( hl );
+    delete hl;
+    *_hl = NULL;
+}
+
+// start decoding filelist[index] in the background
+void icHeadlessPrefetch( IcHeadless* hl, int index )
+{
+    if( hl->cap || index < 0 || index >= (int)hl->filelist.size() ) return;
+    if( hl->prefetch_index == index ) return;
+    icHeadlessDropPrefetch( hl );
+    hl->prefetch_index = index;
+    hl->prefetch_path = filesystem::realpath( hl->filelist[index] );
+    hl->prefetching = icvStartThread( &hl->prefetch_thread, icHeadlessPrefetchRun, hl );
+    if( hl->prefetching ) icMetricsGauge( IC_PREFETCH_QUEUE, 1 );
+    else icHeadlessPrefetchRun( hl );
+}
+
+// make filelist[index] current, from the prefetched image when it is that one
+bool icHeadlessLoadIndex( IcHeadless* hl, int index, int direction, string& error )
+{
+    if( index < 0 || index >= (int)hl->filelist.size() )
+    {
+        error = "index out of range";
+        return false;
+    }
+    IplImage* img = NULL;
+    if( hl->prefetch_index == index )
+    {
+        icHeadlessJoinPrefetch( hl );
+        img = hl->prefetch_img;
+        hl->prefetch_img = NULL;
+        hl->prefetch_index = -1;
+    }
+    if( !img )
+    {
+        int64 start = icMetricsStart();
+        img = cvLoadImage( filesystem::realpath( hl->filelist[index] ).c_str() );
+        if( img )
+        {
+            icMetricsObserve( IC_STAGE_DECODE, start );
+            icMetricsCount( IC_IMAGES_DECODED );
+        }
+    }
+    if( !img )
+    {
+        error = "cannot decode " + hl->filelist[index];
+        return false;
+    }
+    if( hl->img ) cvReleaseImage( &hl->img );
+    hl->img = img;
+    hl->index = index;
+    icHeadlessPrefetch( hl, index + ( direction < 0 ? -1 : 1 ) );
+    return true;
+}
+
+bool icHeadlessLoadFrame( IcHeadless* hl, int frame, string& error )
+{
+    if( frame < 1 )
+    {
+        error = "frame out of range";
+        return false;
+    }
+    // sequential decoding is much cheaper than a seek
+    if( frame != hl->frame + 1 || hl->reseek )
+        cvSetCaptureProperty( hl->cap, CV_CAP_PROP_POS_FRAMES, frame - 1 );
+    if( frame > hl->frame + 1 )
+        icMetricsCount( IC_FRAMES_SKIPPED, frame - hl->frame - 1 );
+    int64 start = icMetricsStart();
+    IplImage* img = cvQueryFrame( hl->cap );
+    if( !img )
+    {
+        error = "frame out of range";
+        // the failed seek or query moved the capture. Read the shown frame
+        // again so that img and frame agree, and seek on the next load
+        hl->reseek = true;
+        if( hl->frame >= 1 )
+        {
+            cvSetCaptureProperty( hl->cap, CV_CAP_PROP_POS_FRAMES, hl->frame - 1 );
+            hl->img = cvQueryFrame( hl->cap );
+        }
+        else
+            hl->img = NULL;
+        hl->reseek = hl->img == NULL;
+        return false;
+    }
+    hl->reseek = false;
+    icMetricsObserve( IC_STAGE_DECODE, start );
+    icMetricsCount( IC_IMAGES_DECODED );
+    hl->img = img;
+    hl->frame = frame;
+    return true;
+}
+
+/**
+ * Open a directory, an image (and the directory it is in) or a video
+ */
+bool icHeadlessOpen( IcHeadless* hl, const string& path, int frame, string& error )
+{
+    icHeadlessClose( hl );
+    bool is_dir = filesystem::is_dir( path );
+    bool is_image = !is_dir && filesystem::match_extensions( path, hl->imtypes );
+    if( !filesystem::exists( path ) )
+    {
+        error = path + " does not exist";
+        return false;
+    }
+    if( is_dir || is_image )
+    {
+        hl->filelist = filesystem::filelist( is_dir ? path : filesystem::dirname( path ), hl->imtypes, "file" );
+        int index = 0;
+        if( is_image )
+        {
+            for( index = 0; index < (int)hl->filelist.size(); index++ )
+                if( filesystem::realpath( hl->filelist[index] ) == filesystem::realpath( path ) ) break;
+        }
+        if( hl->filelist.empty() )
+        {
+            error = "no image file in " + path;
+            return false;
+        }
+        if( !icHeadlessLoadIndex( hl, index, 1, error ) )
+        {
+            hl->filelist.clear();
+            return false;
+        }
+    }
+    else
+    {
+        hl->cap = cvCaptureFromFile( filesystem::realpath( path ).c_str() );
+        hl->frame = 0;
+        hl->reseek = false;
+        if( !hl->cap || !icHeadlessLoadFrame( hl, frame, error ) )
+        {
+            if( hl->cap ) cvReleaseCapture( &hl->cap );
+            error = path + " is not loadable as a video";
+            return false;
+        }
+    }
+    hl->source = path;
+    return true;
+}
+
+// the current image or video file
+string icHeadlessFilename( const IcHeadless* hl )
+{
+    return hl->cap ? hl->source : hl->filelist[hl->index];
+}
+
+/**
+ * Crop the current rectangle and queue the write, as the GUI's S key does
+ */
+bool icHeadlessSave( IcHeadless* hl, string& saved, string& error )
+{
+    if( !hl->img )
+    {
+        error = "no image is loaded";
+        return false;
+    }
+    if( hl->rect.width <= 0 || hl->rect.height <= 0 )
+    {
+        error = "empty rectangle";
+        return false;
+    }
+    string filename = icHeadlessFilename( hl );
+    string format = !hl->output_format.empty() ? hl->output_format :
+                    hl->cap ? hl->vidout_format : hl->imgout_format;
+    string output_path = icFormat( format, filesystem::dirname( filename ),
+                                   filesystem::filename( filename ), filesystem::extension( filename ),
+                                   hl->rect.x, hl->rect.y, hl->rect.width, hl->rect.height,
+                                   hl->frame, hl->rotate );
+    if( !filesystem::match_extensions( output_path, hl->imtypes ) )
+    {
+        error = "the image type " + filesystem::extension( output_path ) + " is not supported";
+        return false;
+    }
+    filesystem::r_mkdir( filesystem::dirname( output_path ) );
+
+    // the crop is taken now, video frames are reused by the capture
+    int64 start = icMetricsStart();
+    IplImage* crop = cvCreateImage( cvSize( hl->rect.width, hl->rect.height ),
+                                    hl->img->depth, hl->img->nChannels );
+    cvCropImageROI( hl->img, crop, cvRect32fFromRect( hl->rect, hl->rotate ), cvPointTo32f( hl->shear ) );
+    icMetricsObserve( IC_STAGE_CROP, start );
+    icHeadlessJoinWrite( hl );
+    hl->save_path = filesystem::realpath( output_path );
+    hl->save_img = crop;
+    hl->saving = icvStartThread( &hl->save_thread, icHeadlessWriteRun, hl );
+    if( hl->saving ) icMetricsGauge( IC_WRITE_QUEUE, 1 );
+    else
+    {
+        icHeadlessWriteRun( hl );
+        if( !hl->save_ok ) hl->write_errors++;
+    }
+    saved = hl->save_path;
+
+    // annotation line, the same file and format the GUI appends to
+    string meta_path = filesystem::dirname( filename ) + "/imageclipper/" + filesystem::filename( filename ) + ".txt";
+    filesystem::r_mkdir( filesystem::dirname( meta_path ) );
+    ofstream meta( meta_path.c_str(), std::ofstream::out | std::ofstream::app );
+    meta << filesystem::filename( filename ) << "." << filesystem::extension( filename ) << "\t";
+    if( hl->cap ) meta << hl->frame << "\t";
+    meta << hl->rect.x << "\t" << hl->rect.y << "\t" << hl->rect.width << "\t" << hl->rect.height << endl;
+    return true;
+}
+
+/**
+ * Delete the current image file and show the next one (the previous one
+ * at the end of the list)
+ */
+bool icHeadlessDelete( IcHeadless* hl, string& deleted, string& error )
+{
+    if( hl->cap )
+    {
+        error = "delete is supported for images only";
+        return false;
+    }
+    deleted = filesystem::realpath( hl->filelist[hl->index] );
+    icHeadlessDropPrefetch( hl );
+    if( remove( deleted.c_str() ) != 0 )
+    {
+        error = "cannot delete " + deleted;
+        return false;
+    }
+    hl->filelist.erase( hl->filelist.begin() + hl->index );
+    cvReleaseImage( &hl->img );
+    hl->index = min( hl->index, (int)hl->filelist.size() - 1 );
+    if( hl->filelist.empty() )
+    {
+        icHeadlessClose( hl );
+        return true;
+    }
+    if( !icHeadlessLoadIndex( hl, hl->index, 1, error ) )
+    {
+        // the delete is done, but no image is left to show
+        icHeadlessClose( hl );
+        error = "deleted " + deleted + ", " + error;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Run one command and write its response fields after "ok"
+ *
+ * @return bool  false on quit
+ */
+bool icHeadlessCommand( IcHeadless* hl, const IcJsonObject& cmd, ostream& out )
+{
+    IcJsonObject::const_iterator it = cmd.find( "cmd" );
+    string name = it != cmd.end() ? it->second.str : "";
+    string error, saved, deleted;
+    bool ok = true, quit = false;
+    int value;
+
+    if( name == "open" )
+    {
+        it = cmd.find( "path" );
+        int frame = 1;
+        icJsonInt( cmd, "frame", &frame );
+        if( it == cmd.end() ) ok = false, error = "open needs a path";
+        else ok = icHeadlessOpen( hl, it->second.str, frame, error );
+    }
+    else if( name == "quit" )
+    {
+        quit = true;
+    }
+    else if( name == "flush" || name == "status" )
+    {
+        if( name == "flush" ) icHeadlessJoinWrite( hl );
+    }
+    else if( hl->source.empty() )
+    {
+        ok = false;
+        error = name.empty() ? "no cmd" : "no source is open";
+    }
+    else if( !hl->img && ( name == "save" || name == "next" || name == "prev" || name == "seek" || name == "delete" ) )
+    {
+        ok = false;
+        error = "no image is loaded";
+    }
+    else if( name == "rect" )
+    {
+        icJsonInt( cmd, "x", &hl->rect.x );
+        icJsonInt( cmd, "y", &hl->rect.y );
+        icJsonInt( cmd, "width", &hl->rect.width );
+        icJsonInt( cmd, "height", &hl->rect.height );
+        if( icJsonInt( cmd, "rotate", &value ) ) hl->rotate = ( value % 360 + 360 ) % 360;
+        icJsonInt( cmd, "shear_x", &hl->shear.x );
+        icJsonInt( cmd, "shear_y", &hl->shear.y );
+    }
+    else if( name == "save" )
+        ok = icHeadlessSave( hl, saved, error );
+    else if( name == "next" )
+        ok = hl->cap ? icHeadlessLoadFrame( hl, hl->frame + 1, error )
+                     : icHeadlessLoadIndex( hl, hl->index + 1, 1, error );
+    else if( name == "prev" )
+        ok = hl->cap ? icHeadlessLoadFrame( hl, hl->frame - 1, error )
+                     : icHeadlessLoadIndex( hl, hl->index - 1, -1, error );
+    else if( name == "seek" )
+    {
+        if( hl->cap && icJsonInt( cmd, "frame", &value ) )
+            ok = icHeadlessLoadFrame( hl, value, error );
+        else if( !hl->cap && icJsonInt( cmd, "index", &value ) )
+            ok = icHeadlessLoadIndex( hl, value, value < hl->index ? -1 : 1, error );
+        else
+            ok = false, error = hl->cap ? "seek needs a frame" : "seek needs an index";
+    }
+    else if( name == "delete" )
+        ok = icHeadlessDelete( hl, deleted, error );
+    else
+    {
+        ok = false;
+        error = "unknown cmd " + name;
+    }
+
+    out << ( ok ? "{\"ok\":true" : "{\"ok\":false" );
+    it = cmd.find( "id" );
+    if( it != cmd.end() )
+        out << ",\"id\":" << ( it->second.is_string ? icJsonQuote( it->second.str ) : it->second.str );
+    if( !ok )
+        out << ",\"error\":" << icJsonQuote( error );
+    if( !saved.empty() )
+        out << ",\"saved\":" << icJsonQuote( saved );
+    if( !deleted.empty() )
+        out << ",\"deleted\":" << icJsonQuote( deleted );
+    if( !hl->source.empty() && hl->img )
+    {
+        out << ",\"file\":" << icJsonQuote( filesystem::realpath( icHeadlessFilename( hl ) ) );
+        if( hl->cap ) out << ",\"frame\":" << hl->frame;
+        else out << ",\"index\":" << hl->index << ",\"count\":" << hl->filelist.size();
+        out << ",\"width\":" << hl->img->width << ",\"height\":" << hl->img->height;
+        out << ",\"rect\":[" << hl->rect.x << "," << hl->rect.y << "," << hl->rect.width << ","
+            << hl->rect.height << "],\"rotate\":" << hl->rotate
+            << ",\"shear\":[" << hl->shear.x << "," << hl->shear.y << "]";
+    }
+    if( name == "flush" || name == "status" )
+        out << ",\"write_errors\":" << hl->write_errors;
+    out << "}\n";
+    return !quit;
+}
+
+/**
+ * Read commands until quit or end of input
+ *
+ * Pending input is only visible through in.rdbuf()->in_avail() if the
+ * stream buffers, so for cin call ios::sync_with_stdio( false ) first.
+ *
+ * @param hl
+ * @param in
+ * @param out
+ * @return int  0, or 1 if a crop could not be written
+ */
+int icHeadlessLoop( IcHeadless* hl, istream& in, ostream& out )
+{
+    string line;
+    IcJsonObject cmd;
+    while( getline( in, line ) )
+    {
+        if( line.find_first_not_of( " \t\r" ) == string::npos ) continue;
+        bool more = true;
+        if( !icJsonParse( line, cmd ) )
+            out << "{\"ok\":false,\"error\":" << icJsonQuote( "malformed command: " + line ) << "}\n";
+        else
+            more = icHeadlessCommand( hl, cmd, out );
+        if( !more ) break;
+        if( in.rdbuf()->in_avail() <= 0 ) out.flush();
+    }
+    out.flush();
+    icHeadlessJoinWrite( hl );
+    return hl->write_errors > 0 ? 1 : 0;
+}
+
+
+#endif
@@ -0,0 +1,168 @@
+/** @file
+ * Flat JSON objects, one per line
+ *
+ * Just enough JSON for the line protocols of the headless mode and the
+ * crop daemon: an object of string, number, true, false or null values.
+ * Nested objects and arrays are rejected.
+ *
+ * The MIT License
+ *
+ * Copyright (c) OpenALPR contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef IC_JSON_INCLUDED
+#define IC_JSON_INCLUDED
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string>
+#include <map>
+using namespace std;
+
+typedef struct IcJsonValue {
+    string str;       // unescaped string, or the literal token of a number, true, false or null
+    bool is_string;
+} IcJsonValue;
+
+typedef map<string, IcJsonValue> IcJsonObject;
+
+// quoted string starting at line[pos] == '"'. pos ends after the closing quote
+inline bool icJsonParseString( const string& line, size_t& pos, string& out )
+{
+    out.clear();
+    for( pos++; pos < line.size(); pos++ )
+    {
+        char c = line[pos];
+        if( c == '"' ) { pos++; return true; }
+        if( c != '\\' ) { out += c; continue; }
+        if( ++pos >= line.size() ) return false;
+        switch( line[pos] )
+        {
+        case 'n': out += '\n'; break;
+        case 't': out += '\t'; break;
+        case 'r': out += '\r'; break;
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'u': // only the ASCII range is kept as is
+            if( pos + 4 >= line.size() ) return false;
+            {
+                int code = (int)strtol( line.substr( pos + 1, 4 ).c_str(), NULL, 16 );
+                out += code < 128 ? (char)code : '?';
+            }
+            pos += 4;
+            break;
+        default: out += line[pos]; break; // \" \\ \/
+        }
+    }
+    return false;
+}
+
+/**
+ * Parse a flat JSON object. Nested objects and arrays are not accepted
+ *
+ * @param line
+ * @param obj   [out]
+ * @return bool false if the line is not a flat object
+ */
+inline bool icJsonParse( const string& line, IcJsonObject& obj )
+{
+    size_t pos = line.find_first_not_of( " \t\r" );
+    obj.clear();
+    if( pos == string::npos || line[pos] != '{' ) return false;
+    pos = line.find_first_not_of( " \t\r", pos + 1 );
+    if( pos != string::npos && line[pos] == '}' ) return true;
+    while( pos != string::npos && pos < line.size() )
+    {
+        string key;
+        IcJsonValue value;
+        if( line[pos] != '"' || !icJsonParseString( line, pos, key ) ) return false;
+        pos = line.find_first_not_of( " \t\r", pos );
+        if( pos == string::npos || line[pos] != ':' ) return false;
+        pos = line.find_first_not_of( " \t\r", pos + 1 );
+        if( pos == string::npos ) return false;
+        value.is_string = line[pos] == '"';
+        if( value.is_string )
+        {
+            if( !icJsonParseString( line, pos, value.str ) ) return false;
+        }
+        else
+        {
+            size_t end = line.find_first_of( ",} \t\r", pos );
+            if( end == string::npos || end == pos || line[pos] == '{' || line[pos] == '[' ) return false;
+            value.str = line.substr( pos, end - pos );
+            pos = end;
+        }
+        obj[key] = value;
+        pos = line.find_first_not_of( " \t\r", pos );
+        if( pos == string::npos ) return false;
+        if( line[pos] == '}' ) return true;
+        if( line[pos] != ',' ) return false;
+        pos = line.find_first_not_of( " \t\r", pos + 1 );
+    }
+    return false;
+}
+
+inline string icJsonQuote( const string& str )
+{
+    string out = "\"";
+    for( size_t i = 0; i < str.size(); i++ )
+    {
+        unsigned char c = str[i];
+        if( c == '"' || c == '\\' ) { out += '\\'; out += c; }
+        else if( c == '\n' ) out += "\\n";
+        else if( c == '\t' ) out += "\\t";
+        else if( c < 0x20 )
+        {
+            char buf[8];
+            sprintf( buf, "\\u%04x", c );
+            out += buf;
+        }
+        else out += c;
+    }
+    return out + "\"";
+}
+
+inline bool icJsonInt( const IcJsonObject& obj, const char* key, int* value )
+{
+    IcJsonObject::const_iterator it = obj.find( key );
+    if( it == obj.end() || it->second.is_string ) return false;
+    *value = (int)floor( atof( it->second.str.c_str() ) + 0.5 );
+    return true;
+}
+
+inline bool icJsonReal( const IcJsonObject& obj, const char* key, double* value )
+{
+    IcJsonObject::const_iterator it = obj.find( key );
+    if( it == obj.end() || it->second.is_string ) return false;
+    *value = atof( it->second.str.c_str() );
+    return true;
+}
+
+inline bool icJsonString( const IcJsonObject& obj, const char* key, string* value )
+{
+    IcJsonObject::const_iterator it = obj.find( key );
+    if( it == obj.end() || !it->second.is_string ) return false;
+    *value = it->second.str;
+    return true;
+}
+
+
+#endif
@@ -0,0 +1,416 @@
+/** @file
+ * Counters, gauges and stage latency histograms for long batch runs
+ *
+ * Nothing is recorded until icStartMetrics is called. From then on every
+ * thread counts into its own shard under the shard's own lock, so
+ * icMetricsCount and icMetricsObserve only wait while a scrape reads
+ * that shard. A background thread sums the shards
+ * every interval and replaces the given file with the Prometheus text
+ * exposition format (written to path.tmp and renamed, as the node_exporter
+ * textfile collector expects). icStopMetrics writes the file one last
+ * time and prints a summary.
+ *
+ * Example)
+ * <code>
+ * icStartMetrics( "/var/lib/node_exporter/imageclipper.prom", 10 );
+ * int64 start = icMetricsStart();
+ * IplImage* img = cvLoadImage( path );
+ * icMetricsObserve( IC_STAGE_DECODE, start );
+ * icMetricsCount( IC_IMAGES_DECODED );
+ * icStopMetrics( cerr );
+ * </code>
+ *
+ * Thread functions end with icMetricsThreadExit so that a batch run that
+ * starts a thread per task keeps one shard per running thread.
+ *
+ * The MIT License
+ *
+ * Copyright (c) OpenALPR contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef IC_METRICS_INCLUDED
+#define IC_METRICS_INCLUDED
+
+#include "cxcore.h"
+#include <stdio.h>
+#include <string.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+#include "opencvx/cvthread.h"
+#if !( defined(WIN32) || defined(_WIN32) || defined(WIN64) )
+#include <unistd.h>
+#endif
+
+typedef enum IcCounter {
+    IC_IMAGES_DECODED,
+    IC_FRAMES_SKIPPED,
+    IC_CROPS_SAVED,
+    IC_BYTES_WRITTEN,
+    IC_WRITE_ERRORS,
+    IC_CACHE_HITS,
+    IC_CACHE_MISSES,
+    IC_NUM_COUNTERS
+} IcCounter;
+
+typedef enum IcGauge {
+    IC_PREFETCH_QUEUE,
+    IC_WRITE_QUEUE,
+    IC_CONNECTIONS,
+    IC_CACHE_BYTES,
+    IC_NUM_GAUGES
+} IcGauge;
+
+typedef enum IcStage {
+    IC_STAGE_DECODE,
+    IC_STAGE_CROP,
+    IC_STAGE_ENCODE,
+    IC_STAGE_WRITE,
+    IC_STAGE_REQUEST,
+    IC_NUM_STAGES
+} IcStage;
+
+static const char* ic_counter_names[][2] = {
+    { "images_decoded_total", "Images and video frames decoded" },
+    { "frames_skipped_total", "Video frames passed over by seeks" },
+    { "crops_saved_total", "Crops saved or sent" },
+    { "bytes_written_total", "Bytes of encoded crops saved or sent" },
+    { "write_errors_total", "Crops that could not be written" },
+    { "cache_hits_total", "Crop requests served from a cached source" },
+    { "cache_misses_total", "Crop requests that decoded their source" }
+};
+static const char* ic_gauge_names[][2] = {
+    { "prefetch_queue_depth", "Images being decoded ahead" },
+    { "write_queue_depth", "Crops waiting to be written" },
+    { "connections", "Open client connections" },
+    { "cache_bytes", "Bytes of decoded sources in the cache" }
+};
+static const char* ic_stage_names[] = { "decode", "crop", "encode", "write", "request" };
+
+// upper bounds in seconds. the last bucket is +Inf
+#define IC_NUM_BUCKETS 12
+static const double ic_bucket_bounds[IC_NUM_BUCKETS - 1] = {
+    0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 1.0
+};
+
+typedef struct IcMetricsCounts {
+    int64 counters[IC_NUM_COUNTERS];
+    int64 buckets[IC_NUM_STAGES][IC_NUM_BUCKETS];
+    double sums[IC_NUM_STAGES];
+} IcMetricsCounts;
+
+typedef struct IcMetricsShard {
+    IcMetricsCounts counts;
+    icvMutex mutex;                  // taken by its thread to write, by a scrape to read
+} IcMetricsShard;
+
+typedef struct IcMetrics {
+    volatile bool enabled;
+    bool stop;                       // guarded by mutex
+    string path;
+    double interval;                 // seconds
+    double tick_frequency;           // cvGetTickCount ticks per second
+    icvMutex mutex;                  // shards, retired, gauges and stop
+    vector<IcMetricsShard*> shards;  // of running threads
+    IcMetricsCounts retired;         // sum of the shards of finished threads
+    int64 gauges[IC_NUM_GAUGES];
+    icvThread thread;
+    bool exporting;
+    int64 start_ticks;
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64)
+    DWORD key;
+#else
+    pthread_key_t key;
+#endif
+} IcMetrics;
+
+static IcMetrics ic_metrics;
+
+// fold the shard of a finishing thread into retired
+inline void icvMetricsRetire( void* _shard )
+{
+    IcMetricsShard* shard = (IcMetricsShard*)_shard;
+    // runs on the shard's own thread, and scrapes hold ic_metrics.mutex
+    icvLockMutex( &ic_metrics.mutex );
+    for( int i = 0; i < IC_NUM_COUNTERS; i++ )
+        ic_metrics.retired.counters[i] += shard->counts.counters[i];
+    for( int s = 0; s < IC_NUM_STAGES; s++ )
+    {
+        for( int b = 0; b < IC_NUM_BUCKETS; b++ )
+            ic_metrics.retired.buckets[s][b] += shard->counts.buckets[s][b];
+        ic_metrics.retired.sums[s] += shard->counts.sums[s];
+    }
+    for( size_t i = 0; i < ic_metrics.shards.size(); i++ )
+    {
+        if( ic_metrics.shards[i] != shard ) continue;
+        ic_metrics.shards.erase( ic_metrics.shards.begin() + i );
+        break;
+    }
+    icvUnlockMutex( &ic_metrics.mutex );
+    icvDestroyMutex( &shard->mutex );
+    delete shard;
+}
+
+inline IcMetricsShard* icvMetricsShard()
+{
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64)
+    IcMetricsShard* shard = (IcMetricsShard*)TlsGetValue( ic_metrics.key );
+#else
+    IcMetricsShard* shard = (IcMetricsShard*)pthread_getspecific( ic_metrics.key );
+#endif
+    if( shard ) return shard;
+    shard = new IcMetricsShard;
+    memset( &shard->counts, 0, sizeof( IcMetricsCounts ) );
+    icvInitMutex( &shard->mutex );
+    icvLockMutex( &ic_metrics.mutex );
+    ic_metrics.shards.push_back( shard );
+    icvUnlockMutex( &ic_metrics.mutex );
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64)
+    TlsSetValue( ic_metrics.key, shard ); // no exit hook, see icMetricsThreadExit
+#else
+    pthread_setspecific( ic_metrics.key, shard );
+#endif
+    return shard;
+}
+
+/**
+ * Fold the calling thread's counts into the retired total. Call it last
+ * in every thread function that records: Windows has no exit hook for
+ * the thread storage, and on POSIX it keeps the shard from outliving
+ * the thread that its joiner waits for
+ */
+inline void icMetricsThreadExit()
+{
+    if( !ic_metrics.enabled ) return;
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64)
+    IcMetricsShard* shard = (IcMetricsShard*)TlsGetValue( ic_metrics.key );
+    TlsSetValue( ic_metrics.key, NULL );
+#else
+    IcMetricsShard* shard = (IcMetricsShard*)pthread_getspecific( ic_metrics.key );
+    pthread_setspecific( ic_metrics.key, NULL );
+#endif
+    if( shard ) icvMetricsRetire( shard );
+}
+
+inline void icMetricsCount( IcCounter counter, int64 n = 1 )
+{
+    if( !ic_metrics.enabled ) return;
+    IcMetricsShard* shard = icvMetricsShard();
+    icvLockMutex( &shard->mutex );
+    shard->counts.counters[counter] += n;
+    icvUnlockMutex( &shard->mutex );
+}
+
+inline void icMetricsGauge( IcGauge gauge, int64 value )
+{
+    if( !ic_metrics.enabled ) return;
+    icvLockMutex( &ic_metrics.mutex );
+    ic_metrics.gauges[gauge] = value;
+    icvUnlockMutex( &ic_metrics.mutex );
+}
+
+// for gauges changed by several threads
+inline void icMetricsGaugeAdd( IcGauge gauge, int64 delta )
+{
+    if( !ic_metrics.enabled ) return;
+    icvLockMutex( &ic_metrics.mutex );
+    ic_metrics.gauges[gauge] += delta;
+    icvUnlockMutex( &ic_metrics.mutex );
+}
+
+inline int64 icMetricsStart()
+{
+    return ic_metrics.enabled ? cvGetTickCount() : 0;
+}
+
+/**
+ * Record the time from start (icMetricsStart) to now for a stage
+ */
+inline void icMetricsObserve( IcStage stage, int64 start )
+{
+    if( !ic_metrics.enabled ) return;
+    double seconds = ( cvGetTickCount() - start ) / ic_metrics.tick_frequency;
+    int b = 0;
+    while( b < IC_NUM_BUCKETS - 1 && seconds > ic_bucket_bounds[b] ) b++;
+    IcMetricsShard* shard = icvMetricsShard();
+    icvLockMutex( &shard->mutex );
+    shard->counts.buckets[stage][b]++;
+    shard->counts.sums[stage] += seconds;
+    icvUnlockMutex( &shard->mutex );
+}
+
+// sum the shards into total and copy the gauges
+inline void icvMetricsSum( IcMetricsCounts* total, int64* gauges )
+{
+    icvLockMutex( &ic_metrics.mutex );
+    *total = ic_metrics.retired;
+    for( size_t k = 0; k < ic_metrics.shards.size(); k++ )
+    {
+        IcMetricsShard* shard = ic_metrics.shards[k];
+        icvLockMutex( &shard->mutex );
+        for( int i = 0; i < IC_NUM_COUNTERS; i++ )
+            total->counters[i] += shard->counts.counters[i];
+        for( int s = 0; s < IC_NUM_STAGES; s++ )
+        {
+            for( int b = 0; b < IC_NUM_BUCKETS; b++ )
+                total->buckets[s][b] += shard->counts.buckets[s][b];
+            total->sums[s] += shard->counts.sums[s];
+        }
+        icvUnlockMutex( &shard->mutex );
+    }
+    for( int i = 0; i < IC_NUM_GAUGES; i++ )
+        gauges[i] = ic_metrics.gauges[i];
+    icvUnlockMutex( &ic_metrics.mutex );
+}
+
+inline bool icvMetricsWrite()
+{
+    IcMetricsCounts total;
+    int64 gauges[IC_NUM_GAUGES];
+    icvMetricsSum( &total, gauges );
+    stringstream out;
+    for( int i = 0; i < IC_NUM_COUNTERS; i++ )
+    {
+        out << "# HELP imageclipper_" << ic_counter_names[i][0] << " " << ic_counter_names[i][1] << "\n";
+        out << "# TYPE imageclipper_" << ic_counter_names[i][0] << " counter\n";
+        out << "imageclipper_" << ic_counter_names[i][0] << " " << total.counters[i] << "\n";
+    }
+    for( int i = 0; i < IC_NUM_GAUGES; i++ )
+    {
+        out << "# HELP imageclipper_" << ic_gauge_names[i][0] << " " << ic_gauge_names[i][1] << "\n";
+        out << "# TYPE imageclipper_" << ic_gauge_names[i][0] << " gauge\n";
+        out << "imageclipper_" << ic_gauge_names[i][0] << " " << gauges[i] << "\n";
+    }
+    out << "# HELP imageclipper_stage_seconds Time spent per call in each stage\n";
+    out << "# TYPE imageclipper_stage_seconds histogram\n";
+    for( int s = 0; s < IC_NUM_STAGES; s++ )
+    {
+        int64 count = 0;
+        for( int b = 0; b < IC_NUM_BUCKETS; b++ )
+        {
+            count += total.buckets[s][b];
+            out << "imageclipper_stage_seconds_bucket{stage=\"" << ic_stage_names[s] << "\",le=\"";
+            if( b < IC_NUM_BUCKETS - 1 ) out << ic_bucket_bounds[b];
+            else out << "+Inf";
+            out << "\"} " << count << "\n";
+        }
+        out << "imageclipper_stage_seconds_sum{stage=\"" << ic_stage_names[s] << "\"} " << total.sums[s] << "\n";
+        out << "imageclipper_stage_seconds_count{stage=\"" << ic_stage_names[s] << "\"} " << count << "\n";
+    }
+
+    string tmp = ic_metrics.path + ".tmp";
+    ofstream file( tmp.c_str() );
+    file << out.str();
+    file.close();
+    if( !file ) return false;
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64)
+    remove( ic_metrics.path.c_str() ); // rename does not replace on Windows
+#endif
+    return rename( tmp.c_str(), ic_metrics.path.c_str() ) == 0;
+}
+
+inline void icvMetricsExport( void* )
+{
+    int slices = 0;
+    for( ;; )
+    {
+        icvLockMutex( &ic_metrics.mutex );
+        bool stop = ic_metrics.stop;
+        icvUnlockMutex( &ic_metrics.mutex );
+        if( stop ) break;
+        // short sleeps so that icStopMetrics does not wait for a whole interval
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64)
+        Sleep( 100 );
+#else
+        usleep( 100000 );
+#endif
+        if( ++slices * 0.1 < ic_metrics.interval ) continue;
+        slices = 0;
+        if( !icvMetricsWrite() )
+            cerr << "Cannot write " << ic_metrics.path << endl;
+    }
+}
+
+/**
+ * Start recording and export to path every interval seconds
+ *
+ * @param path      Prometheus text file. Empty to keep only the summary
+ * @param interval  seconds
+ * @return bool     false if the export thread could not be started
+ */
+inline bool icStartMetrics( const string& path, double interval = 10 )
+{
+    if( ic_metrics.enabled ) return true;
+    memset( &ic_metrics.retired, 0, sizeof( IcMetricsCounts ) );
+    for( int i = 0; i < IC_NUM_GAUGES; i++ ) ic_metrics.gauges[i] = 0;
+    ic_metrics.path = path;
+    ic_metrics.interval = interval > 0 ? interval : 10;
+    ic_metrics.tick_frequency = cvGetTickFrequency() * 1e6;
+    ic_metrics.start_ticks = cvGetTickCount();
+    ic_metrics.stop = false;
+    icvInitMutex( &ic_metrics.mutex );
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64)
+    ic_metrics.key = TlsAlloc();
+#else
+    pthread_key_create( &ic_metrics.key, icvMetricsRetire );
+#endif
+    ic_metrics.enabled = true;
+    ic_metrics.exporting = !path.empty() && icvStartThread( &ic_metrics.thread, icvMetricsExport, NULL );
+    return path.empty() || ic_metrics.exporting;
+}
+
+/**
+ * Stop the export, write the file a last time and print a summary
+ *
+ * @param summary  e.g., cerr
+ */
+inline void icStopMetrics( ostream& summary )
+{
+    if( !ic_metrics.enabled ) return;
+    icvLockMutex( &ic_metrics.mutex );
+    ic_metrics.stop = true;
+    icvUnlockMutex( &ic_metrics.mutex );
+    if( ic_metrics.exporting ) icvJoinThread( &ic_metrics.thread );
+    if( !ic_metrics.path.empty() && !icvMetricsWrite() )
+        cerr << "Cannot write " << ic_metrics.path << endl;
+
+    IcMetricsCounts total;
+    int64 gauges[IC_NUM_GAUGES];
+    icvMetricsSum( &total, gauges );
+    double elapsed = ( cvGetTickCount() - ic_metrics.start_ticks ) / ic_metrics.tick_frequency;
+    summary << "Metrics over " << elapsed << " s" << endl;
+    for( int i = 0; i < IC_NUM_COUNTERS; i++ )
+        if( total.counters[i] ) summary << "  " << ic_counter_names[i][1] << ": " << total.counters[i] << endl;
+    for( int s = 0; s < IC_NUM_STAGES; s++ )
+    {
+        int64 count = 0;
+        for( int b = 0; b < IC_NUM_BUCKETS; b++ ) count += total.buckets[s][b];
+        if( count )
+            summary << "  " << ic_stage_names[s] << ": " << count << " calls, "
+                    << 1000 * total.sums[s] / count << " ms mean" << endl;
+    }
+    ic_metrics.enabled = false;
+}
+
+
+#endif
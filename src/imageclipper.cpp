@@ -44,16 +44,21 @@
 #include <vector>
 #include "filesystem.h"
 #include "icformat.h"
+#include "icheadless.h"
 #include "cvdrawwatershed.h"
 #include "opencvx/cvrect32f.h"
 #include "opencvx/cvdrawrectangle.h"
 #include "opencvx/cvcropimageroi.h"
 #include "opencvx/cvpointnorm.h"
+#include "opencvx/cvrunningbackground.h"
+#include "opencvx/cvrectkalman.h"
+#include "cvrecttracker.h"
 using namespace std;
 
 const std::string DEFAULT_OUTPUT_DIR = "imageclipper";
 const std::string DEFAULT_OUTPUT_IMG_FORMAT = "%d/" + DEFAULT_OUTPUT_DIR + "/%i.%e_%04r_%04x_%04y_%04w_%04h.png";
 const std::string DEFAULT_OUTPUT_VIDEO_FORMAT = "%d/" + DEFAULT_OUTPUT_DIR + "/%i.%e_%04f_%04r_%04x_%04y_%04w_%04h.png";
+const std::string FOREGROUND_WINDOW_NAME = "Foreground";
 
 // US plates use 12x6, EU plates use 16x4
 const float DEFAULT_ASPECT_WIDTH = 12;
@@ -86,6 +91,14 @@ typedef struct CvCallbackParam {
     CvCapture* cap;                     /**< video reading */
     float aspect_ratio;
     int frame;                          /**< iterator */
+    // moving region detection (video)
+    CvRunningBackground* bg;            /**< background model updated per decoded frame */
+    bool show_foreground;               /**< show the foreground mask window */
+    // rectangle tracking (video)
+    CvRectTracker* tracker;             /**< moves rect along on forward steps */
+    bool track;                         /**< tracking flag */
+    CvRectKalman* kalman;               /**< learns rect motion from saves */
+    CvRect32f auto_rect;                /**< rect as last placed automatically */
 } CvCallbackParam ;
 
 /**
@@ -99,6 +112,9 @@ typedef struct ArgParam {
     const char* output_format;
     float aspect_ratio;
     int   frame;
+    bool  headless;
+    const char* metrics;
+    float metrics_interval;
 } ArgParam;
 
 /************************* Function Prototypes ******************************/
@@ -108,6 +124,8 @@ void gui_usage();
 void mouse_callback( int event, int x, int y, int flags, void* _param );
 void load_reference( const ArgParam* arg, CvCallbackParam* param );
 void key_callback( const ArgParam* arg, CvCallbackParam* param );
+void show_foreground( const CvCallbackParam* param );
+void finish_tracking( CvCallbackParam* param );
 
 /************************* Main **********************************************/
 
@@ -154,12 +172,33 @@ int main( int argc, char *argv[] )
         DEFAULT_OUTPUT_VIDEO_FORMAT.c_str(),
         NULL,
 	DEFAULT_ASPECT,
-        1
+        1,
+        false,
+        NULL,
+        10
     };
     ArgParam *arg = &init_arg;
 
     // parse arguments
     arg_parse( argc, argv, arg );
+    if( arg->headless )
+    {
+        // stdout carries the responses, nothing else may be printed there.
+        // Unsynced streams buffer input, which lets a batch share one flush
+        ios::sync_with_stdio( false );
+        cin.tie( NULL );
+        if( arg->metrics && !icStartMetrics( arg->metrics, arg->metrics_interval ) )
+            cerr << "Cannot export metrics to " << arg->metrics << endl;
+        IcHeadless* hl = icCreateHeadless( param->imtypes, arg->imgout_format, arg->vidout_format,
+                                           arg->output_format ? arg->output_format : "" );
+        string error;
+        if( !icHeadlessOpen( hl, arg->reference, arg->frame, error ) )
+            cerr << error << endl;
+        int ret = icHeadlessLoop( hl, cin, cout );
+        icReleaseHeadless( &hl );
+        icStopMetrics( cerr );
+        return ret;
+    }
     gui_usage();
     load_reference( arg, param );
 
@@ -170,6 +209,11 @@ int main( int argc, char *argv[] )
     key_callback( arg, param );
     cvDestroyWindow( param->w_name );
     cvDestroyWindow( param->miniw_name );
+    if( param->show_foreground )
+        cvDestroyWindow( FOREGROUND_WINDOW_NAME.c_str() );
+    cvReleaseRunningBackground( &param->bg );
+    cvReleaseRectTracker( &param->tracker );
+    cvReleaseRectKalman( &param->kalman );
 }
 
 /**
@@ -243,6 +287,10 @@ void load_reference( const ArgParam* arg, CvCallbackParam* param )
         param->img->origin = 0;
         cvFlip( param->img );
 #endif
+        param->bg = cvCreateRunningBackground( param->img );
+        param->tracker = cvCreateRectTracker( 300 );
+        param->track = true;
+        param->kalman = cvCreateRectKalman();
     }
     else
     {
@@ -268,7 +316,14 @@ void key_callback( const ArgParam* arg, CvCallbackParam* param )
 
     while( true ) // key callback
     {
-        char key = cvWaitKey( 0 );
+        // poll while the tracker works in the background
+        bool tracking = param->tracker && param->tracker->busy;
+        char key = cvWaitKey( tracking ? 10 : 0 );
+        if( tracking && ( key != (char)-1 || cvRectTrackerDone( param->tracker ) ) )
+        {
+            finish_tracking( param );
+        }
+        if( key == (char)-1 ) continue;
 
         // 32 is SPACE
         if( key == 's' || key == 32 ) // Save
@@ -317,6 +372,12 @@ void key_callback( const ArgParam* arg, CvCallbackParam* param )
 		metaFile.open(output_meta_file.c_str(), std::ofstream::out | std::ofstream::app);
 		metaFile << meta_file_content.str();
 		metaFile.close();
+
+                if( param->kalman )
+                {
+                    cvRectKalmanCorrect( param->kalman, 
+                        cvRect32fFromRect( param->rect, param->rotate ), param->frame );
+                }
             }
         }
 	if (key == 'd')
@@ -337,6 +398,7 @@ void key_callback( const ArgParam* arg, CvCallbackParam* param )
                     cvFlip( param->img );
 #endif
                     param->frame++;
+                    cvUpdateRunningBackground( param->img, param->bg );
                     cout << "Now showing " << filesystem::realpath( filename ) << " " <<  param->frame << endl;
                 }
             }
@@ -360,6 +422,13 @@ void key_callback( const ArgParam* arg, CvCallbackParam* param )
         {
             if( param->cap )
             {
+                // the capture reuses the buffer of param->img, seed before querying
+                bool track = param->track && param->rect.width > 0 && param->rect.height > 0;
+                if( track )
+                {
+                    cvRectTrackerSeed( param->tracker, param->img,
+                                       cvRect32fFromRect( param->rect, param->rotate ) );
+                }
                 IplImage* tmpimg = cvQueryFrame( param->cap );
                 if( tmpimg != NULL )
                 //if( frame < cvGetCaptureProperty( param->cap, CV_CAP_PROP_FRAME_COUNT ) )
@@ -370,6 +439,21 @@ void key_callback( const ArgParam* arg, CvCallbackParam* param )
                     cvFlip( param->img );
 #endif
                     param->frame++;
+                    cvUpdateRunningBackground( param->img, param->bg );
+                    // continue the motion of the saves that led to this frame
+                    CvRect32f predicted;
+                    if( param->kalman->t == param->frame - 1 &&
+                        cvRectKalmanPredict( param->kalman, param->frame, &predicted ) )
+                    {
+                        param->rect = cvRectFromRect32f( predicted );
+                        param->rotate = cvRound( predicted.angle ) % 360;
+                    }
+                    if( track )
+                    {
+                        // shown with the predicted rect now, moved by finish_tracking
+                        param->auto_rect = cvRect32fFromRect( param->rect, param->rotate );
+                        cvRectTrackerStart( param->tracker, param->img );
+                    }
                     cout << "Now showing " << filesystem::realpath( filename ) << " " <<  param->frame << endl;
                 }
             }
@@ -400,6 +484,8 @@ void key_callback( const ArgParam* arg, CvCallbackParam* param )
                     param->img->origin = 0;
                     cvFlip( param->img );
 #endif
+                    // the model only follows forward decoding
+                    cvResetRunningBackground( param->img, param->bg );
                     cout << "Now showing " << filesystem::realpath( filename ) << " " <<  param->frame << endl;
                 }
             }
@@ -438,6 +524,34 @@ void key_callback( const ArgParam* arg, CvCallbackParam* param )
 		param->rect.width = param->img->width;
 		param->rect.height = param->img->height;
 	    }
+        else if( key == 'p' && param->bg ) // Propose the largest moving region
+        {
+            CvRect region = cvRunningBackgroundRegion( param->bg );
+            if( region.width > 0 && region.height > 0 )
+            {
+                param->watershed = false;
+                param->rotate    = 0;
+                param->shear.x   = param->shear.y = 0;
+                param->rect      = region;
+            }
+        }
+        else if( key == 'g' && param->bg ) // Toggle foreground window
+        {
+            param->show_foreground = !param->show_foreground;
+            if( param->show_foreground )
+                cvNamedWindow( FOREGROUND_WINDOW_NAME.c_str(), CV_WINDOW_AUTOSIZE );
+            else
+                cvDestroyWindow( FOREGROUND_WINDOW_NAME.c_str() );
+        }
+        else if( key == 't' && param->tracker ) // Toggle tracking
+        {
+            param->track = !param->track;
+            cout << "Tracking: " << ( param->track ? "on" : "off" ) << endl;
+        }
+        if( param->show_foreground )
+        {
+            show_foreground( param );
+        }
         if( param->watershed ) // watershed
         {
             // Rectangle Movement (Vi like hotkeys)
@@ -628,6 +742,42 @@ void key_callback( const ArgParam* arg, CvCallbackParam* param )
     }
 }
 
+/**
+ * Take the tracked rectangle unless the user has moved it meanwhile
+ */
+void finish_tracking( CvCallbackParam* param )
+{
+    CvRect32f tracked;
+    if( !cvRectTrackerFinish( param->tracker, &tracked ) ) return;
+    CvRect rect = cvRectFromRect32f( param->auto_rect );
+    if( param->watershed || param->rect.x != rect.x || param->rect.y != rect.y ||
+        param->rect.width != rect.width || param->rect.height != rect.height ||
+        param->rotate != cvRound( param->auto_rect.angle ) )
+        return;
+    if( tracked.width < 1 || tracked.height < 1 ) return;
+
+    param->rect = cvRectFromRect32f( tracked );
+    param->rotate = cvRound( tracked.angle ) % 360;
+    param->rotate = ( param->rotate < 0 ) ? 360 + param->rotate : param->rotate;
+    cvShowImageAndRectangle( param->w_name, param->img, 
+                             cvRect32fFromRect( param->rect, param->rotate ), 
+                             cvPointTo32f( param->shear ) );
+    cvShowCroppedImage( param->miniw_name, param->img, 
+                        cvRect32fFromRect( param->rect, param->rotate ), 
+                        cvPointTo32f( param->shear ) );
+}
+
+/**
+ * Show the foreground mask of the background model
+ */
+void show_foreground( const CvCallbackParam* param )
+{
+    IplImage* display = cvCreateImage( cvGetSize( param->bg->foreground ), IPL_DEPTH_8U, 1 );
+    cvConvertScale( param->bg->foreground, display, 255 );
+    cvShowImage( FOREGROUND_WINDOW_NAME.c_str(), display );
+    cvReleaseImage( &display );
+}
+
 /**
 * cvSetMouseCallback function
 */
@@ -870,6 +1020,18 @@ void arg_parse( int argc, char** argv, ArgParam *arg )
         {
             arg->frame = atoi( argv[++i] );
         }
+        else if( !strcmp( argv[i], "--headless" ) )
+        {
+            arg->headless = true;
+        }
+        else if( !strcmp( argv[i], "--metrics" ) )
+        {
+            arg->metrics = argv[++i];
+        }
+        else if( !strcmp( argv[i], "--metrics_interval" ) )
+        {
+            arg->metrics_interval = atof( argv[++i] );
+        }
         else
         {
             arg->reference = string( argv[i] );
@@ -920,6 +1082,14 @@ void usage( const ArgParam* arg )
     cout << "    -r" << endl;
     cout << "    --aspect_ratio <aspect_ratio = 2>" << endl;
     cout << "        Lock the aspect ratio to a particular value.  For example, USA style plate should use a value of 2." << endl;
+    cout << "    --headless" << endl;
+    cout << "        Open no window. Read JSON commands, one per line, from stdin and" << endl;
+    cout << "        answer each with one JSON line on stdout. See icheadless.h." << endl;
+    cout << "    --metrics <file> (headless)" << endl;
+    cout << "        Write counters and stage latencies to <file> in the Prometheus" << endl;
+    cout << "        text format and print a summary to stderr at exit." << endl;
+    cout << "    --metrics_interval <seconds = 10>" << endl;
+    cout << "        How often the metrics file is rewritten." << endl;
     cout << "    -h" << endl;
     cout << "    --help" << endl;
     cout << "        Show this help" << endl;
@@ -945,6 +1115,9 @@ void gui_usage()
     cout << "    SPACE                   : Save and Forward." << endl;
     cout << "    b (backward)            : Backward. " << endl;
     cout << "    d (delete)              : Delete the current file. " << endl;
+    cout << "    p (propose)             : Select the largest moving region. (video)" << endl;
+    cout << "    g (foreground)          : Show or hide moving pixels. (video)" << endl;
+    cout << "    t (track)               : Move the rectangle along on forward. (video)" << endl;
     cout << "    q (quit) or ESC         : Quit. " << endl;
     cout << "    e (expand) E (shrink)   : Expand the recntagle size." << endl;
     cout << "    + (incl)   - (decl)     : Increment the step size to increment." << endl;
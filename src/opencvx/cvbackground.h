@@ -27,13 +27,47 @@
 #include "cv.h"
 #include "cvaux.h"
 #include "cxcore.h"
+#include "cvsimd.h"
 
 CVAPI(void) cvBackground( const IplImage* _img, const IplImage* _ref, IplImage* _mask, int thresh = 100 );
 
+// Scalar pass of cvBackground for 32F inputs of equal depth
+CV_INLINE void icvBackground32f( const IplImage* _img, const IplImage* _ref, IplImage* _mask, int thresh )
+{
+    int x, y, ch;
+    int width = _img->width;
+    int cn = _img->nChannels;
+    float fthresh = (float)thresh;
+    for( y = 0; y < _img->height; y++ )
+    {
+        const float* img = (const float*)( _img->imageData + _img->widthStep * y );
+        const float* ref = (const float*)( _ref->imageData + _ref->widthStep * y );
+        uchar* mask = (uchar*)( _mask->imageData + _mask->widthStep * y );
+        for( x = 0; x < width; x++ )
+        {
+            float dist = 0;
+            for( ch = 0; ch < cn; ch++ )
+            {
+                float d = img[x * cn + ch] - ref[x * cn + ch];
+                dist = ( ch == 0 ) ? d * d : dist + d * d;
+            }
+            mask[x] = dist > fthresh ? 1 : 0;
+        }
+    }
+}
+
 /**
 // Obtain non-background pixels using reference image (such as previous frame in video )
 //
-// @param mg     The target image
+// mask = ( sum over channels of (img - ref)^2 > thresh ) ? 1 : 0, computed
+// in one pass without temporary images. 8U inputs are processed 16 pixels
+// at a time with SSE2 integer arithmetic, which is exact, so the mask is
+// identical to the former convert, subtract, square, split, add and
+// threshold sequence. 32F inputs take a scalar path with the same
+// floating point operation order. Any other depth, or img and ref of
+// different depths, are converted to 32F temporaries first as before.
+//
+// @param mg     The target image. 1 or 3 channels
 // @param ref    The reference image. Usually the previous frame of video
 // @param mask   The generated mask image where 0 is for bg and 1 is for non-bg. Must be 8U and 1 channel
 // @param [thresh = 100] The threshold. [0 - 255^2] for single channel image. [0 - 255^2 * 3] for 3 channel image.
@@ -41,45 +75,94 @@ CVAPI(void) cvBackground( const IplImage* _img, const IplImage* _ref, IplImage*
 */
 CVAPI(void) cvBackground( const IplImage* _img, const IplImage* _ref, IplImage* _mask, int thresh )
 {
+    int x, y, ch;
+    int width = _img->width;
+    int cn = _img->nChannels;
     CV_FUNCNAME( "cvBackground" ); // error handling
     __BEGIN__;
     CV_ASSERT( _img->width == _ref->width );
     CV_ASSERT( _img->width == _mask->width );
     CV_ASSERT( _img->height == _ref->height );
-    CV_ASSERT( _img->height == _ref->height );
+    CV_ASSERT( _img->height == _mask->height );
     CV_ASSERT( _img->nChannels == _ref->nChannels );
     CV_ASSERT( _mask->nChannels == 1 );
     CV_ASSERT( _mask->depth == IPL_DEPTH_8U );
+    CV_ASSERT( cn == 1 || cn == 3 );
 
-    IplImage *img = cvCreateImage( cvGetSize(_img), IPL_DEPTH_32F, _img->nChannels );
-    IplImage *ref = cvCreateImage( cvGetSize(_img), IPL_DEPTH_32F, _img->nChannels );
-    IplImage *mask = cvCreateImage( cvGetSize(_img), IPL_DEPTH_32F, 1 );
-    cvConvert( _img, img );
-    cvConvert( _ref, ref );
-    cvSub( img, ref, img );
-    cvMul( img, img, img ); // square
+    if( _img->depth == IPL_DEPTH_8U && _ref->depth == IPL_DEPTH_8U )
+    {
+        for( y = 0; y < _img->height; y++ )
+        {
+            const uchar* img = (const uchar*)( _img->imageData + _img->widthStep * y );
+            const uchar* ref = (const uchar*)( _ref->imageData + _ref->widthStep * y );
+            uchar* mask = (uchar*)( _mask->imageData + _mask->widthStep * y );
+            x = 0;
+#if CV_SIMD_SSE2
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i one  = _mm_set1_epi8( 1 );
+            const __m128i vthresh = _mm_set1_epi32( thresh );
+            for( ; x <= width - 16; x += 16 )
+            {
+                __m128i d0, d1, d2, r0, r1, r2;
+                if( cn == 3 )
+                {
+                    icvLoadDeinterleaveBGR( img + x * 3, d0, d1, d2 );
+                    icvLoadDeinterleaveBGR( ref + x * 3, r0, r1, r2 );
+                    // |a - b| for unsigned bytes
+                    d1 = _mm_or_si128( _mm_subs_epu8( d1, r1 ), _mm_subs_epu8( r1, d1 ) );
+                    d2 = _mm_or_si128( _mm_subs_epu8( d2, r2 ), _mm_subs_epu8( r2, d2 ) );
+                }
+                else
+                {
+                    d0 = _mm_loadu_si128( (const __m128i*)( img + x ) );
+                    r0 = _mm_loadu_si128( (const __m128i*)( ref + x ) );
+                    d1 = d2 = zero;
+                }
+                d0 = _mm_or_si128( _mm_subs_epu8( d0, r0 ), _mm_subs_epu8( r0, d0 ) );
 
-    if( img->nChannels > 1 )
-    {        
-        IplImage* imgB = cvCreateImage( cvGetSize(img), img->depth, 1 );
-        IplImage* imgG = cvCreateImage( cvGetSize(img), img->depth, 1 );
-        IplImage* imgR = cvCreateImage( cvGetSize(img), img->depth, 1 );
-        cvSplit( img, imgB, imgG, imgR, NULL );
-        cvAdd( imgB, imgG, mask );
-        cvAdd( mask, imgR, mask );
-        cvReleaseImage( &imgB );
-        cvReleaseImage( &imgG );
-        cvReleaseImage( &imgR );
+                __m128i gt[4];
+                for( int q = 0; q < 4; q++ )
+                {
+                    __m128i a16 = ( q < 2 ) ? _mm_unpacklo_epi8( d0, zero ) : _mm_unpackhi_epi8( d0, zero );
+                    __m128i b16 = ( q < 2 ) ? _mm_unpacklo_epi8( d1, zero ) : _mm_unpackhi_epi8( d1, zero );
+                    __m128i c16 = ( q < 2 ) ? _mm_unpacklo_epi8( d2, zero ) : _mm_unpackhi_epi8( d2, zero );
+                    __m128i ab = ( q & 1 ) ? _mm_unpackhi_epi16( a16, b16 ) : _mm_unpacklo_epi16( a16, b16 );
+                    __m128i c0 = ( q & 1 ) ? _mm_unpackhi_epi16( c16, zero ) : _mm_unpacklo_epi16( c16, zero );
+                    // madd of (a, b) with itself is a^2 + b^2 per pixel
+                    __m128i dist = _mm_add_epi32( _mm_madd_epi16( ab, ab ), _mm_madd_epi16( c0, c0 ) );
+                    gt[q] = _mm_cmpgt_epi32( dist, vthresh );
+                }
+                __m128i res = _mm_packs_epi16( _mm_packs_epi32( gt[0], gt[1] ), 
+                                               _mm_packs_epi32( gt[2], gt[3] ) );
+                _mm_storeu_si128( (__m128i*)( mask + x ), _mm_and_si128( res, one ) );
+            }
+#endif
+            for( ; x < width; x++ )
+            {
+                int dist = 0;
+                for( ch = 0; ch < cn; ch++ )
+                {
+                    int d = img[x * cn + ch] - ref[x * cn + ch];
+                    dist += d * d;
+                }
+                mask[x] = dist > thresh ? 1 : 0;
+            }
+        }
+    }
+    else if( _img->depth == IPL_DEPTH_32F && _ref->depth == IPL_DEPTH_32F )
+    {
+        icvBackground32f( _img, _ref, _mask, thresh );
     }
     else
     {
-        cvCopy( img, mask );
+        IplImage *img = cvCreateImage( cvGetSize(_img), IPL_DEPTH_32F, cn );
+        IplImage *ref = cvCreateImage( cvGetSize(_img), IPL_DEPTH_32F, cn );
+        cvConvert( _img, img );
+        cvConvert( _ref, ref );
+        icvBackground32f( img, ref, _mask, thresh );
+        cvReleaseImage( &img );
+        cvReleaseImage( &ref );
     }
-    cvThreshold( mask, _mask, thresh, 1, CV_THRESH_BINARY );
-
-    cvReleaseImage( &img );
-    cvReleaseImage( &ref );
-    cvReleaseImage( &mask );
     __END__;
 }
 
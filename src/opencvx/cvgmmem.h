@@ -0,0 +1,428 @@
+/** @file
+ * Expectation-Maximization training of Gaussian Mixture Models
+ *
+ * The trained model holds means, covs and weights in the layout of
+ * cvMatGmmPdf (cvgmmpdf.h), so it can be evaluated directly:
+ * <code>
+ * CvGmmModel* gmm = cvCreateGmmModel( 3, 16, CV_GMM_DIAGONAL );
+ * cvTrainGmmEM( samples, gmm );   // samples is D x N
+ * cvSaveGmmModel( "plate.xml", gmm );
+ * ...
+ * CvGmmModel* gmm = cvLoadGmmModel( "plate.xml" );
+ * cvMatGmmPdf( samples, gmm->means, gmm->covs, gmm->weights, probs, true );
+ * </code>
+ *
+ * The E-step and the accumulation of the M-step statistics are one pass
+ * over the samples, split across threads with OpenMP. Each thread sums
+ * its own statistics, so no N x K responsibility matrix is stored.
+ *
+ * The MIT License
+ *
+ * Copyright (c) OpenALPR contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CV_GMMEM_INCLUDED
+#define CV_GMMEM_INCLUDED
+
+#include "cv.h"
+#include "cvaux.h"
+#include "cxcore.h"
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <float.h>
+#include <vector>
+using namespace std;
+
+/******************************* Structures **********************************/
+
+#define CV_GMM_DIAGONAL 0
+#define CV_GMM_FULL     1
+
+typedef struct CvGmmModel {
+    int D;             // dimension
+    int K;             // number of components
+    int covtype;       // CV_GMM_DIAGONAL or CV_GMM_FULL
+    CvMat* means;      // D x K CV_64FC1
+    CvMat** covs;      // K of D x D CV_64FC1. off-diagonals are 0 for CV_GMM_DIAGONAL
+    CvMat* weights;    // 1 x K CV_64FC1
+    double min_var;    // variance floor added to every diagonal in the M-step
+} CvGmmModel;
+
+/**************************** Function Prototypes ****************************/
+
+CvGmmModel* cvCreateGmmModel( int D, int K, int covtype = CV_GMM_DIAGONAL );
+void cvReleaseGmmModel( CvGmmModel** gmm );
+double cvTrainGmmEM( const CvMat* samples, CvGmmModel* gmm,
+                     CvTermCriteria term = cvTermCriteria( CV_TERMCRIT_ITER + CV_TERMCRIT_EPS, 100, 1e-4 ),
+                     CvRNG rng = cvRNG( -1 ) );
+void cvSaveGmmModel( const char* filename, const CvGmmModel* gmm );
+CvGmmModel* cvLoadGmmModel( const char* filename );
+
+/*************************** Function Definitions ****************************/
+
+/**
+ * Allocate a GMM
+ *
+ * @param D        Dimension
+ * @param K        Number of components
+ * @param covtype  CV_GMM_DIAGONAL or CV_GMM_FULL
+ * @return CvGmmModel*
+ */
+CvGmmModel* cvCreateGmmModel( int D, int K, int covtype )
+{
+    CvGmmModel* gmm = NULL;
+    CV_FUNCNAME( "cvCreateGmmModel" );
+    __BEGIN__;
+    CV_ASSERT( D > 0 && K > 0 );
+    CV_ASSERT( covtype == CV_GMM_DIAGONAL || covtype == CV_GMM_FULL );
+    gmm = (CvGmmModel*)cvAlloc( sizeof(CvGmmModel) );
+    gmm->D = D;
+    gmm->K = K;
+    gmm->covtype = covtype;
+    gmm->means = cvCreateMat( D, K, CV_64FC1 );
+    gmm->covs = (CvMat**)cvAlloc( K * sizeof(CvMat*) );
+    for( int k = 0; k < K; k++ )
+    {
+        gmm->covs[k] = cvCreateMat( D, D, CV_64FC1 );
+        cvSetIdentity( gmm->covs[k] );
+    }
+    gmm->weights = cvCreateMat( 1, K, CV_64FC1 );
+    cvSet( gmm->weights, cvScalar( 1.0 / K ) );
+    cvZero( gmm->means );
+    gmm->min_var = 1.0; // a pixel value step
+    __END__;
+    return gmm;
+}
+
+/**
+ * Release a GMM
+ *
+ * @param gmm
+ */
+void cvReleaseGmmModel( CvGmmModel** _gmm )
+{
+    CvGmmModel* gmm = *_gmm;
+    if( !gmm ) return;
+    for( int k = 0; k < gmm->K; k++ )
+        cvReleaseMat( &gmm->covs[k] );
+    cvFree( &gmm->covs );
+    cvReleaseMat( &gmm->means );
+    cvReleaseMat( &gmm->weights );
+    cvFree( _gmm );
+}
+
+/**
+ * Covariance of all samples, used to start and to revive components
+ */
+CV_INLINE void icvGmmGlobalCov( const CvMat* X, const CvGmmModel* gmm, CvMat* cov )
+{
+    int D = X->rows, N = X->cols, i, j, n;
+    vector<double> mu( D, 0.0 );
+    for( i = 0; i < D; i++ )
+    {
+        const double* row = (const double*)( X->data.ptr + X->step * i );
+        for( n = 0; n < N; n++ ) mu[i] += row[n];
+        mu[i] /= N;
+    }
+    for( i = 0; i < D; i++ )
+    {
+        const double* ri = (const double*)( X->data.ptr + X->step * i );
+        for( j = i; j < D; j++ )
+        {
+            const double* rj = (const double*)( X->data.ptr + X->step * j );
+            double s = 0;
+            if( i == j || gmm->covtype == CV_GMM_FULL )
+                for( n = 0; n < N; n++ ) s += ( ri[n] - mu[i] ) * ( rj[n] - mu[j] );
+            s /= N;
+            if( i == j ) s += gmm->min_var;
+            cvmSet( cov, i, j, s );
+            cvmSet( cov, j, i, s );
+        }
+    }
+}
+
+/**
+ * Train a GMM with Expectation-Maximization
+ *
+ * Components start at K random samples with the covariance of
+ * all samples and equal weights. A component that loses all of its
+ * samples is restarted the same way.
+ *
+ * @param samples  D x N samples. CV_32FC1 or CV_64FC1
+ * @param gmm      Model to train. D must match
+ * @param [term]   Stops after term.max_iter iterations or when the mean
+ *                 log likelihood improves less than term.epsilon
+ * @param [rng]    Random state for the initialization
+ * @return double  Mean log likelihood of the samples under the model
+ */
+double cvTrainGmmEM( const CvMat* samples, CvGmmModel* gmm, CvTermCriteria term, CvRNG rng )
+{
+    int D = gmm->D, K = gmm->K;
+    int N = samples->cols;
+    int DD = gmm->covtype == CV_GMM_FULL ? D * D : D; // statistics per component
+    double loglik = -DBL_MAX;
+    CvMat* X = NULL;
+    CvMat* globalcov = NULL;
+    CV_FUNCNAME( "cvTrainGmmEM" );
+    __BEGIN__;
+    CV_ASSERT( CV_IS_MAT(samples) && samples->rows == D && N >= K );
+    CV_ASSERT( CV_MAT_TYPE(samples->type) == CV_32FC1 || CV_MAT_TYPE(samples->type) == CV_64FC1 );
+
+    int max_iter = ( term.type & CV_TERMCRIT_ITER ) ? term.max_iter : 100;
+    double eps = ( term.type & CV_TERMCRIT_EPS ) ? term.epsilon : 0;
+    int i, j, k, iter;
+
+    X = cvCreateMat( D, N, CV_64FC1 );
+    cvConvert( samples, X );
+    globalcov = cvCreateMat( D, D, CV_64FC1 );
+    icvGmmGlobalCov( X, gmm, globalcov );
+
+    // initialization
+    for( k = 0; k < K; k++ )
+    {
+        int n = cvRandInt( &rng ) % N;
+        for( i = 0; i < D; i++ )
+            cvmSet( gmm->means, i, k, cvmGet( X, i, n ) );
+        cvCopy( globalcov, gmm->covs[k] );
+        cvmSet( gmm->weights, 0, k, 1.0 / K );
+    }
+
+    // per component: inverse covariance (or inverse variances), log constant
+    vector<double> icov( K * DD ), logc( K );
+    vector<double> nk( K ), sx( K * D ), sxx( K * DD );
+
+    for( iter = 0; iter < max_iter; iter++ )
+    {
+        for( k = 0; k < K; k++ )
+        {
+            double logdet = 0;
+            if( gmm->covtype == CV_GMM_FULL )
+            {
+                CvMat inv = cvMat( D, D, CV_64FC1, &icov[k * DD] );
+                double det = cvInvert( gmm->covs[k], &inv, CV_SVD_SYM ) > 0 ? cvDet( gmm->covs[k] ) : 0;
+                logdet = log( MAX( det, DBL_MIN ) );
+            }
+            else
+            {
+                for( i = 0; i < D; i++ )
+                {
+                    double v = cvmGet( gmm->covs[k], i, i );
+                    icov[k * DD + i] = 1.0 / v;
+                    logdet += log( v );
+                }
+            }
+            logc[k] = log( MAX( cvmGet( gmm->weights, 0, k ), DBL_MIN ) )
+                    - 0.5 * ( D * log( 2 * M_PI ) + logdet );
+        }
+        fill( nk.begin(), nk.end(), 0.0 );
+        fill( sx.begin(), sx.end(), 0.0 );
+        fill( sxx.begin(), sxx.end(), 0.0 );
+        double total = 0;
+
+        // E-step and sufficient statistics in one parallel pass
+#ifdef _OPENMP
+#pragma omp parallel private(i, j, k)
+#endif
+        {
+            vector<double> tnk( K, 0.0 ), tsx( K * D, 0.0 ), tsxx( K * DD, 0.0 );
+            vector<double> x( D ), diff( D ), lp( K );
+            double ttotal = 0;
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+            for( int n = 0; n < N; n++ )
+            {
+                for( i = 0; i < D; i++ )
+                    x[i] = ((const double*)( X->data.ptr + X->step * i ))[n];
+                double maxlp = -DBL_MAX;
+                for( k = 0; k < K; k++ )
+                {
+                    const double* mu = gmm->means->data.db;
+                    const double* ic = &icov[k * DD];
+                    double m = 0;
+                    for( i = 0; i < D; i++ )
+                        diff[i] = x[i] - mu[i * K + k];
+                    if( gmm->covtype == CV_GMM_FULL )
+                    {
+                        for( i = 0; i < D; i++ )
+                        {
+                            double s = 0;
+                            for( j = 0; j < D; j++ ) s += ic[i * D + j] * diff[j];
+                            m += diff[i] * s;
+                        }
+                    }
+                    else
+                    {
+                        for( i = 0; i < D; i++ ) m += diff[i] * diff[i] * ic[i];
+                    }
+                    lp[k] = logc[k] - 0.5 * m;
+                    maxlp = MAX( maxlp, lp[k] );
+                }
+                double sum = 0;
+                for( k = 0; k < K; k++ )
+                {
+                    lp[k] = exp( lp[k] - maxlp );
+                    sum += lp[k];
+                }
+                ttotal += maxlp + log( sum );
+                for( k = 0; k < K; k++ )
+                {
+                    double r = lp[k] / sum;
+                    if( r < 1e-12 ) continue;
+                    tnk[k] += r;
+                    double* s1 = &tsx[k * D];
+                    double* s2 = &tsxx[k * DD];
+                    for( i = 0; i < D; i++ )
+                    {
+                        double rx = r * x[i];
+                        s1[i] += rx;
+                        if( gmm->covtype == CV_GMM_FULL )
+                            for( j = 0; j <= i; j++ ) s2[i * D + j] += rx * x[j];
+                        else
+                            s2[i] += rx * x[i];
+                    }
+                }
+            }
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+            {
+                total += ttotal;
+                for( k = 0; k < K; k++ ) nk[k] += tnk[k];
+                for( i = 0; i < K * D; i++ ) sx[i] += tsx[i];
+                for( i = 0; i < K * DD; i++ ) sxx[i] += tsxx[i];
+            }
+        }
+
+        // M-step
+        for( k = 0; k < K; k++ )
+        {
+            if( nk[k] < 1e-6 * N || nk[k] < 1.0 ) // dead component, restart at a random sample
+            {
+                int n = cvRandInt( &rng ) % N;
+                for( i = 0; i < D; i++ )
+                    cvmSet( gmm->means, i, k, cvmGet( X, i, n ) );
+                cvCopy( globalcov, gmm->covs[k] );
+                cvmSet( gmm->weights, 0, k, 1.0 / N );
+                continue;
+            }
+            cvmSet( gmm->weights, 0, k, nk[k] / N );
+            for( i = 0; i < D; i++ )
+                cvmSet( gmm->means, i, k, sx[k * D + i] / nk[k] );
+            for( i = 0; i < D; i++ )
+            {
+                double mi = sx[k * D + i] / nk[k];
+                if( gmm->covtype == CV_GMM_FULL )
+                {
+                    for( j = 0; j <= i; j++ )
+                    {
+                        double mj = sx[k * D + j] / nk[k];
+                        double c = sxx[k * DD + i * D + j] / nk[k] - mi * mj;
+                        if( i == j ) c = MAX( c, 0.0 ) + gmm->min_var;
+                        cvmSet( gmm->covs[k], i, j, c );
+                        cvmSet( gmm->covs[k], j, i, c );
+                    }
+                }
+                else
+                {
+                    double c = sxx[k * DD + i] / nk[k] - mi * mi;
+                    cvmSet( gmm->covs[k], i, i, MAX( c, 0.0 ) + gmm->min_var );
+                }
+            }
+        }
+        // weights of restarted components are tiny, keep the sum at 1
+        cvConvertScale( gmm->weights, gmm->weights, 1.0 / cvSum( gmm->weights ).val[0] );
+
+        double prev = loglik;
+        loglik = total / N;
+        if( iter > 0 && fabs( loglik - prev ) < eps ) break;
+    }
+    __END__;
+    cvReleaseMat( &X );
+    cvReleaseMat( &globalcov );
+    return loglik;
+}
+
+/**
+ * Write a GMM with cvOpenFileStorage (xml or yml by extension)
+ *
+ * @param filename
+ * @param gmm
+ */
+void cvSaveGmmModel( const char* filename, const CvGmmModel* gmm )
+{
+    CvFileStorage* fs = NULL;
+    CV_FUNCNAME( "cvSaveGmmModel" );
+    __BEGIN__;
+    CV_CALL( fs = cvOpenFileStorage( filename, NULL, CV_STORAGE_WRITE ) );
+    cvWriteInt( fs, "covtype", gmm->covtype );
+    cvWrite( fs, "means", gmm->means );
+    cvWrite( fs, "weights", gmm->weights );
+    cvStartWriteStruct( fs, "covs", CV_NODE_SEQ );
+    for( int k = 0; k < gmm->K; k++ )
+        cvWrite( fs, NULL, gmm->covs[k] );
+    cvEndWriteStruct( fs );
+    __END__;
+    cvReleaseFileStorage( &fs );
+}
+
+/**
+ * Read a GMM written by cvSaveGmmModel
+ *
+ * @param filename
+ * @return CvGmmModel*  NULL if the file is missing or not a GMM
+ */
+CvGmmModel* cvLoadGmmModel( const char* filename )
+{
+    CvGmmModel* gmm = NULL;
+    CvFileStorage* fs = cvOpenFileStorage( filename, NULL, CV_STORAGE_READ );
+    if( !fs ) return NULL;
+    CvMat* means   = (CvMat*)cvReadByName( fs, NULL, "means" );
+    CvMat* weights = (CvMat*)cvReadByName( fs, NULL, "weights" );
+    CvFileNode* covs = cvGetFileNodeByName( fs, NULL, "covs" );
+    int covtype = cvReadIntByName( fs, NULL, "covtype", CV_GMM_DIAGONAL );
+    if( means && weights && covs && CV_NODE_IS_SEQ( covs->tag ) &&
+        covs->data.seq->total == means->cols && weights->cols == means->cols )
+    {
+        int D = means->rows, K = means->cols, k;
+        gmm = cvCreateGmmModel( D, K, covtype );
+        cvConvert( means, gmm->means );
+        cvConvert( weights, gmm->weights );
+        for( k = 0; k < K; k++ )
+        {
+            CvMat* cov = (CvMat*)cvRead( fs, (CvFileNode*)cvGetSeqElem( covs->data.seq, k ) );
+            if( !cov || cov->rows != D || cov->cols != D )
+            {
+                if( cov ) cvReleaseMat( &cov );
+                cvReleaseGmmModel( &gmm );
+                break;
+            }
+            cvConvert( cov, gmm->covs[k] );
+            cvReleaseMat( &cov );
+        }
+    }
+    if( means ) cvReleaseMat( &means );
+    if( weights ) cvReleaseMat( &weights );
+    cvReleaseFileStorage( &fs );
+    return gmm;
+}
+
+
+#endif
@@ -0,0 +1,236 @@
+/** @file
+ * Per-frame image pyramid built lazily level by level
+ *
+ * Level l is the frame reduced by 2^l with cvPyrDown. A level, and its
+ * integral images, are computed only when first asked for after
+ * cvSetImagePyramid, so a frame pays only for the scales it is sampled
+ * at. Coordinates in pixel edges (integral image coordinates) map to
+ * level l by a division by 2^l.
+ *
+ * Example)
+ * <code>
+ * CvImagePyramid* pyr = cvCreateImagePyramid( cvGetSize(frame), 4 );
+ * cvSetImagePyramid( pyr, frame ); // for each frame
+ * int level = cvImagePyramidOctave( pyr, rect.width / patch->width );
+ * cvSampleRect32f( cvImagePyramidIntegral( pyr, level ), patch,
+ *                  cvImagePyramidRect32f( rect, level ) );
+ * cvReleaseImagePyramid( &pyr );
+ * </code>
+ *
+ * The MIT License
+ *
+ * Copyright (c) OpenALPR contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CV_IMAGEPYRAMID_INCLUDED
+#define CV_IMAGEPYRAMID_INCLUDED
+
+#include "cv.h"
+#include "cvaux.h"
+#include "cxcore.h"
+#include <math.h>
+#include "cvrect32f.h"
+
+/******************************* Structures **********************************/
+
+typedef struct CvImagePyramid {
+    int num_levels;
+    int channels;
+    IplImage** levels;   // 8U, levels[0] is a copy of the frame
+    CvMat** sums;        // CV_64FC(channels) integral of each level
+    CvMat** sqsums;      // CV_64FC(channels) integral of squares of each level
+    int built;           // levels [0, built) are valid for the current frame
+    int integrated;      // bit l set when sums[l] and sqsums[l] are valid
+} CvImagePyramid;
+
+/**************************** Function Prototypes ****************************/
+
+CvImagePyramid* cvCreateImagePyramid( CvSize size, int num_levels, int channels = 1 );
+void cvReleaseImagePyramid( CvImagePyramid** pyr );
+void cvSetImagePyramid( CvImagePyramid* pyr, const IplImage* frame );
+IplImage* cvImagePyramidLevel( CvImagePyramid* pyr, int level );
+CvMat* cvImagePyramidIntegral( CvImagePyramid* pyr, int level, CvMat** sqsum = NULL );
+CV_INLINE int cvImagePyramidOctave( const CvImagePyramid* pyr, double scale );
+CV_INLINE CvRect32f cvImagePyramidRect32f( CvRect32f rect32f, int level );
+
+/*************************** Function Definitions ****************************/
+
+/**
+ * Allocate a pyramid. Levels are allocated on first use
+ *
+ * @param size        Frame size
+ * @param num_levels  Number of levels including the frame itself
+ * @param channels    Channels kept. Frames of other channels are converted (BGR to gray)
+ * @return CvImagePyramid*
+ */
+CvImagePyramid* cvCreateImagePyramid( CvSize size, int num_levels, int channels )
+{
+    CvImagePyramid* pyr = NULL;
+    CV_FUNCNAME( "cvCreateImagePyramid" );
+    __BEGIN__;
+    CV_ASSERT( num_levels > 0 && num_levels < 31 );
+    CV_ASSERT( channels == 1 || channels == 3 );
+    pyr = (CvImagePyramid*)cvAlloc( sizeof(CvImagePyramid) );
+    pyr->num_levels = num_levels;
+    pyr->channels = channels;
+    pyr->levels = (IplImage**)cvAlloc( num_levels * sizeof(IplImage*) );
+    pyr->sums   = (CvMat**)cvAlloc( num_levels * sizeof(CvMat*) );
+    pyr->sqsums = (CvMat**)cvAlloc( num_levels * sizeof(CvMat*) );
+    for( int l = 0; l < num_levels; l++ )
+    {
+        pyr->levels[l] = NULL;
+        pyr->sums[l] = pyr->sqsums[l] = NULL;
+    }
+    pyr->levels[0] = cvCreateImage( size, IPL_DEPTH_8U, channels );
+    pyr->built = 0;
+    pyr->integrated = 0;
+    __END__;
+    return pyr;
+}
+
+/**
+ * Release a pyramid
+ *
+ * @param pyr
+ */
+void cvReleaseImagePyramid( CvImagePyramid** _pyr )
+{
+    CvImagePyramid* pyr = *_pyr;
+    if( !pyr ) return;
+    for( int l = 0; l < pyr->num_levels; l++ )
+    {
+        cvReleaseImage( &pyr->levels[l] );
+        cvReleaseMat( &pyr->sums[l] );
+        cvReleaseMat( &pyr->sqsums[l] );
+    }
+    cvFree( &pyr->levels );
+    cvFree( &pyr->sums );
+    cvFree( &pyr->sqsums );
+    cvFree( _pyr );
+}
+
+/**
+ * Start a new frame. Only level 0 is computed here
+ *
+ * @param pyr
+ * @param frame  8U, of the size given at creation
+ */
+void cvSetImagePyramid( CvImagePyramid* pyr, const IplImage* frame )
+{
+    CV_FUNCNAME( "cvSetImagePyramid" );
+    __BEGIN__;
+    CV_ASSERT( frame->width == pyr->levels[0]->width && frame->height == pyr->levels[0]->height );
+    if( frame->nChannels == pyr->channels )
+        cvCopy( frame, pyr->levels[0] );
+    else if( pyr->channels == 1 )
+        cvCvtColor( frame, pyr->levels[0], CV_BGR2GRAY );
+    else
+        cvCvtColor( frame, pyr->levels[0], CV_GRAY2BGR );
+    pyr->built = 1;
+    pyr->integrated = 0;
+    __END__;
+}
+
+/**
+ * Level of the current frame, reduced from the level above when needed
+ *
+ * @param pyr
+ * @param level  [0, num_levels)
+ * @return IplImage*
+ */
+IplImage* cvImagePyramidLevel( CvImagePyramid* pyr, int level )
+{
+    CV_FUNCNAME( "cvImagePyramidLevel" );
+    __BEGIN__;
+    CV_ASSERT( level >= 0 && level < pyr->num_levels && pyr->built > 0 );
+    for( ; pyr->built <= level; pyr->built++ )
+    {
+        int l = pyr->built;
+        IplImage* src = pyr->levels[l - 1];
+        if( !pyr->levels[l] )
+        {
+            pyr->levels[l] = cvCreateImage( cvSize( ( src->width + 1 ) / 2, ( src->height + 1 ) / 2 ),
+                                            IPL_DEPTH_8U, pyr->channels );
+        }
+        cvPyrDown( src, pyr->levels[l] );
+    }
+    __END__;
+    return pyr->levels[level];
+}
+
+/**
+ * Integral images of a level of the current frame
+ *
+ * @param pyr
+ * @param level   [0, num_levels)
+ * @param sqsum   [out] Integral of squares when not NULL
+ * @return CvMat* Integral
+ */
+CvMat* cvImagePyramidIntegral( CvImagePyramid* pyr, int level, CvMat** sqsum )
+{
+    IplImage* img = cvImagePyramidLevel( pyr, level );
+    if( !( pyr->integrated & ( 1 << level ) ) )
+    {
+        if( !pyr->sums[level] )
+        {
+            pyr->sums[level]   = cvCreateMat( img->height + 1, img->width + 1, CV_64FC(pyr->channels) );
+            pyr->sqsums[level] = cvCreateMat( img->height + 1, img->width + 1, CV_64FC(pyr->channels) );
+        }
+        cvIntegral( img, pyr->sums[level], pyr->sqsums[level] );
+        pyr->integrated |= 1 << level;
+    }
+    if( sqsum ) *sqsum = pyr->sqsums[level];
+    return pyr->sums[level];
+}
+
+/**
+ * Coarsest level where one unit of scale is still at least one pixel
+ *
+ * @param pyr
+ * @param scale  Level 0 pixels per output pixel, e.g., box width / patch width
+ * @return int   floor( log2( scale ) ) clamped to [0, num_levels)
+ */
+CV_INLINE int cvImagePyramidOctave( const CvImagePyramid* pyr, double scale )
+{
+    int level = 0;
+    while( scale >= 2.0 && level < pyr->num_levels - 1 )
+    {
+        scale *= 0.5;
+        level++;
+    }
+    return level;
+}
+
+/**
+ * Rectangle of level 0 expressed in level coordinates
+ *
+ * @param rect32f
+ * @param level
+ * @return CvRect32f
+ */
+CV_INLINE CvRect32f cvImagePyramidRect32f( CvRect32f rect32f, int level )
+{
+    float s = 1.0f / ( 1 << level );
+    return cvRect32f( rect32f.x * s, rect32f.y * s, rect32f.width * s, rect32f.height * s,
+                      rect32f.angle );
+}
+
+
+#endif
@@ -0,0 +1,99 @@
+/** @file
+ * Read-only memory mapping of a whole file
+ *
+ * Small wrapper over mmap (POSIX) and MapViewOfFile (Windows) so that
+ * binary model files can be used in place without being parsed.
+ *
+ * The MIT License
+ *
+ * Copyright (c) OpenALPR contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CV_MAPFILE_INCLUDED
+#define CV_MAPFILE_INCLUDED
+
+#include <stddef.h>
+
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Map a file read-only
+ *
+ * @param filename
+ * @param size      [out] Size of the file in bytes
+ * @return void*    Start of the mapping (page aligned), or NULL on failure
+ */
+inline void* icvMapFile( const char* filename, size_t* size )
+{
+    void* addr = NULL;
+    *size = 0;
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64)
+    HANDLE file = CreateFileA( filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                               OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+    if( file == INVALID_HANDLE_VALUE ) return NULL;
+    LARGE_INTEGER len;
+    if( GetFileSizeEx( file, &len ) && len.QuadPart > 0 ) {
+        HANDLE mapping = CreateFileMappingA( file, NULL, PAGE_READONLY, 0, 0, NULL );
+        if( mapping != NULL ) {
+            addr = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+            if( addr != NULL ) *size = (size_t)len.QuadPart;
+            CloseHandle( mapping ); // the view keeps the mapping alive
+        }
+    }
+    CloseHandle( file );
+#else
+    struct stat st;
+    int fd = open( filename, O_RDONLY );
+    if( fd < 0 ) return NULL;
+    if( fstat( fd, &st ) == 0 && st.st_size > 0 ) {
+        addr = mmap( NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+        if( addr == MAP_FAILED ) addr = NULL;
+        else *size = (size_t)st.st_size;
+    }
+    close( fd ); // the mapping stays valid after close
+#endif
+    return addr;
+}
+
+/**
+ * Unmap a mapping returned by icvMapFile
+ *
+ * @param addr
+ * @param size
+ */
+inline void icvUnmapFile( void* addr, size_t size )
+{
+    if( addr == NULL ) return;
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64)
+    UnmapViewOfFile( addr );
+#else
+    munmap( addr, size );
+#endif
+}
+
+
+#endif
@@ -0,0 +1,357 @@
+/** @file
+ * Multi-object tracking with one particle set per object
+ *
+ * Every target keeps its own CvParticle (cvparticlestaterect2.h states)
+ * and reference template, while the per-frame work (gray conversion,
+ * pyramid levels and their integral images) is done once in a
+ * CvParticleFrame shared by all of them. Each particle is observed at
+ * the pyramid octave of its scale, so large boxes cost as little as
+ * small ones and levels nobody needs are never built. Observation of
+ * all particles of all targets is one parallel batch with the NCC model
+ * of cvparticleobservencc.h.
+ *
+ * Example)
+ * <code>
+ * CvMultiParticle* mp = cvCreateMultiParticle( cvGetSize(frame), 8, 500,
+ *                                              cvParticleState( 3, 3, 2, 2, 1 ) );
+ * int id = cvMultiParticleAdd( mp, frame, rect32f );
+ * while( (frame = cvQueryFrame( video )) != NULL )
+ * {
+ *     cvMultiParticleUpdate( mp, frame );
+ *     CvRect32f rect = cvMultiParticleGet( mp, id );
+ * }
+ * cvReleaseMultiParticle( &mp );
+ * </code>
+ *
+ * The MIT License
+ *
+ * Copyright (c) OpenALPR contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CV_MULTIPARTICLE_INCLUDED
+#define CV_MULTIPARTICLE_INCLUDED
+
+#include "cv.h"
+#include "cvaux.h"
+#include "cxcore.h"
+#include <time.h>
+#include <vector>
+#include "cvparticle.h"
+#include "cvparticlestaterect2.h"
+#include "cvparticleobservencc.h"
+#include "cvimagepyramid.h"
+using namespace std;
+
+/******************************* Structures **********************************/
+
+typedef struct CvParticleFrame {
+    CvImagePyramid* pyr; // gray pyramid with lazily computed integral images
+} CvParticleFrame;
+
+typedef struct CvMultiParticle {
+    // config
+    int max_targets;
+    int num_particles;        // particles per target
+    CvSize imsize;
+    CvParticleState std;      // transition noise of every target
+    // targets, the first num_targets entries are in use
+    int num_targets;
+    int next_id;
+    int* ids;
+    CvParticle** targets;
+    CvMat** templs;           // zero-mean feature_size reference of each target
+    double* tnorms;           // sum of squares of each template
+    CvParticleState* estimates; // most probable state after the last update
+    // shared per-frame features
+    CvParticleFrame* frame;
+} CvMultiParticle;
+
+/**************************** Function Prototypes ****************************/
+
+CvParticleFrame* cvCreateParticleFrame( CvSize size, int num_levels = 4 );
+void cvReleaseParticleFrame( CvParticleFrame** f );
+void cvUpdateParticleFrame( const IplImage* frame, CvParticleFrame* f );
+
+CvMultiParticle* cvCreateMultiParticle( CvSize imsize, int max_targets, int num_particles,
+                                        CvParticleState std );
+void cvReleaseMultiParticle( CvMultiParticle** mp );
+int  cvMultiParticleAdd( CvMultiParticle* mp, const IplImage* frame, CvRect32f rect32f );
+void cvMultiParticleRemove( CvMultiParticle* mp, int id );
+void cvMultiParticleUpdate( CvMultiParticle* mp, const IplImage* frame );
+CvRect32f cvMultiParticleGet( const CvMultiParticle* mp, int id );
+
+/*************************** Function Definitions ****************************/
+
+/**
+ * Allocate shared per-frame features
+ *
+ * @param size        Frame size
+ * @param num_levels  Pyramid levels including the frame
+ * @return CvParticleFrame*
+ */
+CvParticleFrame* cvCreateParticleFrame( CvSize size, int num_levels )
+{
+    CvParticleFrame* f = (CvParticleFrame*)cvAlloc( sizeof(CvParticleFrame) );
+    f->pyr = cvCreateImagePyramid( size, num_levels, 1 );
+    return f;
+}
+
+/**
+ * Release shared per-frame features
+ *
+ * @param f
+ */
+void cvReleaseParticleFrame( CvParticleFrame** _f )
+{
+    CvParticleFrame* f = *_f;
+    if( !f ) return;
+    cvReleaseImagePyramid( &f->pyr );
+    cvFree( _f );
+}
+
+/**
+ * Start the shared features of a new frame. Levels are computed on demand
+ *
+ * @param frame  8U, 1 or 3 channels, of the size given at creation
+ * @param f
+ */
+void cvUpdateParticleFrame( const IplImage* frame, CvParticleFrame* f )
+{
+    cvSetImagePyramid( f->pyr, frame );
+}
+
+/**
+ * Allocate a multi-object tracker
+ *
+ * @param imsize         Frame size
+ * @param max_targets    Maximum number of objects tracked at once
+ * @param num_particles  Particles per object
+ * @param std            Standard deviation of the transition noise
+ * @return CvMultiParticle*
+ */
+CvMultiParticle* cvCreateMultiParticle( CvSize imsize, int max_targets, int num_particles,
+                                        CvParticleState std )
+{
+    CvMultiParticle* mp = NULL;
+    CV_FUNCNAME( "cvCreateMultiParticle" );
+    __BEGIN__;
+    CV_ASSERT( max_targets > 0 && num_particles > 0 );
+    mp = (CvMultiParticle*)cvAlloc( sizeof(CvMultiParticle) );
+    mp->max_targets   = max_targets;
+    mp->num_particles = num_particles;
+    mp->imsize        = imsize;
+    mp->std           = std;
+    mp->num_targets   = 0;
+    mp->next_id       = 0;
+    mp->ids       = (int*)cvAlloc( max_targets * sizeof(int) );
+    mp->targets   = (CvParticle**)cvAlloc( max_targets * sizeof(CvParticle*) );
+    mp->templs    = (CvMat**)cvAlloc( max_targets * sizeof(CvMat*) );
+    mp->tnorms    = (double*)cvAlloc( max_targets * sizeof(double) );
+    mp->estimates = (CvParticleState*)cvAlloc( max_targets * sizeof(CvParticleState) );
+    mp->frame     = cvCreateParticleFrame( imsize );
+    __END__;
+    return mp;
+}
+
+/**
+ * Release a multi-object tracker and all of its targets
+ *
+ * @param mp
+ */
+void cvReleaseMultiParticle( CvMultiParticle** _mp )
+{
+    CvMultiParticle* mp = *_mp;
+    if( !mp ) return;
+    while( mp->num_targets > 0 )
+        cvMultiParticleRemove( mp, mp->ids[0] );
+    cvReleaseParticleFrame( &mp->frame );
+    cvFree( &mp->ids );
+    cvFree( &mp->targets );
+    cvFree( &mp->templs );
+    cvFree( &mp->tnorms );
+    cvFree( &mp->estimates );
+    cvFree( _mp );
+}
+
+/**
+ * Start tracking an object
+ *
+ * The reference template is sampled from the frame at feature_size.
+ *
+ * @param mp
+ * @param frame    Frame where the object is at rect32f
+ * @param rect32f  Object region. (x, y) is the top-left corner, rotated by angle around it
+ * @return int     Target id, or -1 if max_targets objects are already tracked
+ */
+int cvMultiParticleAdd( CvMultiParticle* mp, const IplImage* frame, CvRect32f rect32f )
+{
+    int t = mp->num_targets;
+    if( t == mp->max_targets ) return -1;
+
+    CvBox32f box = cvBox32fFromRect32f( rect32f );
+    CvParticleState s = cvParticleState( box.cx, box.cy, box.width, box.height, box.angle,
+                                         box.cx, box.cy, box.width, box.height, box.angle );
+    CvParticle* init = cvCreateParticle( 10, 1, 1 );
+    CvParticle* p = cvCreateParticle( 10, 1, mp->num_particles, true );
+    cvParticleStateConfig( p, mp->imsize, mp->std );
+    p->rng = cvRNG( time( NULL ) + mp->next_id ); // targets must not share noise
+    cvParticleStateSet( init, 0, s );
+    cvParticleInit( p, init );
+    cvReleaseParticle( &init );
+
+    cvUpdateParticleFrame( frame, mp->frame );
+    int level = cvImagePyramidOctave( mp->frame->pyr, MIN( rect32f.width / feature_size.width,
+                                                           rect32f.height / feature_size.height ) );
+    mp->templs[t] = cvCreateMat( feature_size.height, feature_size.width, CV_64FC1 );
+    cvSampleRect32f( cvImagePyramidIntegral( mp->frame->pyr, level ), mp->templs[t],
+                     cvImagePyramidRect32f( rect32f, level ) );
+    cvSubS( mp->templs[t], cvAvg( mp->templs[t] ), mp->templs[t] );
+    mp->tnorms[t] = cvDotProduct( mp->templs[t], mp->templs[t] );
+
+    mp->targets[t] = p;
+    mp->estimates[t] = s;
+    mp->ids[t] = mp->next_id++;
+    mp->num_targets++;
+    return mp->ids[t];
+}
+
+/**
+ * Stop tracking an object
+ *
+ * @param mp
+ * @param id  Target id returned by cvMultiParticleAdd
+ */
+void cvMultiParticleRemove( CvMultiParticle* mp, int id )
+{
+    int t, last = mp->num_targets - 1;
+    for( t = 0; t <= last; t++ )
+    {
+        if( mp->ids[t] != id ) continue;
+        cvReleaseParticle( &mp->targets[t] );
+        cvReleaseMat( &mp->templs[t] );
+        // keep targets packed
+        mp->ids[t]       = mp->ids[last];
+        mp->targets[t]   = mp->targets[last];
+        mp->templs[t]    = mp->templs[last];
+        mp->tnorms[t]    = mp->tnorms[last];
+        mp->estimates[t] = mp->estimates[last];
+        mp->num_targets--;
+        return;
+    }
+}
+
+/**
+ * Track all objects into a new frame
+ *
+ * Shared features are computed once, every target is propagated, all
+ * particles of all targets are observed in one parallel loop, and then
+ * every target stores its most probable state and resamples.
+ *
+ * @param mp
+ * @param frame
+ */
+void cvMultiParticleUpdate( CvMultiParticle* mp, const IplImage* frame )
+{
+    int t, n, l, total = 0;
+    int Kw = feature_size.width, Kh = feature_size.height;
+    CvImagePyramid* pyr = mp->frame->pyr;
+    vector<CvMat*> sums( pyr->num_levels ), sqsums( pyr->num_levels );
+    int needed = 0;
+
+    // targets may hold different numbers of particles (cvParticleSetAdaptive)
+    for( t = 0; t < mp->num_targets; t++ )
+        total += mp->targets[t]->num_particles;
+    vector<int> levels( total ), owners( total ), ids( total );
+
+    cvUpdateParticleFrame( frame, mp->frame );
+    total = 0;
+    for( t = 0; t < mp->num_targets; t++ )
+    {
+        CvParticle* p = mp->targets[t];
+        cvParticleTransition( p );
+        // octave of each particle
+        const float* widths  = cvParticleStateRow( p, 2 );
+        const float* heights = cvParticleStateRow( p, 3 );
+        for( n = 0; n < p->num_particles; n++, total++ )
+        {
+            l = cvImagePyramidOctave( pyr, MIN( widths[n] / Kw, heights[n] / Kh ) );
+            levels[total] = l;
+            owners[total] = t;
+            ids[total] = n;
+            needed |= 1 << l;
+        }
+    }
+    // build the levels in use before the parallel loop reads them
+    for( l = 0; l < pyr->num_levels; l++ )
+        if( needed & ( 1 << l ) )
+            sums[l] = cvImagePyramidIntegral( pyr, l, &sqsums[l] );
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        vector<double> grid( (Kw + 1) * (Kh + 1) );
+        CvMat* msum = cvCreateMat( Kh, Kw, CV_64FC1 );
+        CvMat* msqsum = cvCreateMat( Kh, Kw, CV_64FC1 );
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+        for( int k = 0; k < total; k++ )
+        {
+            int target = owners[k], i = ids[k], level = levels[k];
+            CvParticle* p = mp->targets[target];
+            cvmSet( p->probs, 0, i, icvParticleNccLikelihood( p, i, sums[level], sqsums[level],
+                mp->templs[target], mp->tnorms[target], &grid[0], msum, msqsum, level ) );
+        }
+        cvReleaseMat( &msum );
+        cvReleaseMat( &msqsum );
+    }
+
+    for( t = 0; t < mp->num_targets; t++ )
+    {
+        CvParticle* p = mp->targets[t];
+        cvParticleMarginalize( p );
+        cvParticleNormalize( p );
+        mp->estimates[t] = cvParticleStateGet( p, cvParticleMaxParticle( p ) );
+        cvParticleResample( p, false );
+    }
+}
+
+/**
+ * Current region of an object
+ *
+ * @param mp
+ * @param id  Target id returned by cvMultiParticleAdd
+ * @return CvRect32f  Top-left corner, size and angle. width == 0 for an unknown id
+ */
+CvRect32f cvMultiParticleGet( const CvMultiParticle* mp, int id )
+{
+    int t;
+    for( t = 0; t < mp->num_targets; t++ )
+    {
+        if( mp->ids[t] != id ) continue;
+        const CvParticleState& s = mp->estimates[t];
+        return cvRect32fFromBox32f( cvBox32f( s.x, s.y, s.width, s.height, s.angle ) );
+    }
+    return cvRect32f( 0, 0, 0, 0, 0 );
+}
+
+
+#endif
@@ -37,6 +37,8 @@
 #include "cxcore.h"
 
 #include <time.h>
+#include <string.h>
+#include "cvsimd.h"
 #include "cvsetrow.h"
 #include "cvsetcol.h"
 #include "cvlogsum.h"
@@ -51,6 +53,9 @@ typedef struct CvParticle {
     bool logprob;      // probs are log probabilities
     // transition
     CvMat* dynamics;   // num_states x num_states. Dynamics model.
+    int*   dynamics_rows;  // num_states + 1. nonzeros of row i are [rows[i], rows[i+1])
+    int*   dynamics_cols;  // column of each nonzero of dynamics
+    float* dynamics_vals;  // value of each nonzero of dynamics
     CvRNG  rng;        // Random seed
     CvMat* std;        // num_states x 1. Standard deviation for gaussian noise
                        // Set standard deviation == 0 for no noise
@@ -58,21 +63,37 @@ typedef struct CvParticle {
                        // Set lowerbound == upperbound to express no bound
     // particle states
     CvMat* particles;  // num_states x num_particles. linked with probs. 
+                       // CV_32FC1, each state row 16 byte aligned. see cvParticleStateRow
+    CvMat* particles_buf; // num_states x num_particles. resampling target, swapped with particles
+    int*   ancestors;  // num_particles. source particle of each resampled particle
     CvMat* probs;      // num_observes x num_particles. linked with particles.
     CvMat* particle_probs; // 1 x num_particles. marginalization respect to observation models
     CvMat* observe_probs;  // num_observes x 1.  marginalization respect to tracking states
+    // adaptive number of particles, see cvParticleSetAdaptive
+    int    max_particles;  // upper bound. the per particle buffers above hold at least this many
+    int    min_particles;
+    double ess_ratio;      // target effective sample size / num_particles. 0 for fixed
 } CvParticle;
 
+// resampling methods
+#define CV_PARTICLE_RESAMPLE_SYSTEMATIC 0
+#define CV_PARTICLE_RESAMPLE_STRATIFIED 1
+
 /**************************** Function Prototypes ****************************/
 
+CV_INLINE float* cvParticleStateRow( const CvParticle* p, int state );
+
 CvParticle* cvCreateParticle( int num_states, int num_observes, int num_particles, bool logprob = false );
 void cvParticleSetDynamics( CvParticle* p, const CvMat* dynamics );
 void cvParticleSetNoise( CvParticle* p, CvRNG rng, const CvMat* std );
 void cvParticleSetBound( CvParticle* p );
+void cvParticleSetAdaptive( CvParticle* p, int min_particles, int max_particles, 
+                            double ess_ratio = 0.5 );
 void cvParticleInit( CvParticle* p, const CvParticle* init = NULL );
 void cvReleaseParticle( CvParticle** p );
 
-void cvParticleResample( CvParticle* p, bool marginal = true );
+void cvParticleResample( CvParticle* p, bool marginal = true,
+                         int method = CV_PARTICLE_RESAMPLE_SYSTEMATIC );
 void cvParticleTransition( CvParticle* p );
 
 void cvParticleMarginalize( CvParticle* p );
@@ -85,6 +106,71 @@ void cvParticlePrint( const CvParticle* p, int p_id = -1 );
 
 /*************************** Function Definitions ****************************/
 
+/**
+ * Typed access to one state of all particles
+ *
+ * States are stored state-major, one contiguous row of num_particles
+ * floats per state, so kernels can walk plain float arrays while
+ * p->particles stays a CvMat for everything else.
+ *
+ * @param particle
+ * @param state     state index, e.g., 0 for x
+ * @return float*   num_particles values
+ */
+CV_INLINE float* cvParticleStateRow( const CvParticle* p, int state )
+{
+    return (float*)( p->particles->data.ptr + p->particles->step * state );
+}
+
+/**
+ * Allocate a num_states x num_particles CV_32FC1 particle store whose
+ * rows start on 16 byte boundaries
+ */
+CV_INLINE CvMat* icvCreateParticleStore( int num_states, int num_particles )
+{
+    CvMat* mat = cvCreateMatHeader( num_states, num_particles, CV_32FC1 );
+    mat->step = ( num_particles * sizeof(float) + 15 ) & ~15;
+    if( mat->step != (int)( num_particles * sizeof(float) ) )
+        mat->type &= ~CV_MAT_CONT_FLAG;
+    cvCreateData( mat );
+    return mat;
+}
+
+/**
+ * Use the first cols columns of a matrix allocated with more. step is
+ * kept, so the continuity flag follows
+ */
+CV_INLINE void icvParticleSetCols( CvMat* mat, int cols )
+{
+    mat->cols = cols;
+    if( mat->rows == 1 || mat->step == cols * CV_ELEM_SIZE( mat->type ) )
+        mat->type |= CV_MAT_CONT_FLAG;
+    else
+        mat->type &= ~CV_MAT_CONT_FLAG;
+}
+
+/**
+ * Keep the nonzeros of p->dynamics row by row (CSR) for cvParticleTransition.
+ * Constant velocity models have two nonzeros per row at most.
+ */
+CV_INLINE void icvParticleSparseDynamics( CvParticle* p )
+{
+    int i, j, nz = 0;
+    for( i = 0; i < p->num_states; i++ )
+    {
+        p->dynamics_rows[i] = nz;
+        for( j = 0; j < p->num_states; j++ )
+        {
+            float v = CV_MAT_ELEM( *p->dynamics, float, i, j );
+            if( v == 0.0f ) continue;
+            p->dynamics_cols[nz] = j;
+            p->dynamics_vals[nz] = v;
+            nz++;
+        }
+    }
+    p->dynamics_rows[p->num_states] = nz;
+}
+
 /**
  * Print states of a particle
  *
@@ -116,17 +202,30 @@ void cvParticlePrint( const CvParticle*p, int p_id )
  * Re-samples a set of particles according to their probs to produce a
  * new set of unweighted particles
  *
- * Simply copy, not uniform randomly selects
+ * Draws num_particles sorted positions over the cumulative weights with
+ * a single uniform offset (systematic) or one uniform draw per stratum
+ * (stratified), and finds the ancestor of each in one merge pass. The
+ * ancestors are copied into particles_buf one state row at a time and
+ * the two buffers are swapped, so nothing is allocated per frame.
+ *
+ * With cvParticleSetAdaptive, the number of particles drawn follows the
+ * effective sample size ESS = 1 / sum( w^2 ) of the normalized weights:
+ * N' = ess_ratio * N^2 / ESS, i.e., more particles when the weights
+ * degenerate and fewer when they are even, limited to [N/2, 2N] per call
+ * and to [min_particles, max_particles].
  *
  * @param particle
+ * @param [marginal = true] Marginalize and normalize probs first
+ * @param [method = CV_PARTICLE_RESAMPLE_SYSTEMATIC]
+ *                          CV_PARTICLE_RESAMPLE_SYSTEMATIC or CV_PARTICLE_RESAMPLE_STRATIFIED
  */
-void cvParticleResample( CvParticle* p, bool marginal )
+void cvParticleResample( CvParticle* p, bool marginal, int method )
 {
-    int i, j, np, k = 0;
-    CvMat* particle, hdr;
-    CvMat* new_particles = cvCreateMat( p->num_states, p->num_particles, p->particles->type );
-    double prob;
-    int max_loc;
+    int i, k, s;
+    int N = p->num_particles, M = N;
+    const double* probs = p->particle_probs->data.db;
+    double total = 0, sqtotal = 0, cumsum, step, u;
+    CvMat* tmp;
 
     if( marginal )
     {
@@ -134,89 +233,161 @@ void cvParticleResample( CvParticle* p, bool marginal )
         cvParticleNormalize( p );
     }
 
-    k = 0;
-    for( i = 0; i < p->num_particles; i++ )
+    for( i = 0; i < N; i++ )
     {
-        particle = cvGetCol( p->particles, &hdr, i );
-        prob = cvmGet( p->particle_probs, 0, i );
-        prob = p->logprob ? exp( prob ) : prob;
-        np = cvRound( prob * p->num_particles );
-        for( j = 0; j < np; j++ )
+        double w = p->logprob ? exp( probs[i] ) : probs[i];
+        total += w;
+        sqtotal += w * w;
+    }
+
+    if( p->ess_ratio > 0 && total > 0 && sqtotal > 0 )
+    {
+        double ess = total * total / sqtotal;
+        double target = p->ess_ratio * N * N / ess;
+        M = cvRound( MIN( MAX( target, N * 0.5 ), N * 2.0 ) );
+        M = MIN( MAX( M, p->min_particles ), p->max_particles );
+    }
+
+    if( !( total > 0 ) ) // all zero or NaN, keep the most probable one
+    {
+        int max_loc = cvParticleMaxParticle( p );
+        for( k = 0; k < M; k++ ) p->ancestors[k] = max_loc;
+    }
+    else
+    {
+        step = total / M;
+        u = cvRandReal( &p->rng ) * step;
+        i = 0;
+        cumsum = p->logprob ? exp( probs[0] ) : probs[0];
+        for( k = 0; k < M; k++ )
         {
-            cvSetCol( particle, new_particles, k++ );
-            if( k == p->num_particles )
-                goto exit;
+            if( method == CV_PARTICLE_RESAMPLE_STRATIFIED && k > 0 )
+                u = ( k + cvRandReal( &p->rng ) ) * step;
+            while( cumsum <= u && i < N - 1 )
+            {
+                i++;
+                cumsum += p->logprob ? exp( probs[i] ) : probs[i];
+            }
+            p->ancestors[k] = i;
+            u += step;
         }
     }
 
-    max_loc = cvParticleMaxParticle( p );
-    particle = cvGetCol( p->particles, &hdr, max_loc );
-    while( k < p->num_particles )
-        cvSetCol( particle, new_particles, k++ );
+    // gather state rows. each row is contiguous in both buffers
+    for( s = 0; s < p->num_states; s++ )
+    {
+        const uchar* src = p->particles->data.ptr + p->particles->step * s;
+        uchar* dst = p->particles_buf->data.ptr + p->particles_buf->step * s;
+        if( CV_MAT_DEPTH( p->particles->type ) == CV_32F )
+        {
+            for( k = 0; k < M; k++ )
+                ((float*)dst)[k] = ((const float*)src)[p->ancestors[k]];
+        }
+        else
+        {
+            for( k = 0; k < M; k++ )
+                ((double*)dst)[k] = ((const double*)src)[p->ancestors[k]];
+        }
+    }
+    tmp = p->particles;
+    p->particles = p->particles_buf;
+    p->particles_buf = tmp;
 
-exit:
-    cvReleaseMat( &p->particles );
-    p->particles = new_particles;
+    if( M != N )
+    {
+        p->num_particles = M;
+        icvParticleSetCols( p->particles, M );
+        icvParticleSetCols( p->particles_buf, M );
+        icvParticleSetCols( p->probs, M );
+        icvParticleSetCols( p->particle_probs, M );
+    }
 }
 
 /**
  * Get id of the most probable particle
  *
+ * The first of equal maxima is returned. With SSE2 the maximum is found
+ * two probabilities at a time and then located with a second scan.
+ *
  * @param particle
  * @return int
  */
 int cvParticleMaxParticle( const CvParticle* p )
 {
-    double minval, maxval;
-    CvPoint min_loc, max_loc;
-    cvMinMaxLoc( p->particle_probs, &minval, &maxval, &min_loc, &max_loc );
-    return max_loc.x;
+    const double* probs = p->particle_probs->data.db;
+    int n = 0, max_loc = 0, N = p->num_particles;
+#if CV_SIMD_SSE2
+    if( N >= 4 )
+    {
+        __m128d vmax = _mm_loadu_pd( probs );
+        for( n = 2; n <= N - 2; n += 2 )
+            vmax = _mm_max_pd( vmax, _mm_loadu_pd( probs + n ) );
+        double maxval = MAX( _mm_cvtsd_f64( vmax ), _mm_cvtsd_f64( _mm_unpackhi_pd( vmax, vmax ) ) );
+        for( ; n < N; n++ )
+            maxval = MAX( maxval, probs[n] );
+        for( n = 0; n < N; n++ )
+            if( probs[n] == maxval ) return n;
+        n = 0; // NaNs, fall back to the scan below
+    }
+#endif
+    for( n = 1; n < N; n++ )
+    {
+        if( probs[n] > probs[max_loc] ) max_loc = n;
+    }
+    return max_loc;
 }
 
 /**
  * Get mean state
  *
+ * Weighted sum of each state row. With SSE2 four particles are summed at
+ * a time in double precision, so the result can differ from the scalar
+ * order in the last bits.
+ *
  * @param particle
  * @param meanstate num_states x 1, CV_32FC1 or CV_64FC1
  * @return CvMat*
  */
 void cvParticleMeanParticle( const CvParticle* p, CvMat* meanstate )
 {
-    CvMat* probs = NULL;
-    CvMat* mul = NULL;
-    CvMat* state, statehdr;
+    double* weights = NULL;
+    const double* probs = p->particle_probs->data.db;
     int i, j;
-    CvScalar avg;
     CV_FUNCNAME( "cvParticleMeanParticle" );
     __BEGIN__;
     CV_ASSERT( meanstate->rows == p->num_states && meanstate->cols == 1 );
-    if( !p->logprob )
-    {
-        probs = p->observe_probs;
-    }
-    else
+    weights = (double*)cvAlloc( p->num_particles * sizeof(double) );
+    for( j = 0; j < p->num_particles; j++ )
     {
-        probs = cvCreateMat( 1, p->num_particles, CV_64FC1 );
-        cvExp( p->particle_probs, probs );
+        weights[j] = p->logprob ? exp( probs[j] ) : probs[j];
     }
-    mul = cvCreateMat( 1, p->num_particles, CV_64FC1 );
 
     for( i = 0; i < p->num_states; i++ )
     {
-        state = cvGetRow( p->particles, &statehdr, i );
-        // cvMul( state, probs, mul ); // must be same type (not 32F and 64F)
-        for( j = 0; j < p->num_particles; j++ )
+        const float* state = cvParticleStateRow( p, i );
+        double sum = 0;
+        j = 0;
+#if CV_SIMD_SSE2
+        // state rows are 16 byte aligned. widen to double, two sums of two
+        __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+        for( ; j <= p->num_particles - 4; j += 4 )
+        {
+            __m128 v = _mm_load_ps( state + j );
+            acc0 = _mm_add_pd( acc0, _mm_mul_pd( _mm_cvtps_pd( v ), _mm_loadu_pd( weights + j ) ) );
+            acc1 = _mm_add_pd( acc1, _mm_mul_pd( _mm_cvtps_pd( _mm_movehl_ps( v, v ) ),
+                                                 _mm_loadu_pd( weights + j + 2 ) ) );
+        }
+        acc0 = _mm_add_pd( acc0, acc1 );
+        sum = _mm_cvtsd_f64( acc0 ) + _mm_cvtsd_f64( _mm_unpackhi_pd( acc0, acc0 ) );
+#endif
+        for( ; j < p->num_particles; j++ )
         {
-            cvmSet( mul, 0, j, cvmGet( state, 0, j ) * cvmGet( probs, 0, j ) );
+            sum += state[j] * weights[j];
         }
-        avg = cvSum( mul );
-        cvmSet( meanstate, i, 0, avg.val[0] );
+        cvmSet( meanstate, i, 0, sum );
     }
-
-    cvReleaseMat( &mul );
-    if( probs != p->particle_probs )
-        cvReleaseMat( &probs );
     __END__;
+    if( weights ) cvFree( &weights );
 }
 
 /**
@@ -298,25 +469,33 @@ void cvParticleBound( CvParticle* p )
     int row, col;
     double lower, upper;
     bool circular;
-    CvMat* stateparticles, hdr;
-    float state;
+    int N = p->num_particles;
     // @todo:     np.width   = (double)MAX( 2.0, MIN( maxX - 1 - x, width ) );
     for( row = 0; row < p->num_states; row++ )
     {
+        float* state = cvParticleStateRow( p, row );
         lower = cvmGet( p->bound, row, 0 );
         upper = cvmGet( p->bound, row, 1 );
         circular = (bool) cvmGet( p->bound, row, 2 );
         if( lower == upper ) continue; // no bound flag
         if( circular ) {
-            for( col = 0; col < p->num_particles; col++ ) {
-                state = cvmGet( p->particles, row, col );
-                state = state < lower ? state + upper : ( state >= upper ? state - upper : state );
-                cvmSet( p->particles, row, col, state );
+            for( col = 0; col < N; col++ ) {
+                double s = state[col];
+                state[col] = (float)( s < lower ? s + upper : ( s >= upper ? s - upper : s ) );
             }
         } else {
-            stateparticles = cvGetRow( p->particles, &hdr, row );
-            cvMinS( stateparticles, upper, stateparticles );
-            cvMaxS( stateparticles, lower, stateparticles );
+            float lo = (float)lower, hi = (float)upper;
+            col = 0;
+#if CV_SIMD_SSE2
+            __m128 vlo = _mm_set1_ps( lo ), vhi = _mm_set1_ps( hi );
+            for( ; col <= N - 4; col += 4 ) {
+                __m128 v = _mm_loadu_ps( state + col );
+                _mm_storeu_ps( state + col, _mm_max_ps( _mm_min_ps( v, vhi ), vlo ) );
+            }
+#endif
+            for( ; col < N; col++ ) {
+                state[col] = MAX( MIN( state[col], hi ), lo );
+            }
         }
     }
 }
@@ -329,37 +508,83 @@ void cvParticleBound( CvParticle* p )
  * such as Taylor series model and call your function instead of this function. 
  * Other functions should not necessary be modified.
  *
+ * Each new state row is built in one pass into particles_buf: gaussian
+ * noise, plus the nonzero terms of its dynamics row, bounded on the way
+ * out. particles_buf is then swapped in. Noise rows are drawn in state
+ * order so the random sequence is the same as with separate passes.
+ *
  * @param particle
  */
 void cvParticleTransition( CvParticle* p )
 {
-    int i;
-    CvMat* transits = cvCreateMat( p->num_states, p->num_particles, p->particles->type );
-    CvMat* noises   = cvCreateMat( p->num_states, p->num_particles, p->particles->type );
-    CvMat* noise, noisehdr;
-    double std;
-    
-    // dynamics
-    cvMatMul( p->dynamics, p->particles, transits );
+    int i, k, n;
+    int N = p->num_particles;
+    CvMat noise;
     
-    // noise generation
     for( i = 0; i < p->num_states; i++ )
     {
-        std    = cvmGet( p->std, i, 0 );
-        noise = cvGetRow( noises, &noisehdr, i );
+        float* dst = (float*)( p->particles_buf->data.ptr + p->particles_buf->step * i );
+        int nz0 = p->dynamics_rows[i], nz1 = p->dynamics_rows[i + 1];
+        double std   = cvmGet( p->std, i, 0 );
+        double lower = cvmGet( p->bound, i, 0 );
+        double upper = cvmGet( p->bound, i, 1 );
+        bool circular = (bool) cvmGet( p->bound, i, 2 );
+        bool bounded  = ( lower != upper );
+        float lo = (float)lower, hi = (float)upper;
+
         if( std == 0.0 )
-            cvZero( noise );
+        {
+            memset( dst, 0, N * sizeof(float) );
+        }
         else
-            cvRandArr( &p->rng, noise, CV_RAND_NORMAL, cvScalar(0), cvScalar( std ) );
-    }
-    
-    // dynamics + noise
-    cvAdd( transits, noises, p->particles );
+        {
+            cvGetRow( p->particles_buf, &noise, i );
+            cvRandArr( &p->rng, &noise, CV_RAND_NORMAL, cvScalar(0), cvScalar( std ) );
+        }
 
-    cvReleaseMat( &transits );
-    cvReleaseMat( &noises );
+        n = 0;
+#if CV_SIMD_SSE2
+        __m128 vlo = _mm_set1_ps( lo ), vhi = _mm_set1_ps( hi );
+        for( ; n <= N - 4; n += 4 )
+        {
+            __m128 v = _mm_load_ps( dst + n );
+            for( k = nz0; k < nz1; k++ )
+            {
+                const float* src = cvParticleStateRow( p, p->dynamics_cols[k] );
+                v = _mm_add_ps( v, _mm_mul_ps( _mm_set1_ps( p->dynamics_vals[k] ), 
+                                               _mm_load_ps( src + n ) ) );
+            }
+            if( bounded && circular )
+            {
+                // s < lower ? s + upper : ( s >= upper ? s - upper : s )
+                __m128 below = _mm_cmplt_ps( v, vlo );
+                __m128 above = _mm_cmpge_ps( v, vhi );
+                v = _mm_add_ps( v, _mm_and_ps( below, vhi ) );
+                v = _mm_sub_ps( v, _mm_and_ps( _mm_andnot_ps( below, above ), vhi ) );
+            }
+            else if( bounded )
+            {
+                v = _mm_max_ps( _mm_min_ps( v, vhi ), vlo );
+            }
+            _mm_store_ps( dst + n, v );
+        }
+#endif
+        for( ; n < N; n++ )
+        {
+            float s = dst[n];
+            for( k = nz0; k < nz1; k++ )
+                s += p->dynamics_vals[k] * cvParticleStateRow( p, p->dynamics_cols[k] )[n];
+            if( bounded && circular )
+                s = ( s < lo ? s + hi : ( s >= hi ? s - hi : s ) );
+            else if( bounded )
+                s = MAX( MIN( s, hi ), lo );
+            dst[n] = s;
+        }
+    }
 
-    cvParticleBound( p );
+    CvMat* tmp = p->particles;
+    p->particles = p->particles_buf;
+    p->particles_buf = tmp;
 }
 
 /**
@@ -434,6 +659,60 @@ void cvParticleSetBound( CvParticle* p, const CvMat* bound )
     __END__;
 }
 
+/**
+ * Let cvParticleResample change the number of particles
+ *
+ * Buffers are reallocated here once for max_particles when needed, so
+ * resampling never allocates. The current particles are kept.
+ *
+ * @param particle
+ * @param min_particles
+ * @param max_particles
+ * @param [ess_ratio = 0.5] Effective sample size per particle to keep. 0 to fix
+ *                          the number of particles again
+ */
+void cvParticleSetAdaptive( CvParticle* p, int min_particles, int max_particles, 
+                            double ess_ratio )
+{
+    CV_FUNCNAME( "cvParticleSetAdaptive" );
+    __BEGIN__;
+    CV_ASSERT( 0 < min_particles && min_particles <= max_particles );
+    CV_ASSERT( 0 <= ess_ratio && ess_ratio <= 1 );
+    if( max_particles > p->max_particles )
+    {
+        int N = p->num_particles, s;
+        CvMat* particles = icvCreateParticleStore( p->num_states, max_particles );
+        CvMat* probs = cvCreateMat( p->num_observes, max_particles, CV_64FC1 );
+        CvMat* particle_probs = cvCreateMat( 1, max_particles, CV_64FC1 );
+        for( s = 0; s < p->num_states; s++ )
+            memcpy( particles->data.ptr + particles->step * s,
+                    p->particles->data.ptr + p->particles->step * s, N * sizeof(float) );
+        for( s = 0; s < p->num_observes; s++ )
+            memcpy( probs->data.ptr + probs->step * s,
+                    p->probs->data.ptr + p->probs->step * s, N * sizeof(double) );
+        memcpy( particle_probs->data.ptr, p->particle_probs->data.ptr, N * sizeof(double) );
+        cvReleaseMat( &p->particles );
+        cvReleaseMat( &p->particles_buf );
+        cvReleaseMat( &p->probs );
+        cvReleaseMat( &p->particle_probs );
+        cvFree( &p->ancestors );
+        p->particles      = particles;
+        p->particles_buf  = icvCreateParticleStore( p->num_states, max_particles );
+        p->probs          = probs;
+        p->particle_probs = particle_probs;
+        p->ancestors      = (int*) cvAlloc( max_particles * sizeof(int) );
+        p->max_particles  = max_particles;
+        icvParticleSetCols( p->particles, N );
+        icvParticleSetCols( p->particles_buf, N );
+        icvParticleSetCols( p->probs, N );
+        icvParticleSetCols( p->particle_probs, N );
+    }
+    p->min_particles = min_particles;
+    p->max_particles = max_particles;
+    p->ess_ratio     = ess_ratio;
+    __END__;
+}
+
 /**
  * Set noise model
  *
@@ -468,6 +747,7 @@ void cvParticleSetDynamics( CvParticle* p, const CvMat* dynamics )
     CV_ASSERT( p->num_states == dynamics->cols );
     //cvCopy( dynamics, p->dynamics );
     cvConvert( dynamics, p->dynamics );
+    icvParticleSparseDynamics( p );
     __END__;
 }
 
@@ -486,9 +766,14 @@ void cvReleaseParticle( CvParticle** particle )
     if( !p ) EXIT;
     
     CV_CALL( cvReleaseMat( &p->dynamics ) );
+    CV_CALL( cvFree( &p->dynamics_rows ) );
+    CV_CALL( cvFree( &p->dynamics_cols ) );
+    CV_CALL( cvFree( &p->dynamics_vals ) );
     CV_CALL( cvReleaseMat( &p->std ) );
     CV_CALL( cvReleaseMat( &p->bound ) );
     CV_CALL( cvReleaseMat( &p->particles ) );
+    CV_CALL( cvReleaseMat( &p->particles_buf ) );
+    CV_CALL( cvFree( &p->ancestors ) );
     CV_CALL( cvReleaseMat( &p->probs ) );
     CV_CALL( cvFree( &p ) );
     __END__;
@@ -517,17 +802,26 @@ CvParticle* cvCreateParticle( int num_states, int num_observes, int num_particle
     p->num_states    = num_states;
     p->num_observes  = num_observes;
     p->dynamics      = cvCreateMat( num_states, num_states, CV_32FC1 );
+    p->dynamics_rows = (int*) cvAlloc( ( num_states + 1 ) * sizeof(int) );
+    p->dynamics_cols = (int*) cvAlloc( num_states * num_states * sizeof(int) );
+    p->dynamics_vals = (float*) cvAlloc( num_states * num_states * sizeof(float) );
     p->rng           = 1;
     p->std           = cvCreateMat( num_states, 1, CV_32FC1 );
     p->bound         = cvCreateMat( num_states, 3, CV_32FC1 );
-    p->particles     = cvCreateMat( num_states, num_particles, CV_32FC1 );
+    p->particles     = icvCreateParticleStore( num_states, num_particles );
+    p->particles_buf = icvCreateParticleStore( num_states, num_particles );
+    p->ancestors     = (int*) cvAlloc( num_particles * sizeof(int) );
     p->probs         = cvCreateMat( num_observes, num_particles, CV_64FC1 );
     p->particle_probs = cvCreateMat( 1, num_particles, CV_64FC1 );
     p->observe_probs  = cvCreateMat( num_observes, 1, CV_64FC1 );
     p->logprob        = logprob;
+    p->max_particles  = num_particles;
+    p->min_particles  = num_particles;
+    p->ess_ratio      = 0;
 
     // Default dynamics: next state = curr state + noise
     cvSetIdentity( p->dynamics, cvScalar(1.0) );
+    icvParticleSparseDynamics( p );
     cvSet( p->std, cvScalar(1.0) );
 
     cvZero( p->bound );
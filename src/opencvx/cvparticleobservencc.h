@@ -0,0 +1,219 @@
+/** @file
+ *
+ * Normalized cross-correlation observation model for particle filter
+ * CvParticleState s must have s.x, s.y, s.width, s.height, s.angle
+ *
+ * The frame is integrated once (sum and squared sum) and shared by all
+ * particles. The reference is treated as a feature_size grid stretched
+ * over each particle box, so for an axis-aligned box the correlation
+ * needs one integral lookup per grid corner and the box variance needs
+ * four. Rotated boxes fall back to area-sampled features of the same
+ * integral images (cvSampleRect32f) and use the same formula.
+ *
+ * The MIT License
+ *
+ * Copyright (c) OpenALPR contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CV_PARTICLE_OBSERVE_NCC_H
+#define CV_PARTICLE_OBSERVE_NCC_H
+
+#include "cvparticle.h"
+#include "cvrect32f.h"
+#include "cvsamplerect32f.h"
+#include "cvimagepyramid.h"
+#include <math.h>
+#include <float.h>
+#include <vector>
+using namespace std;
+
+/********************* Globals **********************************/
+int num_observes = 1;
+CvSize feature_size = cvSize(24, 24); // size of the reference patch
+double ncc_sigma = 0.2; // log likelihood is -(1 - ncc)^2 / (2 ncc_sigma^2)
+
+/******************** Function Prototypes **********************/
+void cvParticleObserveLikelihood( CvParticle* p, IplImage* frame, IplImage *reference );
+void cvParticleObserveNcc( CvParticle* p, const CvMat* sum, const CvMat* sqsum, const CvMat* templ );
+CvMat* cvCreateNccTemplate( const IplImage* reference );
+
+/**
+ * Zero-mean gray template of the reference
+ *
+ * @param reference  Reference patch, 1 or 3 channels
+ * @return CvMat*    reference->height x reference->width CV_64FC1
+ */
+CvMat* cvCreateNccTemplate( const IplImage* reference )
+{
+    CvMat* templ = cvCreateMat( reference->height, reference->width, CV_64FC1 );
+    if( reference->nChannels != 1 ) {
+        IplImage* gry = cvCreateImage( cvGetSize(reference), reference->depth, 1 );
+        cvCvtColor( reference, gry, CV_BGR2GRAY );
+        cvConvert( gry, templ );
+        cvReleaseImage( &gry );
+    } else {
+        cvConvert( reference, templ );
+    }
+    cvSubS( templ, cvAvg( templ ), templ );
+    return templ;
+}
+
+// Bilinear value of an integral image at (x, y), clamped to the image
+CV_INLINE double icvIntegralAt( const CvMat* sum, double x, double y )
+{
+    CvIntegralTap t = icvIntegralTap( sum, x, y );
+    const double* p = sum->data.db + t.ofs;
+    int sstep = sum->step / sizeof(double);
+    return t.w00 * p[0] + t.w01 * p[1] + t.w10 * p[sstep] + t.w11 * p[sstep + 1];
+}
+
+/**
+ * NCC log likelihood of one particle box against a template
+ *
+ * With the template stretched over a box of area A split into cells of
+ * area a, cell sums S, box sum s1 and squared sum s2,
+ *     ncc = sum( T * S ) / sqrt( a * sum( T^2 ) * ( s2 - s1^2 / A ) )
+ * T has zero mean, so the image mean cancels out of the numerator.
+ *
+ * @param p       particles
+ * @param n       particle id
+ * @param sum     (H+1) x (W+1) CV_64FC1 integral of the gray frame
+ * @param sqsum   (H+1) x (W+1) CV_64FC1 integral of its squares
+ * @param templ   Zero-mean template, see cvCreateNccTemplate
+ * @param tnorm   sum( templ^2 )
+ * @param grid    Scratch of (templ->cols + 1) * (templ->rows + 1) doubles
+ * @param msum    Scratch of the template size, CV_64FC1
+ * @param msqsum  Scratch of the template size, CV_64FC1
+ * @param level   Pyramid level sum and sqsum are of, see cvimagepyramid.h
+ * @return double
+ */
+double icvParticleNccLikelihood( const CvParticle* p, int n, const CvMat* sum, const CvMat* sqsum,
+                                 const CvMat* templ, double tnorm, double* grid,
+                                 CvMat* msum, CvMat* msqsum, int level = 0 )
+{
+    int Kw = templ->cols, Kh = templ->rows;
+    CvParticleState s = cvParticleStateGet( p, n );
+    CvBox32f box32f = cvBox32f( s.x, s.y, s.width, s.height, s.angle );
+    CvRect32f rect32f = cvImagePyramidRect32f( cvRect32fFromBox32f( box32f ), level );
+    double A = (double)rect32f.width * rect32f.height;
+    double a = A / ( Kw * Kh );
+    double num = 0, s1 = 0, s2 = 0;
+    int i, j;
+
+    if( rect32f.angle == 0 )
+    {
+        // integral at the cell corners, then differences per cell
+        double cw = rect32f.width / Kw, ch = rect32f.height / Kh;
+        for( j = 0; j <= Kh; j++ )
+            for( i = 0; i <= Kw; i++ )
+                grid[j * (Kw + 1) + i] = icvIntegralAt( sum, rect32f.x + i * cw, rect32f.y + j * ch );
+        for( j = 0; j < Kh; j++ )
+        {
+            const double* t = (const double*)( templ->data.ptr + templ->step * j );
+            const double* g0 = &grid[j * (Kw + 1)];
+            const double* g1 = g0 + Kw + 1;
+            for( i = 0; i < Kw; i++ )
+                num += t[i] * ( g1[i + 1] - g1[i] - g0[i + 1] + g0[i] );
+        }
+        s1 = grid[Kh * (Kw + 1) + Kw] - grid[Kh * (Kw + 1)] - grid[Kw] + grid[0];
+        s2 = icvIntegralAt( sqsum, rect32f.x + rect32f.width, rect32f.y + rect32f.height )
+           - icvIntegralAt( sqsum, rect32f.x, rect32f.y + rect32f.height )
+           - icvIntegralAt( sqsum, rect32f.x + rect32f.width, rect32f.y )
+           + icvIntegralAt( sqsum, rect32f.x, rect32f.y );
+    }
+    else
+    {
+        // rotated: cell means of the rotated box
+        cvSampleRect32f( sum, msum, rect32f );
+        cvSampleRect32f( sqsum, msqsum, rect32f );
+        num = a * cvDotProduct( templ, msum );
+        s1 = a * cvSum( msum ).val[0];
+        s2 = a * cvSum( msqsum ).val[0];
+    }
+
+    double var = s2 - s1 * s1 / A;
+    double ncc = ( var > DBL_EPSILON && tnorm > DBL_EPSILON ) ? num / sqrt( a * tnorm * var ) : 0;
+    double d = 1.0 - ncc;
+    return -d * d / ( 2 * ncc_sigma * ncc_sigma );
+}
+
+/**
+ * NCC of every particle box against a template, from integral images
+ *
+ * @param p       probs row 0 receives the log likelihoods
+ * @param sum     (H+1) x (W+1) CV_64FC1 integral of the gray frame
+ * @param sqsum   (H+1) x (W+1) CV_64FC1 integral of its squares
+ * @param templ   Zero-mean template, see cvCreateNccTemplate
+ */
+void cvParticleObserveNcc( CvParticle* p, const CvMat* sum, const CvMat* sqsum, const CvMat* templ )
+{
+    int Kw = templ->cols, Kh = templ->rows;
+    double tnorm = cvDotProduct( templ, templ );
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        vector<double> grid( (Kw + 1) * (Kh + 1) );
+        CvMat* msum = cvCreateMat( Kh, Kw, CV_64FC1 );
+        CvMat* msqsum = cvCreateMat( Kh, Kw, CV_64FC1 );
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+        for( int n = 0; n < p->num_particles; n++ )
+        {
+            cvmSet( p->probs, 0, n, icvParticleNccLikelihood( p, n, sum, sqsum, templ, tnorm,
+                                                              &grid[0], msum, msqsum ) );
+        }
+        cvReleaseMat( &msum );
+        cvReleaseMat( &msqsum );
+    }
+}
+
+/**
+ * CvParticleState s must have s.x, s.y, s.width, s.height, s.angle
+ *
+ * @param particle
+ * @param frame
+ * @param reference  Reference patch. Its size is the template grid
+ */
+void cvParticleObserveLikelihood( CvParticle* p, IplImage* frame, IplImage *reference )
+{
+    IplImage *gry;
+    if( frame->nChannels != 1 ) {
+        gry = cvCreateImage( cvGetSize(frame), frame->depth, 1 );
+        cvCvtColor( frame, gry, CV_BGR2GRAY );
+    } else {
+        gry = frame;
+    }
+    CvMat* sum   = cvCreateMat( frame->height + 1, frame->width + 1, CV_64FC1 );
+    CvMat* sqsum = cvCreateMat( frame->height + 1, frame->width + 1, CV_64FC1 );
+    CvMat* templ = cvCreateNccTemplate( reference );
+    cvIntegral( gry, sum, sqsum );
+
+    cvParticleObserveNcc( p, sum, sqsum, templ );
+
+    cvReleaseMat( &templ );
+    cvReleaseMat( &sqsum );
+    cvReleaseMat( &sum );
+    if( gry != frame )
+        cvReleaseImage( &gry );
+}
+
+#endif
@@ -32,6 +32,7 @@
 #include "cvparticle.h"
 #include "cvrect32f.h"
 #include "cvcropimageroi.h"
+#include "cvsamplerect32f.h"
 #include "cvpcadiffs.h"
 #include "cvgaussnorm.h"
 #include <iostream>
@@ -44,11 +45,15 @@ string data_dir = "";
 string data_pcaval = "pcaval.xml";
 string data_pcavec = "pcavec.xml";
 string data_pcaavg = "pcaavg.xml";
+string data_pcamodel = "pcamodel.bin"; // used instead of the xml files if exists
+double pca_forget = 0; // weight of the past in the online subspace update, 0 to keep it fixed
+double pca_update_threshold = 2.0; // max DIFS + DFFS per feature dimension of a patch folded in
 
 /******************************* Globals in this file ******************************/
 CvMat *eigenvalues;
 CvMat *eigenvectors;
 CvMat *eigenavg;
+CvPcaDiffsModel *pcamodel;
 
 /****************************** Function Prototypes ********************************/
 void cvParticleObserveInitialize();
@@ -65,6 +70,10 @@ void cvParticleObserveLikelihood( CvParticle* p, IplImage* cur_frame, IplImage *
 void cvParticleObserveInitialize()
 {
     string filename;
+    filename = data_dir + data_pcamodel;
+    if( (pcamodel = cvLoadPcaDiffsModel( filename.c_str() )) != NULL ) {
+        return;
+    }
     filename = data_dir + data_pcaval;
     if( (eigenvalues = (CvMat*)cvLoad( filename.c_str() )) == NULL ) {
         cerr << filename << " is not loadable." << endl << flush;
@@ -80,6 +89,8 @@ void cvParticleObserveInitialize()
         cerr << filename << " is not loadable." << endl << flush;
         exit( 1 );
     }
+    // convert and transpose once instead of per frame
+    pcamodel = cvCreatePcaDiffsModel( eigenavg, eigenvalues, eigenvectors );
 }
 
 /**
@@ -90,10 +101,15 @@ void cvParticleObserveFinalize()
     cvReleaseMat( &eigenvalues );
     cvReleaseMat( &eigenvectors );
     cvReleaseMat( &eigenavg );
+    cvReleasePcaDiffsModel( &pcamodel );
 }
 
 /**
  * Preprocess as did in training PCA subspace
+ *
+ * For a single patch. It allocates its gray and resize buffers per call,
+ * so icvGetFeatures does not use it and samples from an integral image
+ * instead.
  */
 void icvPreprocess( const IplImage* patch, CvMat *mat )
 {
@@ -119,38 +135,60 @@ void icvPreprocess( const IplImage* patch, CvMat *mat )
  * Get observation features
  *
  * CvParticleState must have x, y, width, height, angle
+ *
+ * Particles are processed in parallel when built with OpenMP. Each
+ * thread allocates its scratch matrices once, nothing is allocated per
+ * particle, and each particle fills only its own column.
+ *
+ * The frame is converted to gray and integrated once, and each particle
+ * box is area-sampled straight into the feature size (cvSampleRect32f)
+ * instead of being cropped, converted and resized one by one.
  */
 void icvGetFeatures( const CvParticle* p, const IplImage* frame, CvMat* features )
 {
     int feature_height = feature_size.height;
     int feature_width  = feature_size.width;
+    IplImage *gry;
+    if( frame->nChannels != 1 ) {
+        gry = cvCreateImage( cvGetSize(frame), frame->depth, 1 );
+        cvCvtColor( frame, gry, CV_BGR2GRAY );
+    } else {
+        gry = (IplImage*)frame;
+    }
+    CvMat* sum = cvCreateMat( frame->height + 1, frame->width + 1, CV_64FC1 );
+    cvIntegral( gry, sum );
     //cvNamedWindow( "patch" );
-    CvMat* normed = cvCreateMat( feature_height, feature_width, CV_64FC1 );
-    CvMat* normedT = cvCreateMat( feature_width, feature_height, CV_64FC1 );
-    CvMat* feature, featurehdr;
-    IplImage *patch;
-    for( int n = 0; n < p->num_particles; n++ ) {
-        CvParticleState s = cvParticleStateGet( p, n );
-        CvBox32f box32f = cvBox32f( s.x, s.y, s.width, s.height, s.angle );
-        CvRect32f rect32f = cvRect32fFromBox32f( box32f );
-
-        // get image patch and preprocess
-        patch = cvCreateImage( cvSize( cvRound( s.width ), cvRound( s.height ) ), 
-                               frame->depth, frame->nChannels );
-        cvCropImageROI( (IplImage*)frame, patch, rect32f );
-        //cvShowImage( "patch", patch );
-        //cvWaitKey( 10 );
-        icvPreprocess( patch, normed );
-        cvReleaseImage( &patch );
-
-        // vectorize
-        cvT( normed, normedT ); // transpose to make the same with matlab's reshape
-        feature = cvReshape( normedT, &featurehdr, 1, feature_height * feature_width );
-
-        cvSetCol( feature, features, n );
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        CvMat* normed = cvCreateMat( feature_height, feature_width, CV_32FC1 );
+        CvMat* normedT = cvCreateMat( feature_width, feature_height, CV_32FC1 );
+        CvMat* feature, featurehdr;
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+        for( int n = 0; n < p->num_particles; n++ ) {
+            CvParticleState s = cvParticleStateGet( p, n );
+            CvBox32f box32f = cvBox32f( s.x, s.y, s.width, s.height, s.angle );
+            CvRect32f rect32f = cvRect32fFromBox32f( box32f );
+
+            // sample the box at the feature size and preprocess as in training
+            cvSampleRect32f( sum, normed, rect32f );
+            cvImgGaussNorm( normed, normed );
+
+            // vectorize
+            cvT( normed, normedT ); // transpose to make the same with matlab's reshape
+            feature = cvReshape( normedT, &featurehdr, 1, feature_height * feature_width );
+
+            cvSetCol( feature, features, n );
+        }
+        cvReleaseMat( &normedT );
+        cvReleaseMat( &normed );
     }
-    cvReleaseMat( &normedT );
-    cvReleaseMat( &normed );
+    cvReleaseMat( &sum );
+    if( gry != frame )
+        cvReleaseImage( &gry );
 }
 
 /**
@@ -166,11 +204,24 @@ void cvParticleObserveLikelihood( CvParticle* p, IplImage* frame )
     int feature_width  = feature_size.width;
 
     // extract features from particle states
-    CvMat* features = cvCreateMat( feature_height*feature_width, p->num_particles, CV_64FC1 );
+    CvMat* features = cvCreateMat( feature_height*feature_width, p->num_particles, CV_32FC1 );
     icvGetFeatures( p, frame, features );
     
     // Likelihood measurments
-    cvMatPcaDiffs( features, eigenavg, eigenvalues, eigenvectors, p->probs, 0, TRUE);
+    cvMatPcaDiffs32f( features, pcamodel, p->probs, 0, TRUE );
+
+    // fold the most likely patch into the subspace to follow appearance
+    // changes, if it is confident. probs are -(DIFS + DFFS) / 2, which is
+    // about -D / 2 for a patch the subspace explains
+    if( pca_forget > 0 && pcamodel->M > 0 ) {
+        CvMat best;
+        CvPoint max_loc;
+        double max_logprob;
+        cvMinMaxLoc( p->probs, NULL, &max_logprob, NULL, &max_loc );
+        if( -2.0 * max_logprob / features->rows <= pca_update_threshold )
+            cvUpdatePcaDiffsModel( pcamodel, cvGetCol( features, &best, max_loc.x ), pca_forget );
+    }
+    cvReleaseMat( &features );
 }
 
 #endif
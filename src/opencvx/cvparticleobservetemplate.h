@@ -31,6 +31,7 @@
 #include "cvparticle.h"
 #include "cvrect32f.h"
 #include "cvcropimageroi.h"
+#include "cvsamplerect32f.h"
 using namespace std;
 
 /********************* Globals **********************************/
@@ -43,37 +44,50 @@ void cvParticleObserveLikelihood( CvParticle* p, IplImage* cur_frame, IplImage *
 /**
  * CvParticleState s must have s.x, s.y, s.width, s.height, s.angle
  *
+ * Particles are observed in parallel when built with OpenMP. Each thread
+ * allocates its feature_size sample buffer once, nothing is allocated per
+ * particle, and every particle writes only its own column of probs, so
+ * results do not depend on the number of threads.
+ *
+ * Patches are sampled straight to feature_size from an integral image of
+ * the frame (cvSampleRect32f), so the cost per particle does not depend
+ * on the box size.
+ *
  * @param particle
  * @param frame
  * @param reference
  */
 void cvParticleObserveLikelihood( CvParticle* p, IplImage* frame, IplImage *reference )
 {
-    int i;
-    double likeli;
-    IplImage *patch;
-    IplImage *resize;
-    resize = cvCreateImage( feature_size, frame->depth, frame->nChannels );
-    for( i = 0; i < p->num_particles; i++ ) 
+    CvMat* sum = cvCreateMat( frame->height + 1, frame->width + 1, CV_64FC(frame->nChannels) );
+    cvIntegral( frame, sum );
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
     {
-        CvParticleState s = cvParticleStateGet( p, i );
-        CvBox32f box32f = cvBox32f( s.x, s.y, s.width, s.height, s.angle );
-        CvRect32f rect32f = cvRect32fFromBox32f( box32f );
-        CvRect rect = cvRectFromRect32f( rect32f );
-        
-        patch = cvCreateImage( cvSize(rect.width,rect.height), frame->depth, frame->nChannels );
-        cvCropImageROI( frame, patch, rect32f );
-        cvResize( patch, resize );
+        double likeli;
+        IplImage *resize;
+        resize = cvCreateImage( feature_size, frame->depth, frame->nChannels );
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+        for( int i = 0; i < p->num_particles; i++ ) 
+        {
+            CvParticleState s = cvParticleStateGet( p, i );
+            CvBox32f box32f = cvBox32f( s.x, s.y, s.width, s.height, s.angle );
+            CvRect32f rect32f = cvRect32fFromBox32f( box32f );
+            
+            cvSampleRect32f( sum, resize, rect32f );
 
-        // log likeli. kinds of Gaussian model
-        // exp( -d^2 / sigma^2 )
-        // sigma can be omitted because common param does not affect ML estimate
-        likeli = -cvNorm( resize, reference, CV_L2 ); 
-        cvmSet( p->probs, 0, i, likeli );
-        
-        cvReleaseImage( &patch );
+            // log likeli. kinds of Gaussian model
+            // exp( -d^2 / sigma^2 )
+            // sigma can be omitted because common param does not affect ML estimate
+            likeli = -cvNorm( resize, reference, CV_L2 ); 
+            cvmSet( p->probs, 0, i, likeli );
+        }
+        cvReleaseImage( &resize );
     }
-    cvReleaseImage( &resize );
+    cvReleaseMat( &sum );
 }
 
 #endif
@@ -136,16 +136,16 @@ inline CvParticleState cvParticleState( double x,
 CvParticleState cvParticleStateGet( const CvParticle* p, int p_id )
 {
     CvParticleState s;
-    s.x       = cvmGet( p->particles, 0, p_id );
-    s.y       = cvmGet( p->particles, 1, p_id );
-    s.width   = cvmGet( p->particles, 2, p_id );
-    s.height  = cvmGet( p->particles, 3, p_id );
-    s.angle   = cvmGet( p->particles, 4, p_id );
-    s.xp      = cvmGet( p->particles, 5, p_id );
-    s.yp      = cvmGet( p->particles, 6, p_id );
-    s.widthp  = cvmGet( p->particles, 7, p_id );
-    s.heightp = cvmGet( p->particles, 8, p_id );
-    s.anglep  = cvmGet( p->particles, 9, p_id );
+    s.x       = cvParticleStateRow( p, 0 )[p_id];
+    s.y       = cvParticleStateRow( p, 1 )[p_id];
+    s.width   = cvParticleStateRow( p, 2 )[p_id];
+    s.height  = cvParticleStateRow( p, 3 )[p_id];
+    s.angle   = cvParticleStateRow( p, 4 )[p_id];
+    s.xp      = cvParticleStateRow( p, 5 )[p_id];
+    s.yp      = cvParticleStateRow( p, 6 )[p_id];
+    s.widthp  = cvParticleStateRow( p, 7 )[p_id];
+    s.heightp = cvParticleStateRow( p, 8 )[p_id];
+    s.anglep  = cvParticleStateRow( p, 9 )[p_id];
     return s;
 }
 
@@ -159,16 +159,16 @@ CvParticleState cvParticleStateGet( const CvParticle* p, int p_id )
  */
 void cvParticleStateSet( const CvParticle* p, int p_id, CvParticleState &state )
 {
-    cvmSet( p->particles, 0, p_id, state.x );
-    cvmSet( p->particles, 1, p_id, state.y );
-    cvmSet( p->particles, 2, p_id, state.width );
-    cvmSet( p->particles, 3, p_id, state.height );
-    cvmSet( p->particles, 4, p_id, state.angle );
-    cvmSet( p->particles, 5, p_id, state.xp );
-    cvmSet( p->particles, 6, p_id, state.yp );
-    cvmSet( p->particles, 7, p_id, state.widthp );
-    cvmSet( p->particles, 8, p_id, state.heightp );
-    cvmSet( p->particles, 9, p_id, state.anglep );
+    cvParticleStateRow( p, 0 )[p_id] = (float)state.x;
+    cvParticleStateRow( p, 1 )[p_id] = (float)state.y;
+    cvParticleStateRow( p, 2 )[p_id] = (float)state.width;
+    cvParticleStateRow( p, 3 )[p_id] = (float)state.height;
+    cvParticleStateRow( p, 4 )[p_id] = (float)state.angle;
+    cvParticleStateRow( p, 5 )[p_id] = (float)state.xp;
+    cvParticleStateRow( p, 6 )[p_id] = (float)state.yp;
+    cvParticleStateRow( p, 7 )[p_id] = (float)state.widthp;
+    cvParticleStateRow( p, 8 )[p_id] = (float)state.heightp;
+    cvParticleStateRow( p, 9 )[p_id] = (float)state.anglep;
 }
 
 /*************************** Particle Filter Configuration *********************************/
@@ -225,16 +225,20 @@ void cvParticleStateConfig( CvParticle* p, CvSize imsize, CvParticleState& std )
  */
 void cvParticleStateAdditionalBound( CvParticle* p, CvSize imsize )
 {
+    const float* xs = cvParticleStateRow( p, 0 );
+    const float* ys = cvParticleStateRow( p, 1 );
+    float* widths   = cvParticleStateRow( p, 2 );
+    float* heights  = cvParticleStateRow( p, 3 );
     for( int np = 0; np < p->num_particles; np++ ) 
     {
-        double x      = cvmGet( p->particles, 0, np );
-        double y      = cvmGet( p->particles, 1, np );
-        double width  = cvmGet( p->particles, 2, np );
-        double height = cvmGet( p->particles, 3, np );
+        double x      = xs[np];
+        double y      = ys[np];
+        double width  = widths[np];
+        double height = heights[np];
         width = min( width, imsize.width - x ); // another state x is used
         height = min( height, imsize.height - y ); // another state y is used
-        cvmSet( p->particles, 2, np, width );
-        cvmSet( p->particles, 3, np, height );
+        widths[np]  = (float)width;
+        heights[np] = (float)height;
     }
 }
 
@@ -18,6 +18,9 @@
 #include <iostream>
 #define _USE_MATH_DEFINES
 #include <math.h>
+#include <float.h>
+#include <string.h>
+#include "cvmapfile.h"
 
 #ifndef CV_PCADIFFS_INCLUDED
 #define CV_PCADIFFS_INCLUDED
@@ -34,6 +37,65 @@ void cvMatPcaDiffs( const CvMat* samples, const CvMat* avg, const CvMat* eigenva
 double cvPcaDiffs( const CvMat* sample, const CvMat* avg, const CvMat* eigenvalues, 
                    const CvMat* eigenvectors, int normalize = 0, bool logprob = true );
 
+/**
+ * PCA subspace prepared for repeated cvMatPcaDiffs32f calls
+ *
+ * Eigenvectors are converted to float and transposed to M x D once, and
+ * every eigenvalue-only term is precomputed.
+ */
+typedef struct CvPcaDiffsModel {
+    int D;                 // feature dimension
+    int M;                 // number of principal components
+    int nEig;              // number of eigenvalues
+    CvMat* avg;            // D x 1 CV_32FC1 mean vector
+    CvMat* eigenvectors;   // M x D CV_32FC1, one basis per row
+    CvMat* inv_lambda;     // M x 1 CV_32FC1, 1 / eigenvalue
+    double rho;            // average of residual eigenvalues (nEig > M)
+    double normterm;       // log normalization term used by normalize == 1
+    double count;          // samples the subspace stands for in cvUpdatePcaDiffsModel
+    void* mapped;          // file mapping backing the matrices, see cvLoadPcaDiffsModel
+    size_t mapped_size;
+} CvPcaDiffsModel;
+
+/**
+ * Header of the binary model file written by cvSavePcaDiffsModel
+ *
+ * The file is used in place through a read-only mapping, so it is laid
+ * out as the matrices are used: avg (D floats), inv_lambda (M floats) and
+ * eigenvectors (M rows of D floats, vec_step bytes apart). Every section
+ * and every eigenvector row starts on a 64 byte boundary.
+ */
+typedef struct CvPcaDiffsFileHeader {
+    char   magic[8];       // CV_PCADIFFS_MAGIC
+    int    version;        // CV_PCADIFFS_VERSION
+    int    endian;         // 0x01020304 in the byte order of the writer
+    int    D;
+    int    M;
+    int    nEig;
+    int    vec_step;       // bytes between eigenvector rows
+    double rho;
+    double normterm;
+    int    avg_offset;     // byte offsets of the sections from the file start
+    int    lambda_offset;
+    int    vec_offset;
+    int    file_size;
+} CvPcaDiffsFileHeader;
+
+#define CV_PCADIFFS_MAGIC   "CVXPCAD"
+#define CV_PCADIFFS_VERSION 1
+#define CV_PCADIFFS_ALIGN   64
+#define icvPcaDiffsAlign( size, align ) ( ((size) + (align) - 1) & -(align) )
+#define CV_PCADIFFS_PRIOR_COUNT 100 // initial count of a trained subspace
+
+CvPcaDiffsModel* cvCreatePcaDiffsModel( const CvMat* avg, const CvMat* eigenvalues, 
+                                        const CvMat* eigenvectors );
+void cvReleasePcaDiffsModel( CvPcaDiffsModel** model );
+void cvSavePcaDiffsModel( const char* filename, const CvPcaDiffsModel* model );
+CvPcaDiffsModel* cvLoadPcaDiffsModel( const char* filename );
+void cvMatPcaDiffs32f( const CvMat* samples, const CvPcaDiffsModel* model, CvMat* probs,
+                       int normalize = 0, bool logprob = true );
+void cvUpdatePcaDiffsModel( CvPcaDiffsModel* model, const CvMat* samples, double forget = 0.95 );
+
 /**
  * cvPcaDiffs - Distance "in" and "from" feature space [1]
  *
@@ -237,4 +299,488 @@ double cvPcaDiffs( const CvMat* sample, const CvMat* avg, const CvMat* eigenvalu
 }
 
 
+/**
+ * Prepare a PCA subspace for cvMatPcaDiffs32f
+ *
+ * @param avg                 D x 1 mean vector
+ * @param eigenvalues         nEig x 1 eigen values
+ * @param eigenvectors        M x D or D x M (automatically adjusted) eigen vectors
+ * @return CvPcaDiffsModel*
+ */
+CvPcaDiffsModel* cvCreatePcaDiffsModel( const CvMat* avg, const CvMat* eigenvalues, 
+                                        const CvMat* eigenvectors )
+{
+    CvPcaDiffsModel* model = NULL;
+    int D = avg->rows;
+    int M = (eigenvectors->rows == D) ? eigenvectors->cols : eigenvectors->rows;
+    int nEig = eigenvalues->rows;
+    int d;
+    CV_FUNCNAME( "cvCreatePcaDiffsModel" );
+    __BEGIN__;
+    CV_ASSERT( CV_IS_MAT(avg) && CV_IS_MAT(eigenvalues) && CV_IS_MAT(eigenvectors) );
+    CV_ASSERT( 1 == avg->cols );
+    CV_ASSERT( D == eigenvectors->rows || D == eigenvectors->cols );
+    CV_ASSERT( M <= nEig );
+
+    model = (CvPcaDiffsModel*)cvAlloc( sizeof(CvPcaDiffsModel) );
+    model->D = D;
+    model->M = M;
+    model->nEig = nEig;
+    model->avg = cvCreateMat( D, 1, CV_32FC1 );
+    cvConvert( avg, model->avg );
+    model->eigenvectors = cvCreateMat( M, D, CV_32FC1 );
+    if( D == eigenvectors->rows ) {
+        CvMat *tmp = cvCreateMat( D, M, CV_32FC1 );
+        cvConvert( eigenvectors, tmp );
+        cvT( tmp, model->eigenvectors );
+        cvReleaseMat( &tmp );
+    } else {
+        cvConvert( eigenvectors, model->eigenvectors );
+    }
+
+    model->inv_lambda = cvCreateMat( M, 1, CV_32FC1 );
+    model->normterm = 0;
+    for( d = 0; d < M; d++ ) {
+        double lambda = cvmGet( eigenvalues, d, 0 );
+        cvmSet( model->inv_lambda, d, 0, 1.0 / lambda );
+        model->normterm += log( sqrt( lambda ) );
+    }
+    if( M > 0 ) {
+        model->normterm += log(2*M_PI)*(M/2.0);
+    }
+    model->rho = 0;
+    model->count = CV_PCADIFFS_PRIOR_COUNT;
+    model->mapped = NULL;
+    model->mapped_size = 0;
+    if( nEig > M ) {
+        for( d = M; d < nEig; d++ ) {
+            model->rho += cvmGet( eigenvalues, d, 0 );
+        }
+        model->rho /= (nEig - M);
+        model->normterm += log(2*M_PI*model->rho) * ((nEig - M)/2.0);
+    }
+    __END__;
+    return model;
+}
+
+/**
+ * Release a model created by cvCreatePcaDiffsModel
+ *
+ * @param model
+ */
+void cvReleasePcaDiffsModel( CvPcaDiffsModel** _model )
+{
+    CvPcaDiffsModel* model = *_model;
+    if( !model ) return;
+    cvReleaseMat( &model->avg );
+    cvReleaseMat( &model->eigenvectors );
+    cvReleaseMat( &model->inv_lambda );
+    icvUnmapFile( model->mapped, model->mapped_size );
+    cvFree( _model );
+}
+
+/**
+ * Write a model in the binary format read by cvLoadPcaDiffsModel
+ *
+ * @param filename
+ * @param model
+ */
+void cvSavePcaDiffsModel( const char* filename, const CvPcaDiffsModel* model )
+{
+    CvPcaDiffsFileHeader hdr;
+    FILE* fp = NULL;
+    char* buf = NULL;
+    int m;
+    CV_FUNCNAME( "cvSavePcaDiffsModel" );
+    __BEGIN__;
+    memset( &hdr, 0, sizeof(hdr) );
+    memcpy( hdr.magic, CV_PCADIFFS_MAGIC, sizeof(CV_PCADIFFS_MAGIC) );
+    hdr.version  = CV_PCADIFFS_VERSION;
+    hdr.endian   = 0x01020304;
+    hdr.D        = model->D;
+    hdr.M        = model->M;
+    hdr.nEig     = model->nEig;
+    hdr.vec_step = icvPcaDiffsAlign( model->D * (int)sizeof(float), CV_PCADIFFS_ALIGN );
+    hdr.rho      = model->rho;
+    hdr.normterm = model->normterm;
+    hdr.avg_offset    = icvPcaDiffsAlign( (int)sizeof(hdr), CV_PCADIFFS_ALIGN );
+    hdr.lambda_offset = hdr.avg_offset + icvPcaDiffsAlign( model->D * (int)sizeof(float), CV_PCADIFFS_ALIGN );
+    hdr.vec_offset    = hdr.lambda_offset + icvPcaDiffsAlign( model->M * (int)sizeof(float), CV_PCADIFFS_ALIGN );
+    hdr.file_size     = hdr.vec_offset + hdr.vec_step * model->M;
+
+    // assemble the whole file in memory so that padding is zero filled
+    buf = (char*)cvAlloc( hdr.file_size );
+    memset( buf, 0, hdr.file_size );
+    memcpy( buf, &hdr, sizeof(hdr) );
+    for( m = 0; m < model->D; m++ ) {
+        ((float*)(buf + hdr.avg_offset))[m] = (float)cvmGet( model->avg, m, 0 );
+    }
+    for( m = 0; m < model->M; m++ ) {
+        ((float*)(buf + hdr.lambda_offset))[m] = (float)cvmGet( model->inv_lambda, m, 0 );
+        memcpy( buf + hdr.vec_offset + hdr.vec_step * m,
+                model->eigenvectors->data.ptr + model->eigenvectors->step * m,
+                model->D * sizeof(float) );
+    }
+
+    fp = fopen( filename, "wb" );
+    if( fp == NULL ) {
+        CV_ERROR( CV_StsError, "Cannot open the PCA model file for writing" );
+    }
+    if( fwrite( buf, 1, hdr.file_size, fp ) != (size_t)hdr.file_size ) {
+        CV_ERROR( CV_StsError, "Cannot write the PCA model file" );
+    }
+    __END__;
+    if( fp ) fclose( fp );
+    if( buf ) cvFree( &buf );
+}
+
+/**
+ * Check a mapped model header against the file size
+ *
+ * The fields come from the file, so the section bounds are computed in
+ * 64 bit where products of two int fields can not overflow, and every
+ * field is limited to the file size first.
+ */
+CV_INLINE bool icvPcaDiffsHeaderValid( const CvPcaDiffsFileHeader* hdr, size_t size )
+{
+    const int64 fsize = (int64)sizeof(float);
+    if( memcmp( hdr->magic, CV_PCADIFFS_MAGIC, sizeof(CV_PCADIFFS_MAGIC) ) != 0 ||
+        hdr->version != CV_PCADIFFS_VERSION || hdr->endian != 0x01020304 ||
+        hdr->file_size < 0 || (size_t)hdr->file_size != size )
+        return false;
+    int64 file_size = hdr->file_size;
+    int64 D = hdr->D, M = hdr->M, nEig = hdr->nEig, vec_step = hdr->vec_step;
+    int64 avg_offset = hdr->avg_offset, lambda_offset = hdr->lambda_offset, vec_offset = hdr->vec_offset;
+    if( D <= 0 || D * fsize > file_size || M < 0 || M > nEig || M * fsize > file_size ||
+        vec_step < D * fsize || vec_step > file_size ||
+        avg_offset < (int64)sizeof(CvPcaDiffsFileHeader) || avg_offset > file_size ||
+        lambda_offset < 0 || lambda_offset > file_size ||
+        vec_offset < 0 || vec_offset > file_size )
+        return false;
+    if( vec_step % CV_PCADIFFS_ALIGN != 0 || avg_offset % CV_PCADIFFS_ALIGN != 0 ||
+        lambda_offset % CV_PCADIFFS_ALIGN != 0 || vec_offset % CV_PCADIFFS_ALIGN != 0 )
+        return false;
+    return lambda_offset >= avg_offset + D * fsize &&
+           vec_offset >= lambda_offset + M * fsize &&
+           file_size >= vec_offset + vec_step * M;
+}
+
+/**
+ * Map a binary model file written by cvSavePcaDiffsModel
+ *
+ * Only the header is validated and read; the matrices of the returned
+ * model point into a read-only mapping of the file, so loading time does
+ * not depend on the subspace size. Release with cvReleasePcaDiffsModel.
+ *
+ * @param filename
+ * @return CvPcaDiffsModel* NULL if the file is missing or not a valid model
+ */
+CvPcaDiffsModel* cvLoadPcaDiffsModel( const char* filename )
+{
+    size_t size;
+    void* addr = icvMapFile( filename, &size );
+    const CvPcaDiffsFileHeader* hdr = (const CvPcaDiffsFileHeader*)addr;
+    CvPcaDiffsModel* model;
+    char* base = (char*)addr;
+    if( addr == NULL ) {
+        return NULL;
+    }
+    if( size < sizeof(CvPcaDiffsFileHeader) || !icvPcaDiffsHeaderValid( hdr, size ) ) {
+        icvUnmapFile( addr, size );
+        return NULL;
+    }
+
+    model = (CvPcaDiffsModel*)cvAlloc( sizeof(CvPcaDiffsModel) );
+    model->D = hdr->D;
+    model->M = hdr->M;
+    model->nEig = hdr->nEig;
+    model->rho = hdr->rho;
+    model->normterm = hdr->normterm;
+    model->count = CV_PCADIFFS_PRIOR_COUNT;
+    model->avg = cvCreateMatHeader( hdr->D, 1, CV_32FC1 );
+    cvSetData( model->avg, base + hdr->avg_offset, sizeof(float) );
+    model->inv_lambda = cvCreateMatHeader( MAX(hdr->M, 1), 1, CV_32FC1 );
+    cvSetData( model->inv_lambda, base + hdr->lambda_offset, sizeof(float) );
+    model->inv_lambda->rows = hdr->M;
+    model->eigenvectors = cvCreateMatHeader( MAX(hdr->M, 1), hdr->D, CV_32FC1 );
+    cvSetData( model->eigenvectors, base + hdr->vec_offset, hdr->vec_step );
+    model->eigenvectors->rows = hdr->M;
+    model->mapped = addr;
+    model->mapped_size = size;
+    return model;
+}
+
+
+/**
+ * Fold new samples into a subspace (incremental PCA)
+ *
+ * Sequential Karhunen-Loeve update with a moving mean [3]: the samples,
+ * centered on their own mean plus one column for the mean shift, are
+ * split into their projection on the basis and an orthonormalized
+ * residual, and only the small (M + r) x (M + k + 1) matrix
+ *     [ sqrt(forget) * sigma   projection ]
+ *     [ 0                      residual   ]
+ * is decomposed, where sigma = sqrt( count * eigenvalues ). The rotated
+ * basis keeps its M leading directions; the energy of the others moves
+ * into rho. The cost is O( D (M + k)^2 ) for k samples and memory stays
+ * at M basis vectors. A mapped model is copied to owned memory first.
+ *
+ * @param model    Subspace from cvCreatePcaDiffsModel or cvLoadPcaDiffsModel. M > 0
+ * @param samples  D x k new sample vectors
+ * @param [forget = 0.95] Weight of the old samples, 1 for no forgetting
+ *
+ * References
+ *   [3] @ARTICLE{Ross08incremental,
+ *     author = {David A. Ross and Jongwoo Lim and Ruei-Sung Lin and Ming-Hsuan Yang},
+ *     title = {Incremental Learning for Robust Visual Tracking},
+ *     journal = {International Journal of Computer Vision},
+ *     year = {2008},
+ *     volume = {77},
+ *     pages = {125--141}
+ *   }
+ */
+void cvUpdatePcaDiffsModel( CvPcaDiffsModel* model, const CvMat* samples, double forget )
+{
+    int D = model->D, M = model->M, k = samples->cols;
+    int d, j, i, r = 0;
+    double n, fn, n1, discarded = 0;
+    CvMat *X = NULL, *U = NULL, *C = NULL, *R = NULL, *Q = NULL;
+    CvMat *S = NULL, *W = NULL, *Us = NULL, *E = NULL, *Unew = NULL;
+    CvMat hdr;
+    CV_FUNCNAME( "cvUpdatePcaDiffsModel" );
+    __BEGIN__;
+    CV_ASSERT( CV_IS_MAT(samples) && samples->rows == D && k > 0 );
+    CV_ASSERT( M > 0 && 0 < forget && forget <= 1 );
+
+    if( model->mapped ) { // the mapping is read-only
+        CvMat* avg = cvCloneMat( model->avg );
+        CvMat* vec = cvCloneMat( model->eigenvectors );
+        CvMat* il  = cvCloneMat( model->inv_lambda );
+        cvReleaseMat( &model->avg );
+        cvReleaseMat( &model->eigenvectors );
+        cvReleaseMat( &model->inv_lambda );
+        icvUnmapFile( model->mapped, model->mapped_size );
+        model->mapped = NULL;
+        model->mapped_size = 0;
+        model->avg = avg;
+        model->eigenvectors = vec;
+        model->inv_lambda = il;
+    }
+
+    n  = model->count;
+    fn = forget * n;
+    n1 = fn + k;
+
+    // centered samples and the mean shift column
+    X = cvCreateMat( D, k + 1, CV_64FC1 );
+    cvConvert( samples, cvGetCols( X, &hdr, 0, k ) );
+    for( d = 0; d < D; d++ ) {
+        double* row = (double*)( X->data.ptr + X->step * d );
+        double mu = model->avg->data.fl[d], mub = 0;
+        for( j = 0; j < k; j++ ) mub += row[j];
+        mub /= k;
+        for( j = 0; j < k; j++ ) row[j] -= mub;
+        row[k] = sqrt( fn * k / n1 ) * ( mub - mu );
+        model->avg->data.fl[d] = (float)( ( fn * mu + k * mub ) / n1 );
+    }
+
+    // projection and residual
+    U = cvCreateMat( M, D, CV_64FC1 );
+    cvConvert( model->eigenvectors, U );
+    C = cvCreateMat( M, k + 1, CV_64FC1 );
+    R = cvCreateMat( D, k + 1, CV_64FC1 );
+    cvGEMM( U, X, 1, NULL, 0, C );
+    cvGEMM( U, C, -1, X, 1, R, CV_GEMM_A_T );
+
+    // orthonormal basis Q of the residual, Gram-Schmidt applied twice
+    Q = cvCreateMat( D, k + 1, CV_64FC1 );
+    for( j = 0; j <= k; j++ ) {
+        double norm0 = 0, norm = 0;
+        for( d = 0; d < D; d++ ) {
+            double v = CV_MAT_ELEM( *R, double, d, j );
+            CV_MAT_ELEM( *Q, double, d, r ) = v;
+            norm0 += v * v;
+        }
+        for( int pass = 0; pass < 2; pass++ ) {
+            for( i = 0; i < r; i++ ) {
+                double dot = 0;
+                for( d = 0; d < D; d++ )
+                    dot += CV_MAT_ELEM( *Q, double, d, i ) * CV_MAT_ELEM( *Q, double, d, r );
+                for( d = 0; d < D; d++ )
+                    CV_MAT_ELEM( *Q, double, d, r ) -= dot * CV_MAT_ELEM( *Q, double, d, i );
+            }
+        }
+        for( d = 0; d < D; d++ )
+            norm += CV_MAT_ELEM( *Q, double, d, r ) * CV_MAT_ELEM( *Q, double, d, r );
+        if( norm <= 1e-12 * MAX( norm0, DBL_MIN ) || norm <= DBL_MIN ) continue; // dependent
+        norm = 1.0 / sqrt( norm );
+        for( d = 0; d < D; d++ )
+            CV_MAT_ELEM( *Q, double, d, r ) *= norm;
+        r++;
+    }
+
+    // small matrix [ diag( sqrt(forget) sigma ) C ; 0 Q'R ]
+    S = cvCreateMat( M + r, M + k + 1, CV_64FC1 );
+    cvZero( S );
+    for( i = 0; i < M; i++ ) {
+        CV_MAT_ELEM( *S, double, i, i ) = sqrt( fn / model->inv_lambda->data.fl[i] );
+        for( j = 0; j <= k; j++ )
+            CV_MAT_ELEM( *S, double, i, M + j ) = CV_MAT_ELEM( *C, double, i, j );
+    }
+    if( r > 0 ) {
+        CvMat qhdr, shdr;
+        CvMat* Qr = cvGetCols( Q, &qhdr, 0, r );
+        CvMat* Sr = cvGetSubRect( S, &shdr, cvRect( M, M, k + 1, r ) );
+        cvGEMM( Qr, R, 1, NULL, 0, Sr, CV_GEMM_A_T );
+    }
+    W = cvCreateMat( M + r, 1, CV_64FC1 );
+    Us = cvCreateMat( M + r, M + r, CV_64FC1 );
+    cvSVD( S, W, Us, NULL, 0 ); // S = Us diag(W) V', W in descending order
+
+    // rotate [ U ; Q' ] and keep the M leading directions
+    E = cvCreateMat( M + r, D, CV_64FC1 );
+    for( i = 0; i < M; i++ )
+        memcpy( E->data.ptr + E->step * i, U->data.ptr + U->step * i, D * sizeof(double) );
+    for( i = 0; i < r; i++ )
+        for( d = 0; d < D; d++ )
+            CV_MAT_ELEM( *E, double, M + i, d ) = CV_MAT_ELEM( *Q, double, d, i );
+    Unew = cvCreateMat( M + r, D, CV_64FC1 );
+    cvGEMM( Us, E, 1, NULL, 0, Unew, CV_GEMM_A_T );
+    cvConvert( cvGetRows( Unew, &hdr, 0, M ), model->eigenvectors );
+
+    model->normterm = log( 2 * M_PI ) * ( M / 2.0 );
+    for( i = 0; i < M; i++ ) {
+        double lambda = MAX( W->data.db[i] * W->data.db[i] / n1, DBL_MIN );
+        model->inv_lambda->data.fl[i] = (float)( 1.0 / lambda );
+        model->normterm += log( sqrt( lambda ) );
+    }
+    for( i = M; i < M + r; i++ )
+        discarded += W->data.db[i] * W->data.db[i];
+    if( model->nEig > M ) {
+        int nres = model->nEig - M;
+        model->rho = ( fn * model->rho * nres + discarded ) / ( n1 * nres );
+        model->normterm += log( 2 * M_PI * model->rho ) * ( nres / 2.0 );
+    }
+    model->count = n1;
+    __END__;
+    cvReleaseMat( &X );
+    cvReleaseMat( &U );
+    cvReleaseMat( &C );
+    cvReleaseMat( &R );
+    cvReleaseMat( &Q );
+    cvReleaseMat( &S );
+    cvReleaseMat( &W );
+    cvReleaseMat( &Us );
+    cvReleaseMat( &E );
+    cvReleaseMat( &Unew );
+}
+
+/**
+ * cvMatPcaDiffs32f - float32 DIFS + DFFS over a prepared subspace
+ *
+ * Same result as cvMatPcaDiffs (up to float rounding), computed as
+ * blocked matrix operations. Samples are processed in blocks of
+ * columns; per block the mean is subtracted while accumulating
+ * |x - avg|^2, the projection is a single GEMM with the pre-transposed
+ * eigenvectors, and one pass over the projection accumulates both the
+ * scaled (DIFS) and the plain projection norms. Reductions are done in
+ * double.
+ *
+ * @param samples             D x N sample vectors. CV_32FC1
+ * @param model               Subspace from cvCreatePcaDiffsModel
+ * @param probs               1 x N computed likelihood probabilities
+ * @param [normalize = 0]     Compute normalization term or not
+ *                            0 - nothing
+ *                            1 - normalization term
+ *                            2 - normalize so that sum becomes 1.0
+ * @param [logprob   = true]  Log probability or not
+ */
+void cvMatPcaDiffs32f( const CvMat* samples, const CvPcaDiffsModel* model, CvMat* probs,
+                       int normalize, bool logprob )
+{
+    const int BLOCK = 256;
+    int D = samples->rows;
+    int N = samples->cols;
+    int M = model->M;
+    int d, m, n, n0, nb;
+    double *logp = NULL, *sqnorm = NULL, *difs = NULL, *projnorm = NULL;
+    CvMat *samples0 = NULL, *proj = NULL;
+    CV_FUNCNAME( "cvMatPcaDiffs32f" );
+    __BEGIN__;
+    CV_ASSERT( CV_IS_MAT(samples) && CV_MAT_TYPE(samples->type) == CV_32FC1 );
+    CV_ASSERT( D == model->D );
+    CV_ASSERT( 1 == probs->rows && N == probs->cols );
+
+    logp     = (double*)cvAlloc( N * sizeof(double) );
+    sqnorm   = (double*)cvAlloc( BLOCK * sizeof(double) );
+    difs     = (double*)cvAlloc( BLOCK * sizeof(double) );
+    projnorm = (double*)cvAlloc( BLOCK * sizeof(double) );
+    samples0 = cvCreateMat( D, BLOCK, CV_32FC1 );
+    proj     = cvCreateMat( MAX(M, 1), BLOCK, CV_32FC1 );
+
+    for( n0 = 0; n0 < N; n0 += BLOCK ) {
+        CvMat s0hdr, projhdr;
+        nb = MIN( BLOCK, N - n0 );
+        for( n = 0; n < nb; n++ ) {
+            sqnorm[n] = difs[n] = projnorm[n] = 0;
+        }
+
+        // mean subtraction fused with the squared norm of each sample
+        for( d = 0; d < D; d++ ) {
+            const float* src = (const float*)( samples->data.ptr + samples->step * d ) + n0;
+            float* dst = (float*)( samples0->data.ptr + samples0->step * d );
+            float mu = model->avg->data.fl[d];
+            for( n = 0; n < nb; n++ ) {
+                float v = src[n] - mu;
+                dst[n] = v;
+                sqnorm[n] += v * v;
+            }
+        }
+
+        if( M > 0 ) {
+            CvMat* s0 = cvGetCols( samples0, &s0hdr, 0, nb );
+            CvMat* pj = cvGetCols( proj, &projhdr, 0, nb );
+            cvGEMM( model->eigenvectors, s0, 1, NULL, 0, pj );
+            // DIFS and |projection|^2 in one pass over the projection
+            for( m = 0; m < M; m++ ) {
+                const float* p = (const float*)( proj->data.ptr + proj->step * m );
+                double il = model->inv_lambda->data.fl[m];
+                for( n = 0; n < nb; n++ ) {
+                    double p2 = (double)p[n] * p[n];
+                    difs[n] += p2 * il;
+                    projnorm[n] += p2;
+                }
+            }
+        }
+
+        for( n = 0; n < nb; n++ ) {
+            double dffs = ( model->nEig > M ) ? ( sqnorm[n] - projnorm[n] ) / model->rho : 0;
+            logp[n0 + n] = difs[n] / (-2) + dffs / (-2) - ( normalize == 1 ? model->normterm : 0 );
+        }
+    }
+
+    if( normalize == 2 ) {
+        double maxval = -DBL_MAX, sum = 0;
+        for( n = 0; n < N; n++ ) maxval = MAX( maxval, logp[n] );
+        for( n = 0; n < N; n++ ) sum += exp( logp[n] - maxval );
+        for( n = 0; n < N; n++ ) {
+            logp[n] = logprob ? ( logp[n] - maxval ) - log( sum ) : exp( logp[n] - maxval ) / sum;
+        }
+    } else if( !logprob ) {
+        for( n = 0; n < N; n++ ) logp[n] = exp( logp[n] );
+    }
+    {
+        CvMat logpmat = cvMat( 1, N, CV_64FC1, logp );
+        cvConvert( &logpmat, probs );
+    }
+    __END__;
+    cvReleaseMat( &samples0 );
+    cvReleaseMat( &proj );
+    if( logp ) cvFree( &logp );
+    if( sqnorm ) cvFree( &sqnorm );
+    if( difs ) cvFree( &difs );
+    if( projnorm ) cvFree( &projnorm );
+}
+
+
 #endif
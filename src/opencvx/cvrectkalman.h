@@ -0,0 +1,183 @@
+/** @file
+ * Constant velocity Kalman predictor of a rotated rectangle
+ *
+ * x, y, width, height and angle are filtered independently with a
+ * position-velocity state each, so a correction or a prediction is a
+ * few dozen flops. Measurements may come at irregular frame numbers.
+ *
+ * Example)
+ * <code>
+ * CvRectKalman* kalman = cvCreateRectKalman();
+ * cvRectKalmanCorrect( kalman, rect32f, frame );      // for each annotation
+ * if( cvRectKalmanPredict( kalman, frame + 1, &rect32f ) ) // where it goes next
+ * cvReleaseRectKalman( &kalman );
+ * </code>
+ *
+ * The MIT License
+ *
+ * Copyright (c) OpenALPR contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CV_RECTKALMAN_INCLUDED
+#define CV_RECTKALMAN_INCLUDED
+
+#include "cv.h"
+#include "cvaux.h"
+#include "cxcore.h"
+#include <math.h>
+#include "cvrect32f.h"
+
+#define CV_RECTKALMAN_DIMS 5 // x, y, width, height, angle
+
+typedef struct CvRectKalman {
+    int count;        // corrections since reset
+    int t;            // frame number of the last correction
+    double q;         // acceleration variance, per frame^2
+    double r;         // measurement variance
+    double x[CV_RECTKALMAN_DIMS];   // filtered values
+    double v[CV_RECTKALMAN_DIMS];   // velocities, per frame
+    double pxx[CV_RECTKALMAN_DIMS]; // covariance of (x, v) per dimension
+    double pxv[CV_RECTKALMAN_DIMS];
+    double pvv[CV_RECTKALMAN_DIMS];
+} CvRectKalman;
+
+CvRectKalman* cvCreateRectKalman( double accel_std = 1.0, double measure_std = 2.0 );
+void cvReleaseRectKalman( CvRectKalman** kalman );
+void cvResetRectKalman( CvRectKalman* kalman );
+void cvRectKalmanCorrect( CvRectKalman* kalman, CvRect32f rect32f, int t );
+bool cvRectKalmanPredict( const CvRectKalman* kalman, int t, CvRect32f* rect32f );
+
+/**
+ * Allocate a rectangle predictor
+ *
+ * @param accel_std    Standard deviation of the change of velocity per frame
+ * @param measure_std  Standard deviation of the annotation error
+ * @return CvRectKalman*
+ */
+CvRectKalman* cvCreateRectKalman( double accel_std, double measure_std )
+{
+    CvRectKalman* kalman = (CvRectKalman*)cvAlloc( sizeof(CvRectKalman) );
+    kalman->q = accel_std * accel_std;
+    kalman->r = measure_std * measure_std;
+    cvResetRectKalman( kalman );
+    return kalman;
+}
+
+/**
+ * Release a rectangle predictor
+ *
+ * @param kalman
+ */
+void cvReleaseRectKalman( CvRectKalman** kalman )
+{
+    cvFree( kalman );
+}
+
+/**
+ * Forget the motion learned so far
+ *
+ * @param kalman
+ */
+void cvResetRectKalman( CvRectKalman* kalman )
+{
+    kalman->count = 0;
+    kalman->t = 0;
+}
+
+/**
+ * Learn from a rectangle observed at frame t
+ *
+ * A measurement at or before the last one restarts the filter.
+ *
+ * @param kalman
+ * @param rect32f
+ * @param t        Frame number
+ */
+void cvRectKalmanCorrect( CvRectKalman* kalman, CvRect32f rect32f, int t )
+{
+    double z[CV_RECTKALMAN_DIMS] = {
+        rect32f.x, rect32f.y, rect32f.width, rect32f.height, rect32f.angle
+    };
+    int i;
+    if( kalman->count == 0 || t <= kalman->t )
+    {
+        for( i = 0; i < CV_RECTKALMAN_DIMS; i++ )
+        {
+            kalman->x[i] = z[i];
+            kalman->v[i] = 0;
+            kalman->pxx[i] = kalman->r;
+            kalman->pxv[i] = 0;
+            kalman->pvv[i] = 1e4; // velocity unknown
+        }
+        kalman->count = 1;
+        kalman->t = t;
+        return;
+    }
+
+    double dt = t - kalman->t;
+    double q = kalman->q;
+    for( i = 0; i < CV_RECTKALMAN_DIMS; i++ )
+    {
+        // predict: F = [1 dt; 0 1], Q from white acceleration
+        double x = kalman->x[i] + dt * kalman->v[i];
+        double pxx = kalman->pxx[i] + dt * ( 2 * kalman->pxv[i] + dt * kalman->pvv[i] )
+                   + q * dt * dt * dt * dt / 4;
+        double pxv = kalman->pxv[i] + dt * kalman->pvv[i] + q * dt * dt * dt / 2;
+        double pvv = kalman->pvv[i] + q * dt * dt;
+
+        // correct: H = [1 0]
+        double y = z[i] - x;
+        if( i == 4 ) // angle innovation is circular
+            y -= 360 * floor( ( y + 180 ) / 360 );
+        double s = pxx + kalman->r;
+        double kx = pxx / s, kv = pxv / s;
+        kalman->x[i] = x + kx * y;
+        kalman->v[i] = kalman->v[i] + kv * y;
+        kalman->pxx[i] = ( 1 - kx ) * pxx;
+        kalman->pxv[i] = ( 1 - kx ) * pxv;
+        kalman->pvv[i] = pvv - kv * pxv;
+    }
+    kalman->x[4] -= 360 * floor( kalman->x[4] / 360 );
+    kalman->count++;
+    kalman->t = t;
+}
+
+/**
+ * Predict the rectangle at frame t
+ *
+ * @param kalman
+ * @param t        Frame number
+ * @param rect32f  [out]
+ * @return bool    false until two rectangles are observed (no velocity known)
+ */
+bool cvRectKalmanPredict( const CvRectKalman* kalman, int t, CvRect32f* rect32f )
+{
+    if( kalman->count < 2 ) return false;
+    double dt = t - kalman->t;
+    double p[CV_RECTKALMAN_DIMS];
+    for( int i = 0; i < CV_RECTKALMAN_DIMS; i++ )
+        p[i] = kalman->x[i] + dt * kalman->v[i];
+    p[4] -= 360 * floor( p[4] / 360 );
+    *rect32f = cvRect32f( p[0], p[1], MAX( p[2], 1.0 ), MAX( p[3], 1.0 ), p[4] );
+    return true;
+}
+
+
+#endif
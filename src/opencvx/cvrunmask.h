@@ -0,0 +1,459 @@
+/** @file
+ * Run-length encoded binary masks and morphology on runs
+ *
+ * A CvRunMask stores, row by row, the half open intervals [start, end)
+ * of non-zero pixels. Skin color and background masks are mostly empty,
+ * so erosion, dilation, opening, closing and sandwich fill cost time
+ * proportional to the number of runs (and their boundaries) instead of
+ * the number of pixels. Results are identical to cvErode / cvDilate with
+ * the default 3x3 rectangular element (border pixels are not eroded and
+ * do not dilate into the image). The row pass of the sandwich fill matches
+ * cvSandwichFill on 0/1 masks. Its column pass measures runs along the
+ * column, where cvSandwichFill checks the horizontal neighbour, so the
+ * results can differ (see cvRunMaskSandwichFill).
+ *
+ * Example)
+ * <code>
+ * CvRunMask* runs = cvCreateRunMask( mask->width, mask->height );
+ * cvRunMaskFromImage( mask, runs );
+ * cvRunMaskOpening( runs, runs, 2 );
+ * cvRunMaskSandwichFill( runs, runs );
+ * cvRunMaskToImage( runs, mask );
+ * cvReleaseRunMask( &runs );
+ * </code>
+ *
+ * The MIT License
+ *
+ * Copyright (c) OpenALPR contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CV_RUNMASK_INCLUDED
+#define CV_RUNMASK_INCLUDED
+
+#include "cv.h"
+#include "cvaux.h"
+#include "cxcore.h"
+#include <string.h>
+#include <vector>
+using namespace std;
+
+/******************************* Structures **********************************/
+
+typedef struct CvMaskRun {
+    int start;           // first non-zero column
+    int end;             // one past the last non-zero column
+} CvMaskRun;
+
+typedef struct CvRunMask {
+    int width;
+    int height;
+    int* rowptr;         // height + 1 entries. runs of row y are runs[rowptr[y]] .. runs[rowptr[y+1]-1]
+    CvMaskRun* runs;     // sorted, non-overlapping and non-touching within a row
+    int total;           // number of runs
+    int capacity;        // allocated number of runs
+} CvRunMask;
+
+/**************************** Function Prototypes ****************************/
+
+CvRunMask* cvCreateRunMask( int width, int height, int capacity = 0 );
+void cvReleaseRunMask( CvRunMask** mask );
+void cvRunMaskFromImage( const IplImage* src, CvRunMask* dst );
+void cvRunMaskToImage( const CvRunMask* src, IplImage* dst, int value = 1 );
+void cvRunMaskErode( const CvRunMask* src, CvRunMask* dst, int iterations = 1 );
+void cvRunMaskDilate( const CvRunMask* src, CvRunMask* dst, int iterations = 1 );
+void cvRunMaskOpening( const CvRunMask* src, CvRunMask* dst, int iterations = 1 );
+void cvRunMaskClosing( const CvRunMask* src, CvRunMask* dst, int iterations = 1 );
+void cvRunMaskSandwichFill( const CvRunMask* src, CvRunMask* dst );
+
+/*************************** Function Definitions ****************************/
+
+/**
+ * Allocate an empty run mask
+ *
+ * @param width
+ * @param height
+ * @param [capacity = 0] Initial number of runs to reserve. Grows as needed.
+ * @return CvRunMask*
+ */
+CvRunMask* cvCreateRunMask( int width, int height, int capacity )
+{
+    CvRunMask* mask = (CvRunMask*)cvAlloc( sizeof(CvRunMask) );
+    mask->width = width;
+    mask->height = height;
+    mask->rowptr = (int*)cvAlloc( (height + 1) * sizeof(int) );
+    memset( mask->rowptr, 0, (height + 1) * sizeof(int) );
+    mask->capacity = MAX( capacity, 16 );
+    mask->runs = (CvMaskRun*)cvAlloc( mask->capacity * sizeof(CvMaskRun) );
+    mask->total = 0;
+    return mask;
+}
+
+/**
+ * Release a run mask
+ *
+ * @param mask
+ */
+void cvReleaseRunMask( CvRunMask** _mask )
+{
+    CvRunMask* mask = *_mask;
+    if( !mask ) return;
+    cvFree( &mask->rowptr );
+    cvFree( &mask->runs );
+    cvFree( _mask );
+}
+
+// Empty a mask and give it a new size, keeping the run storage
+inline void icvRunMaskReset( CvRunMask* mask, int width, int height )
+{
+    if( height != mask->height ) {
+        cvFree( &mask->rowptr );
+        mask->rowptr = (int*)cvAlloc( (height + 1) * sizeof(int) );
+    }
+    mask->width = width;
+    mask->height = height;
+    mask->rowptr[0] = 0;
+    mask->total = 0;
+}
+
+// Make room for at least n runs, keeping the stored ones
+inline void icvRunMaskReserve( CvRunMask* mask, int n )
+{
+    if( n <= mask->capacity ) return;
+    int capacity = MAX( n, 2 * mask->capacity );
+    CvMaskRun* runs = (CvMaskRun*)cvAlloc( capacity * sizeof(CvMaskRun) );
+    memcpy( runs, mask->runs, mask->total * sizeof(CvMaskRun) );
+    cvFree( &mask->runs );
+    mask->runs = runs;
+    mask->capacity = capacity;
+}
+
+// Append a run to the row being built
+inline void icvRunMaskPush( CvRunMask* mask, int start, int end )
+{
+    icvRunMaskReserve( mask, mask->total + 1 );
+    mask->runs[mask->total].start = start;
+    mask->runs[mask->total].end = end;
+    mask->total++;
+}
+
+// Exchange the contents of two masks
+inline void icvRunMaskSwap( CvRunMask* a, CvRunMask* b )
+{
+    CvRunMask tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+/**
+ * Encode a mask image. Non-zero pixels become runs.
+ *
+ * @param src 8U 1 channel mask
+ * @param dst
+ */
+void cvRunMaskFromImage( const IplImage* src, CvRunMask* dst )
+{
+    int x, y;
+    int width = src->width;
+    CV_FUNCNAME( "cvRunMaskFromImage" );
+    __BEGIN__;
+    CV_ASSERT( src->depth == IPL_DEPTH_8U && src->nChannels == 1 );
+    icvRunMaskReset( dst, src->width, src->height );
+    for( y = 0; y < src->height; y++ )
+    {
+        const uchar* row = (const uchar*)( src->imageData + src->widthStep * y );
+        x = 0;
+        while( x < width )
+        {
+            // skip background a word at a time, masks are mostly empty
+            while( x + (int)sizeof(size_t) <= width ) {
+                size_t word;
+                memcpy( &word, row + x, sizeof(size_t) );
+                if( word != 0 ) break;
+                x += sizeof(size_t);
+            }
+            while( x < width && row[x] == 0 ) x++;
+            if( x == width ) break;
+            int start = x;
+            while( x < width && row[x] != 0 ) x++;
+            icvRunMaskPush( dst, start, x );
+        }
+        dst->rowptr[y + 1] = dst->total;
+    }
+    __END__;
+}
+
+/**
+ * Decode a run mask into a mask image
+ *
+ * @param src
+ * @param dst           8U 1 channel image of the same size
+ * @param [value = 1]   Value written for pixels inside runs. Others are 0.
+ */
+void cvRunMaskToImage( const CvRunMask* src, IplImage* dst, int value )
+{
+    int y, i;
+    CV_FUNCNAME( "cvRunMaskToImage" );
+    __BEGIN__;
+    CV_ASSERT( dst->depth == IPL_DEPTH_8U && dst->nChannels == 1 );
+    CV_ASSERT( dst->width == src->width && dst->height == src->height );
+    for( y = 0; y < src->height; y++ )
+    {
+        uchar* row = (uchar*)( dst->imageData + dst->widthStep * y );
+        memset( row, 0, dst->width );
+        for( i = src->rowptr[y]; i < src->rowptr[y + 1]; i++ )
+        {
+            memset( row + src->runs[i].start, value, src->runs[i].end - src->runs[i].start );
+        }
+    }
+    __END__;
+}
+
+/**
+ * Transpose a run mask. Columns of src become rows of dst.
+ *
+ * Column runs start where a row has a pixel the previous row does not,
+ * and end where the previous row has a pixel this row does not, so only
+ * the differences between consecutive rows are visited.
+ */
+inline void icvRunMaskTranspose( const CvRunMask* src, CvRunMask* dst )
+{
+    int x, y, i, j, pass;
+    int W = src->width, H = src->height;
+    vector<int> open( W ), cursor( W + 1 );
+    vector<CvMaskRun> born, died;
+
+    icvRunMaskReset( dst, H, W );
+    for( pass = 0; pass < 2; pass++ )
+    {
+        // pass 0 counts runs per column, pass 1 stores them
+        if( pass == 0 ) {
+            std::fill( cursor.begin(), cursor.end(), 0 );
+        } else {
+            for( x = 0; x < W; x++ ) cursor[x + 1] += cursor[x];
+            for( x = 0; x <= W; x++ ) dst->rowptr[x] = cursor[x];
+            icvRunMaskReserve( dst, cursor[W] );
+            dst->total = cursor[W];
+        }
+        for( y = 0; y <= H; y++ )
+        {
+            const CvMaskRun* cur = y < H ? src->runs + src->rowptr[y] : NULL;
+            int ncur = y < H ? src->rowptr[y + 1] - src->rowptr[y] : 0;
+            const CvMaskRun* prev = y > 0 ? src->runs + src->rowptr[y - 1] : NULL;
+            int nprev = y > 0 ? src->rowptr[y] - src->rowptr[y - 1] : 0;
+            born.clear(); died.clear();
+            // born = cur \ prev, died = prev \ cur
+            for( int k = 0; k < 2; k++ )
+            {
+                const CvMaskRun* a = k == 0 ? cur : prev;
+                const CvMaskRun* b = k == 0 ? prev : cur;
+                int na = k == 0 ? ncur : nprev, nb = k == 0 ? nprev : ncur;
+                vector<CvMaskRun>& out = k == 0 ? born : died;
+                for( i = 0, j = 0; i < na; i++ )
+                {
+                    int pos = a[i].start;
+                    while( j < nb && b[j].end <= pos ) j++;
+                    for( int l = j; l < nb && b[l].start < a[i].end; l++ ) {
+                        if( b[l].start > pos ) {
+                            CvMaskRun r = { pos, b[l].start };
+                            out.push_back( r );
+                        }
+                        pos = MAX( pos, b[l].end );
+                    }
+                    if( pos < a[i].end ) {
+                        CvMaskRun r = { pos, a[i].end };
+                        out.push_back( r );
+                    }
+                }
+            }
+            for( i = 0; i < (int)died.size(); i++ ) {
+                for( x = died[i].start; x < died[i].end; x++ ) {
+                    if( pass == 0 ) {
+                        cursor[x + 1]++;
+                    } else {
+                        dst->runs[cursor[x]].start = open[x];
+                        dst->runs[cursor[x]].end = y;
+                        cursor[x]++;
+                    }
+                }
+            }
+            for( i = 0; i < (int)born.size(); i++ ) {
+                for( x = born[i].start; x < born[i].end; x++ ) open[x] = y;
+            }
+        }
+    }
+}
+
+// Grow every run by r columns on both sides and merge the ones that meet
+inline void icvRunMaskDilateRows( const CvRunMask* src, CvRunMask* dst, int r )
+{
+    int y, i;
+    icvRunMaskReset( dst, src->width, src->height );
+    for( y = 0; y < src->height; y++ )
+    {
+        for( i = src->rowptr[y]; i < src->rowptr[y + 1]; i++ )
+        {
+            int start = MAX( src->runs[i].start - r, 0 );
+            int end = MIN( src->runs[i].end + r, src->width );
+            if( dst->total > dst->rowptr[y] && dst->runs[dst->total - 1].end >= start ) {
+                dst->runs[dst->total - 1].end = end;
+            } else {
+                icvRunMaskPush( dst, start, end );
+            }
+        }
+        dst->rowptr[y + 1] = dst->total;
+    }
+}
+
+// Shrink every run by r columns on both sides, except at the image border
+inline void icvRunMaskErodeRows( const CvRunMask* src, CvRunMask* dst, int r )
+{
+    int y, i;
+    icvRunMaskReset( dst, src->width, src->height );
+    for( y = 0; y < src->height; y++ )
+    {
+        for( i = src->rowptr[y]; i < src->rowptr[y + 1]; i++ )
+        {
+            int start = src->runs[i].start == 0 ? 0 : src->runs[i].start + r;
+            int end = src->runs[i].end == src->width ? src->width : src->runs[i].end - r;
+            if( start < end ) icvRunMaskPush( dst, start, end );
+        }
+        dst->rowptr[y + 1] = dst->total;
+    }
+}
+
+// Fill from the first to the last run of each row that is at least 2 long
+inline void icvRunMaskSandwichRows( const CvRunMask* src, CvRunMask* dst )
+{
+    int y, i;
+    icvRunMaskReset( dst, src->width, src->height );
+    for( y = 0; y < src->height; y++ )
+    {
+        int first = -1, last = -1;
+        for( i = src->rowptr[y]; i < src->rowptr[y + 1]; i++ )
+        {
+            if( src->runs[i].end - src->runs[i].start >= 2 ) {
+                if( first < 0 ) first = i;
+                last = i;
+            }
+        }
+        for( i = src->rowptr[y]; i < src->rowptr[y + 1]; i++ )
+        {
+            if( i > first && i <= last ) continue; // merged into the first
+            icvRunMaskPush( dst, src->runs[i].start, i == first ? src->runs[last].end : src->runs[i].end );
+        }
+        dst->rowptr[y + 1] = dst->total;
+    }
+}
+
+/**
+ * Erosion with a 3x3 rectangle, same as cvErode( src, dst, NULL, iterations )
+ *
+ * A (2n+1) x (2n+1) rectangle is separable, so rows are eroded by n,
+ * the mask is transposed, rows are eroded again and transposed back.
+ *
+ * @param src
+ * @param dst                May be src
+ * @param [iterations = 1]
+ */
+void cvRunMaskErode( const CvRunMask* src, CvRunMask* dst, int iterations )
+{
+    CvRunMask* tmp = cvCreateRunMask( src->height, src->width, src->total );
+    CvRunMask* tmp2 = cvCreateRunMask( src->width, src->height, src->total );
+    icvRunMaskErodeRows( src, tmp2, iterations );
+    icvRunMaskTranspose( tmp2, tmp );
+    icvRunMaskErodeRows( tmp, tmp2, iterations );
+    icvRunMaskTranspose( tmp2, tmp );
+    icvRunMaskSwap( tmp, dst );
+    cvReleaseRunMask( &tmp );
+    cvReleaseRunMask( &tmp2 );
+}
+
+/**
+ * Dilation with a 3x3 rectangle, same as cvDilate( src, dst, NULL, iterations )
+ *
+ * @param src
+ * @param dst                May be src
+ * @param [iterations = 1]
+ */
+void cvRunMaskDilate( const CvRunMask* src, CvRunMask* dst, int iterations )
+{
+    CvRunMask* tmp = cvCreateRunMask( src->height, src->width, src->total );
+    CvRunMask* tmp2 = cvCreateRunMask( src->width, src->height, src->total );
+    icvRunMaskDilateRows( src, tmp2, iterations );
+    icvRunMaskTranspose( tmp2, tmp );
+    icvRunMaskDilateRows( tmp, tmp2, iterations );
+    icvRunMaskTranspose( tmp2, tmp );
+    icvRunMaskSwap( tmp, dst );
+    cvReleaseRunMask( &tmp );
+    cvReleaseRunMask( &tmp2 );
+}
+
+/**
+ * Opening on runs. see cvOpening
+ *
+ * @param src
+ * @param dst                May be src
+ * @param [iterations = 1]
+ */
+void cvRunMaskOpening( const CvRunMask* src, CvRunMask* dst, int iterations )
+{
+    cvRunMaskErode( src, dst, iterations );
+    cvRunMaskDilate( dst, dst, iterations );
+}
+
+/**
+ * Closing on runs. see cvClosing
+ *
+ * @param src
+ * @param dst                May be src
+ * @param [iterations = 1]
+ */
+void cvRunMaskClosing( const CvRunMask* src, CvRunMask* dst, int iterations )
+{
+    cvRunMaskDilate( src, dst, iterations );
+    cvRunMaskErode( dst, dst, iterations );
+}
+
+/**
+ * Sandwich fill on runs. see cvSandwichFill
+ *
+ * Each row is filled between the first and the last run that is at least
+ * two pixels long, then each column of the result likewise. The column
+ * pass looks at vertical runs, whereas the column pass of cvSandwichFill
+ * tests the pixel to the right, so the two can differ on columns.
+ *
+ * @param src
+ * @param dst  May be src
+ */
+void cvRunMaskSandwichFill( const CvRunMask* src, CvRunMask* dst )
+{
+    CvRunMask* tmp = cvCreateRunMask( src->height, src->width, src->total );
+    CvRunMask* tmp2 = cvCreateRunMask( src->width, src->height, src->total );
+    icvRunMaskSandwichRows( src, tmp2 );
+    icvRunMaskTranspose( tmp2, tmp );
+    icvRunMaskSandwichRows( tmp, tmp2 );
+    icvRunMaskTranspose( tmp2, tmp );
+    icvRunMaskSwap( tmp, dst );
+    cvReleaseRunMask( &tmp );
+    cvReleaseRunMask( &tmp2 );
+}
+
+
+#endif
@@ -0,0 +1,235 @@
+/** @file
+ * Incremental running mean / variance background model for video
+ *
+ * Each pixel keeps an exponentially weighted mean and variance per
+ * channel. cvUpdateRunningBackground classifies the new frame against
+ * the model and folds it into the model in the same pass, so per-frame
+ * cost is one read of the frame and one read/write of the model.
+ *
+ * Example)
+ * <code>
+ * CvRunningBackground* bg = cvCreateRunningBackground( frame );
+ * while( (frame = cvQueryFrame( video )) != NULL )
+ * {
+ *     cvUpdateRunningBackground( frame, bg );
+ *     // bg->foreground is 1 for moving pixels and 0 for background
+ * }
+ * cvReleaseRunningBackground( &bg );
+ * </code>
+ *
+ * The MIT License
+ *
+ * Copyright (c) OpenALPR contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CV_RUNNINGBACKGROUND_INCLUDED
+#define CV_RUNNINGBACKGROUND_INCLUDED
+
+#include "cv.h"
+#include "cvaux.h"
+#include "cxcore.h"
+
+/******************************* Structures **********************************/
+
+typedef struct CvRunningBackground {
+    // config
+    double alpha;        // learning rate of mean and variance, (0, 1]
+    double sigma;        // a pixel is foreground when its distance exceeds sigma std. deviations
+    double min_var;      // lower bound of per channel variance to suppress sensor noise
+    bool   selective;    // do not learn from pixels classified as foreground
+    // model
+    IplImage* mean;      // 32F, same number of channels as frames
+    IplImage* var;       // 32F, same number of channels as frames
+    IplImage* foreground;// 8U 1 channel. 1 for foreground and 0 for background
+    int frames;          // number of frames folded into the model
+} CvRunningBackground;
+
+/**************************** Function Prototypes ****************************/
+
+CvRunningBackground* cvCreateRunningBackground( const IplImage* first, double alpha = 0.05,
+                                                double sigma = 3.0, double min_var = 64.0,
+                                                bool selective = true );
+void cvReleaseRunningBackground( CvRunningBackground** bg );
+void cvResetRunningBackground( const IplImage* frame, CvRunningBackground* bg );
+void cvUpdateRunningBackground( const IplImage* frame, CvRunningBackground* bg );
+CvRect cvRunningBackgroundRegion( const CvRunningBackground* bg, double min_area = 64 );
+
+/*************************** Function Definitions ****************************/
+
+/**
+ * Allocate a running background model initialized by a frame
+ *
+ * @param first            First frame. 8U, 1 or 3 channels
+ * @param [alpha = 0.05]   Learning rate
+ * @param [sigma = 3.0]    Foreground threshold in standard deviations
+ * @param [min_var = 64.0] Lower bound of variance per channel
+ * @param [selective = true] Freeze the model under foreground pixels
+ * @return CvRunningBackground*
+ */
+CvRunningBackground* cvCreateRunningBackground( const IplImage* first, double alpha,
+                                                double sigma, double min_var, bool selective )
+{
+    CvRunningBackground* bg = NULL;
+    CV_FUNCNAME( "cvCreateRunningBackground" );
+    __BEGIN__;
+    CV_ASSERT( first->depth == IPL_DEPTH_8U );
+    CV_ASSERT( alpha > 0 && alpha <= 1 );
+    bg = (CvRunningBackground*) cvAlloc( sizeof( CvRunningBackground ) );
+    bg->alpha      = alpha;
+    bg->sigma      = sigma;
+    bg->min_var    = min_var;
+    bg->selective  = selective;
+    bg->mean       = cvCreateImage( cvGetSize(first), IPL_DEPTH_32F, first->nChannels );
+    bg->var        = cvCreateImage( cvGetSize(first), IPL_DEPTH_32F, first->nChannels );
+    bg->foreground = cvCreateImage( cvGetSize(first), IPL_DEPTH_8U, 1 );
+    cvResetRunningBackground( first, bg );
+    __END__;
+    return bg;
+}
+
+/**
+ * Release a running background model
+ *
+ * @param bg
+ */
+void cvReleaseRunningBackground( CvRunningBackground** _bg )
+{
+    CvRunningBackground* bg = *_bg;
+    if( !bg ) return;
+    cvReleaseImage( &bg->mean );
+    cvReleaseImage( &bg->var );
+    cvReleaseImage( &bg->foreground );
+    cvFree( _bg );
+}
+
+/**
+ * Restart learning from a frame, e.g., after seeking in a video
+ *
+ * @param frame
+ * @param bg
+ */
+void cvResetRunningBackground( const IplImage* frame, CvRunningBackground* bg )
+{
+    CV_FUNCNAME( "cvResetRunningBackground" );
+    __BEGIN__;
+    CV_ASSERT( frame->width == bg->mean->width && frame->height == bg->mean->height );
+    CV_ASSERT( frame->nChannels == bg->mean->nChannels );
+    cvConvert( frame, bg->mean );
+    cvSet( bg->var, cvScalarAll( bg->min_var ) );
+    cvZero( bg->foreground );
+    bg->frames = 1;
+    __END__;
+}
+
+/**
+ * Classify a frame against the model and update the model in one pass
+ *
+ * With d = frame - mean per channel, a pixel is foreground when
+ * sum(d^2) > sigma^2 * sum(var). Then
+ *     mean += alpha * d
+ *     var   = max( min_var, (1 - alpha) * (var + alpha * d^2) )
+ * which is the exponentially weighted incremental variance.
+ *
+ * @param frame 8U frame of the same size and channels as the model
+ * @param bg
+ */
+void cvUpdateRunningBackground( const IplImage* frame, CvRunningBackground* bg )
+{
+    int x, y, ch;
+    int cn = frame->nChannels;
+    float alpha = (float)bg->alpha;
+    float beta  = (float)( 1.0 - bg->alpha );
+    float sigma2 = (float)( bg->sigma * bg->sigma );
+    float min_var = (float)bg->min_var;
+    CV_FUNCNAME( "cvUpdateRunningBackground" );
+    __BEGIN__;
+    CV_ASSERT( frame->depth == IPL_DEPTH_8U );
+    CV_ASSERT( frame->width == bg->mean->width && frame->height == bg->mean->height );
+    CV_ASSERT( cn == bg->mean->nChannels && cn <= 4 );
+
+    for( y = 0; y < frame->height; y++ )
+    {
+        const uchar* src = (const uchar*)( frame->imageData + frame->widthStep * y );
+        float* mean = (float*)( bg->mean->imageData + bg->mean->widthStep * y );
+        float* var  = (float*)( bg->var->imageData + bg->var->widthStep * y );
+        uchar* fg   = (uchar*)( bg->foreground->imageData + bg->foreground->widthStep * y );
+        for( x = 0; x < frame->width; x++ )
+        {
+            float d[4];
+            float dist = 0, varsum = 0;
+            for( ch = 0; ch < cn; ch++ )
+            {
+                d[ch] = src[ch] - mean[ch];
+                dist += d[ch] * d[ch];
+                varsum += var[ch];
+            }
+            uchar is_fg = dist > sigma2 * varsum;
+            fg[x] = is_fg;
+            if( !( is_fg && bg->selective ) )
+            {
+                for( ch = 0; ch < cn; ch++ )
+                {
+                    mean[ch] += alpha * d[ch];
+                    float v = beta * ( var[ch] + alpha * d[ch] * d[ch] );
+                    var[ch] = v > min_var ? v : min_var;
+                }
+            }
+            src += cn; mean += cn; var += cn;
+        }
+    }
+    bg->frames++;
+    __END__;
+}
+
+/**
+ * Propose a region covering the largest moving blob
+ *
+ * @param bg
+ * @param [min_area = 64] Blobs smaller than this (in pixels) are ignored
+ * @return CvRect Bounding rectangle. width == 0 if nothing is moving
+ */
+CvRect cvRunningBackgroundRegion( const CvRunningBackground* bg, double min_area )
+{
+    CvRect best = cvRect( 0, 0, 0, 0 );
+    double best_area = min_area;
+    IplImage* work = cvCloneImage( bg->foreground );
+    CvMemStorage* storage = cvCreateMemStorage( 0 );
+    CvSeq* contour = NULL;
+
+    // merge fragments of the same object before looking for blobs
+    cvDilate( work, work, NULL, 2 );
+    cvFindContours( work, storage, &contour, sizeof(CvContour),
+                    CV_RETR_EXTERNAL, CV_CHAIN_APPROX_SIMPLE );
+    for( ; contour != NULL; contour = contour->h_next )
+    {
+        double area = fabs( cvContourArea( contour ) );
+        if( area > best_area )
+        {
+            best_area = area;
+            best = cvBoundingRect( contour );
+        }
+    }
+    cvReleaseMemStorage( &storage );
+    cvReleaseImage( &work );
+    return best;
+}
+
+
+#endif
@@ -0,0 +1,166 @@
+/** @file
+ * Sample a rotated rectangle directly into a small fixed size patch
+ *
+ * cvCropImageROI followed by cvResize touches every pixel of the
+ * rectangle. cvSampleRect32f instead reads an integral image of the
+ * frame, computed once per frame with cvIntegral, and averages the area
+ * under every output pixel with four bilinear lookups. The per-rectangle
+ * cost therefore depends only on the output size.
+ *
+ * Example)
+ * <code>
+ * CvMat* sum = cvCreateMat( frame->height + 1, frame->width + 1, CV_64FC(frame->nChannels) );
+ * cvIntegral( frame, sum );
+ * IplImage* patch = cvCreateImage( cvSize(24, 24), frame->depth, frame->nChannels );
+ * cvSampleRect32f( sum, patch, rect32f ); // for each rectangle
+ * </code>
+ *
+ * The MIT License
+ *
+ * Copyright (c) OpenALPR contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CV_SAMPLERECT32F_INCLUDED
+#define CV_SAMPLERECT32F_INCLUDED
+
+#include "cv.h"
+#include "cvaux.h"
+#include "cxcore.h"
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#include "cvrect32f.h"
+
+CVAPI(void) cvSampleRect32f( const CvArr* sum, CvArr* dst, CvRect32f rect32f );
+
+/**
+ * Bilinear lookup into an integral image: offset of the top-left tap and
+ * the weights of the four taps. Coordinates are clamped to the image, so
+ * area outside of it adds nothing (as cvCropImageROI fills it with 0).
+ */
+typedef struct CvIntegralTap {
+    int ofs;
+    double w00, w01, w10, w11;
+} CvIntegralTap;
+
+CV_INLINE CvIntegralTap icvIntegralTap( const CvMat* sum, double x, double y )
+{
+    CvIntegralTap t;
+    int W = sum->cols - 1, H = sum->rows - 1;
+    int cn = CV_MAT_CN( sum->type );
+    x = MIN( MAX( x, 0.0 ), (double)W );
+    y = MIN( MAX( y, 0.0 ), (double)H );
+    int ix = MIN( (int)x, W - 1 ), iy = MIN( (int)y, H - 1 );
+    double fx = x - ix, fy = y - iy;
+    t.ofs = iy * ( sum->step / sizeof(double) ) + ix * cn;
+    t.w00 = ( 1 - fx ) * ( 1 - fy );
+    t.w01 = fx * ( 1 - fy );
+    t.w10 = ( 1 - fx ) * fy;
+    t.w11 = fx * fy;
+    return t;
+}
+
+/**
+ * Area-averaged sampling of a rotated rectangle into dst
+ *
+ * The rectangle is interpreted as in cvCropImageROI: (x, y) is the
+ * top-left corner and the rotation center. Each dst pixel averages the
+ * frame over a (width / dst->width) x (height / dst->height) area around
+ * the rotated position of its center. The area is taken axis aligned,
+ * which is exact for angle == 0 and a close approximation for the small
+ * cells of a feature patch otherwise.
+ *
+ * @param sum      (height + 1) x (width + 1) CV_64FC(n) integral image from cvIntegral
+ * @param dst      Patch of the feature size with n channels. 8U, 32F or 64F
+ * @param rect32f  The rectangle region (x,y,width,height) and the rotation
+ *                 angle in degree where the rotation center is (x,y)
+ */
+CVAPI(void) cvSampleRect32f( const CvArr* _sum, CvArr* _dst, CvRect32f rect32f )
+{
+    CvMat sumhdr, dsthdr;
+    CvMat *sum, *dst;
+    int i, j, k, cn, sstep;
+    double c, s, cw, ch, inv_area;
+    const double* S;
+    CV_FUNCNAME( "cvSampleRect32f" );
+    __BEGIN__;
+    CV_CALL( sum = cvGetMat( _sum, &sumhdr ) );
+    CV_CALL( dst = cvGetMat( _dst, &dsthdr ) );
+    cn = CV_MAT_CN( sum->type );
+    CV_ASSERT( CV_MAT_DEPTH( sum->type ) == CV_64F && sum->rows > 1 && sum->cols > 1 );
+    CV_ASSERT( CV_MAT_CN( dst->type ) == cn );
+    CV_ASSERT( CV_MAT_DEPTH( dst->type ) == CV_8U || CV_MAT_DEPTH( dst->type ) == CV_32F ||
+               CV_MAT_DEPTH( dst->type ) == CV_64F );
+    CV_ASSERT( rect32f.width > 0 && rect32f.height > 0 );
+
+    c = cos( -M_PI / 180 * rect32f.angle );
+    s = sin( -M_PI / 180 * rect32f.angle );
+    cw = rect32f.width / dst->cols;
+    ch = rect32f.height / dst->rows;
+    inv_area = 1.0 / ( cw * ch );
+    S = sum->data.db;
+    sstep = sum->step / sizeof(double);
+
+    for( j = 0; j < dst->rows; j++ )
+    {
+        uchar* row = dst->data.ptr + dst->step * j;
+        double v = ( j + 0.5 ) * ch - 0.5;
+        for( i = 0; i < dst->cols; i++ )
+        {
+            // pixel centers of the crop map to x + u, integral image
+            // coordinates are pixel edges, hence + 0.5
+            double u = ( i + 0.5 ) * cw - 0.5;
+            double X = c * u - s * v + rect32f.x + 0.5;
+            double Y = s * u + c * v + rect32f.y + 0.5;
+            CvIntegralTap t[4];
+            t[0] = icvIntegralTap( sum, X - cw / 2, Y - ch / 2 );
+            t[1] = icvIntegralTap( sum, X + cw / 2, Y - ch / 2 );
+            t[2] = icvIntegralTap( sum, X - cw / 2, Y + ch / 2 );
+            t[3] = icvIntegralTap( sum, X + cw / 2, Y + ch / 2 );
+            for( k = 0; k < cn; k++ )
+            {
+                double I[4];
+                for( int q = 0; q < 4; q++ )
+                {
+                    const double* p = S + t[q].ofs + k;
+                    I[q] = t[q].w00 * p[0] + t[q].w01 * p[cn] +
+                           t[q].w10 * p[sstep] + t[q].w11 * p[sstep + cn];
+                }
+                double val = ( I[3] - I[2] - I[1] + I[0] ) * inv_area;
+                switch( CV_MAT_DEPTH( dst->type ) )
+                {
+                case CV_8U:
+                    row[i * cn + k] = CV_CAST_8U( cvRound( val ) );
+                    break;
+                case CV_32F:
+                    ((float*)row)[i * cn + k] = (float)val;
+                    break;
+                default:
+                    ((double*)row)[i * cn + k] = val;
+                    break;
+                }
+            }
+        }
+    }
+    __END__;
+}
+
+
+#endif
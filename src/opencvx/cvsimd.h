@@ -0,0 +1,108 @@
+/** @file
+ * SIMD helpers shared by the vectorized opencvx kernels
+ *
+ * Every kernel that includes this file must keep a plain C++ path for
+ * builds where CV_SIMD_SSE2 is 0 so that results never depend on the
+ * instruction set. Enable SSSE3 (e.g., -mssse3 or -march=native) to get
+ * single-instruction BGR deinterleaving.
+ *
+ * The MIT License
+ *
+ * Copyright (c) OpenALPR contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CV_SIMD_INCLUDED
+#define CV_SIMD_INCLUDED
+
+#include "cv.h"
+#include "cxcore.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CV_SIMD_SSE2 1
+#include <emmintrin.h>
+#else
+#define CV_SIMD_SSE2 0
+#endif
+
+#if CV_SIMD_SSE2 && defined(__SSSE3__)
+#define CV_SIMD_SSSE3 1
+#include <tmmintrin.h>
+#else
+#define CV_SIMD_SSSE3 0
+#endif
+
+#if CV_SIMD_SSE2
+
+/**
+ * Load 16 interleaved BGR pixels (48 bytes) and split them into planes
+ *
+ * @param src  Pointer to the first blue byte. 48 bytes must be readable.
+ * @param b    16 blue values
+ * @param g    16 green values
+ * @param r    16 red values
+ */
+CV_INLINE void icvLoadDeinterleaveBGR( const uchar* src, __m128i& b, __m128i& g, __m128i& r )
+{
+#if CV_SIMD_SSSE3
+    const __m128i v0 = _mm_loadu_si128( (const __m128i*)src );
+    const __m128i v1 = _mm_loadu_si128( (const __m128i*)(src + 16) );
+    const __m128i v2 = _mm_loadu_si128( (const __m128i*)(src + 32) );
+    b = _mm_or_si128( _mm_or_si128(
+        _mm_shuffle_epi8( v0, _mm_setr_epi8( 0, 3, 6, 9,12,15,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1 ) ),
+        _mm_shuffle_epi8( v1, _mm_setr_epi8(-1,-1,-1,-1,-1,-1, 2, 5, 8,11,14,-1,-1,-1,-1,-1 ) ) ),
+        _mm_shuffle_epi8( v2, _mm_setr_epi8(-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, 1, 4, 7,10,13 ) ) );
+    g = _mm_or_si128( _mm_or_si128(
+        _mm_shuffle_epi8( v0, _mm_setr_epi8( 1, 4, 7,10,13,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1 ) ),
+        _mm_shuffle_epi8( v1, _mm_setr_epi8(-1,-1,-1,-1,-1, 0, 3, 6, 9,12,15,-1,-1,-1,-1,-1 ) ) ),
+        _mm_shuffle_epi8( v2, _mm_setr_epi8(-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, 2, 5, 8,11,14 ) ) );
+    r = _mm_or_si128( _mm_or_si128(
+        _mm_shuffle_epi8( v0, _mm_setr_epi8( 2, 5, 8,11,14,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1 ) ),
+        _mm_shuffle_epi8( v1, _mm_setr_epi8(-1,-1,-1,-1,-1, 1, 4, 7,10,13,-1,-1,-1,-1,-1,-1 ) ) ),
+        _mm_shuffle_epi8( v2, _mm_setr_epi8(-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, 0, 3, 6, 9,12,15 ) ) );
+#else
+    // SSE2 has no byte shuffle. Gathering through the stack is still
+    // much cheaper than the per-pixel branches it replaces.
+    CV_DECL_ALIGNED(16) uchar bb[16];
+    CV_DECL_ALIGNED(16) uchar gg[16];
+    CV_DECL_ALIGNED(16) uchar rr[16];
+    for( int i = 0; i < 16; i++ )
+    {
+        bb[i] = src[i * 3];
+        gg[i] = src[i * 3 + 1];
+        rr[i] = src[i * 3 + 2];
+    }
+    b = _mm_load_si128( (const __m128i*)bb );
+    g = _mm_load_si128( (const __m128i*)gg );
+    r = _mm_load_si128( (const __m128i*)rr );
+#endif
+}
+
+/**
+ * Unsigned 8-bit "a > b" as a 0x00 / 0xFF lane mask
+ */
+CV_INLINE __m128i icvCmpGtEpu8( __m128i a, __m128i b )
+{
+    return _mm_xor_si128( _mm_cmpeq_epi8( _mm_subs_epu8( a, b ), _mm_setzero_si128() ),
+                          _mm_set1_epi8( -1 ) );
+}
+
+#endif // CV_SIMD_SSE2
+
+#endif
@@ -19,15 +19,43 @@
 #include "cvaux.h"
 #define _USE_MATH_DEFINES
 #include <math.h>
+#include <string.h>
+#include "cvsimd.h"
+
+// Fixed point BGR to YCrCb coefficients. Same as cvCvtColor( CV_BGR2YCrCb ) for 8U
+#define CV_YCRCB_SHIFT 14
+#define CV_YCRCB_ROUND ( 1 << ( CV_YCRCB_SHIFT - 1 ) )
+#define CV_YCRCB_RY 4899  /* 0.299 */
+#define CV_YCRCB_GY 9617  /* 0.587 */
+#define CV_YCRCB_BY 1868  /* 0.114 */
+#define CV_YCRCB_CR 11682 /* 0.713 */
+#define CV_YCRCB_CB 9241  /* 0.564 */
 
 void cvSkinColorCrCb( const IplImage* _img, IplImage* mask, CvArr* distarr = NULL );
 
+/**
+// icvBGR2CrCb - Cr and Cb of one BGR pixel, bit-exact with cvCvtColor
+*/
+CV_INLINE void icvBGR2CrCb( const uchar* bgr, int& Cr, int& Cb )
+{
+    int Y = ( bgr[2] * CV_YCRCB_RY + bgr[1] * CV_YCRCB_GY + bgr[0] * CV_YCRCB_BY + 
+              CV_YCRCB_ROUND ) >> CV_YCRCB_SHIFT;
+    Cr = ( ( bgr[2] - Y ) * CV_YCRCB_CR + ( 128 << CV_YCRCB_SHIFT ) + CV_YCRCB_ROUND ) >> CV_YCRCB_SHIFT;
+    Cb = ( ( bgr[0] - Y ) * CV_YCRCB_CB + ( 128 << CV_YCRCB_SHIFT ) + CV_YCRCB_ROUND ) >> CV_YCRCB_SHIFT;
+    Cr = Cr < 0 ? 0 : ( Cr > 255 ? 255 : Cr );
+    Cb = Cb < 0 ? 0 : ( Cb > 255 ? 255 : Cb );
+}
+
 /**
 // cvSkinColorCbCr - Skin Color Detection in (Cb, Cr) space by [1][2]
 //
 // @param img  Input image
 // @param mask Generated mask image. 1 for skin and 0 for others
 // @param [dist = NULL] The distortion valued array rather than mask if you want
+//
+// The color conversion is fused into the per-pixel test, so no YCrCb
+// image is allocated. Results are identical to cvCvtColor followed by
+// the ellipse test.
 // 
 // References)
 //  [1] R.L. Hsu, M. Abdel-Mottaleb, A.K. Jain, "Face Detection in Color Images," 
@@ -43,32 +71,29 @@ void cvSkinColorCrCb( const IplImage* _img, IplImage* mask, CvArr* distarr )
     __BEGIN__;
     int width  = _img->width;
     int height = _img->height;
+    int cn     = _img->nChannels;
     CvMat* dist = (CvMat*)distarr, diststub;
     int coi = 0;
-    IplImage* img;
-
-    double Wcb = 46.97;
-    double WLcb = 23;
-    double WHcb = 14;
-    double Wcr = 38.76;
-    double WLcr = 20;
-    double WHcr = 10;
-    double Kl = 125;
-    double Kh = 188;
-    double Ymin = 16;
-    double Ymax = 235;
-    double alpha = 0.56;
-
-    double Cx = 109.38;
-    double Cy = 152.02;
-    double theta = 2.53; 
-    double ecx = 1.6;
-    double ecy = 2.41;
-    double a = 25.39;
-    double b = 14.03;
+    double* distrow = NULL;
+
+    // Hsu's luma dependent terms (Wcb, Wcr, Kl, Kh, ...) are not used by the
+    // tuned model, only the fixed (Cb, Cr) ellipse is.
+    const double Cx = 109.38;
+    const double Cy = 152.02;
+    const double theta = 2.53; 
+    const double ecx = 1.6;
+    const double ecy = 2.41;
+    const double a = 25.39;
+    const double b = 14.03;
+    const double cos_t = cos(theta);
+    const double sin_t = sin(theta);
+    const double nsin_t = -1 * sin(theta);
+    const double a2 = a * a;
+    const double b2 = b * b;
 
     CV_ASSERT( width == mask->width && height == mask->height );
-    CV_ASSERT( _img->nChannels >= 3 && mask->nChannels == 1 );
+    CV_ASSERT( cn >= 3 && mask->nChannels == 1 );
+    CV_ASSERT( _img->depth == IPL_DEPTH_8U && mask->depth == IPL_DEPTH_8U );
 
     if( dist && !CV_IS_MAT(dist) )
     {
@@ -77,61 +102,114 @@ void cvSkinColorCrCb( const IplImage* _img, IplImage* mask, CvArr* distarr )
         CV_ASSERT( width == dist->cols && height == dist->rows );
         CV_ASSERT( CV_MAT_TYPE(dist->type) == CV_32FC1 || CV_MAT_TYPE(dist->type) == CV_64FC1 );
     }
+    if( dist )
+        distrow = (double*)cvAlloc( width * sizeof(double) );
 
-    img = cvCreateImage( cvGetSize(_img), IPL_DEPTH_8U, 3 );
-    cvCvtColor( _img, img, CV_BGR2YCrCb );        
-
-    cvSet( mask, cvScalarAll(0) );
     for( int row = 0; row < height; row++ )
     {
-        for( int col = 0; col < width; col++ )
+        const uchar* src = (const uchar*)( _img->imageData + _img->widthStep * row );
+        uchar* dst = (uchar*)( mask->imageData + mask->widthStep * row );
+        int col = 0;
+#if CV_SIMD_SSE2
+        if( cn == 3 )
         {
-            uchar Y  = img->imageData[img->widthStep * row + col * 3];
-            uchar Cr = img->imageData[img->widthStep * row + col * 3 + 1];
-            uchar Cb = img->imageData[img->widthStep * row + col * 3 + 2];
-
-            double Cb_Y, Cr_Y, Wcb_Y, Wcr_Y;
-            if( Y < Kl )
-                Wcb_Y = WLcb + (Y - Ymin) * (Wcb - WLcb) / (Kl - Ymin);
-            else if( Kh < Y )
-                Wcb_Y = WHcb + (Ymax - Y) * (Wcb - WHcb) / (Ymax - Kh);
-            else
-                Wcb_Y = Wcb;
-
-            if( Y < Kl )
-                Wcr_Y = WLcr + (Y - Ymin) * (Wcr - WLcr) / (Kl - Ymin);
-            else if( Kh < Y )
-                Wcr_Y = WHcr + (Ymax - Y) * (Wcr - WHcr) / (Ymax - Kh);
-            else
-                Wcr_Y = Wcr;
-
-            if( Y < Kl )
-                Cb_Y = 108 + (Kl - Y) * 10 / ( Kl - Ymin );
-            else if( Kh < Y )
-                Cb_Y = 108 + (Y - Kh) * 10 / ( Ymax - Kh );
-            else
-                Cb_Y = 108;
+            const __m128i zero   = _mm_setzero_si128();
+            const __m128i one16  = _mm_set1_epi16( 1 );
+            const __m128i max16  = _mm_set1_epi16( 255 );
+            const __m128i crgy   = _mm_set1_epi32( ( CV_YCRCB_GY << 16 ) | CV_YCRCB_RY );
+            const __m128i cby    = _mm_set1_epi32( ( CV_YCRCB_ROUND << 16 ) | CV_YCRCB_BY );
+            const __m128i ccr    = _mm_set1_epi32( CV_YCRCB_CR );
+            const __m128i ccb    = _mm_set1_epi32( CV_YCRCB_CB );
+            const __m128i cdelta = _mm_set1_epi32( ( 128 << CV_YCRCB_SHIFT ) + CV_YCRCB_ROUND );
+            const __m128d vCx = _mm_set1_pd( Cx ),     vCy = _mm_set1_pd( Cy );
+            const __m128d vcos = _mm_set1_pd( cos_t ), vsin = _mm_set1_pd( sin_t );
+            const __m128d vnsin = _mm_set1_pd( nsin_t );
+            const __m128d vecx = _mm_set1_pd( ecx ),   vecy = _mm_set1_pd( ecy );
+            const __m128d va2 = _mm_set1_pd( a2 ),     vb2 = _mm_set1_pd( b2 );
+            const __m128d vone = _mm_set1_pd( 1.0 );
+            for( ; col <= width - 16; col += 16 )
+            {
+                __m128i vb, vg, vr;
+                CV_DECL_ALIGNED(16) int cr32[16];
+                CV_DECL_ALIGNED(16) int cb32[16];
+                icvLoadDeinterleaveBGR( src + col * 3, vb, vg, vr );
+                for( int half = 0; half < 2; half++ )
+                {
+                    __m128i r16 = half ? _mm_unpackhi_epi8( vr, zero ) : _mm_unpacklo_epi8( vr, zero );
+                    __m128i g16 = half ? _mm_unpackhi_epi8( vg, zero ) : _mm_unpacklo_epi8( vg, zero );
+                    __m128i b16 = half ? _mm_unpackhi_epi8( vb, zero ) : _mm_unpacklo_epi8( vb, zero );
+                    __m128i crv[2], cbv[2];
+                    for( int q = 0; q < 2; q++ )
+                    {
+                        __m128i rg = q ? _mm_unpackhi_epi16( r16, g16 ) : _mm_unpacklo_epi16( r16, g16 );
+                        __m128i b1 = q ? _mm_unpackhi_epi16( b16, one16 ) : _mm_unpacklo_epi16( b16, one16 );
+                        __m128i r32 = q ? _mm_unpackhi_epi16( r16, zero ) : _mm_unpacklo_epi16( r16, zero );
+                        __m128i b32 = q ? _mm_unpackhi_epi16( b16, zero ) : _mm_unpacklo_epi16( b16, zero );
+                        __m128i y32 = _mm_srai_epi32( _mm_add_epi32( _mm_madd_epi16( rg, crgy ), 
+                                                                     _mm_madd_epi16( b1, cby ) ), CV_YCRCB_SHIFT );
+                        // (R - Y) and (B - Y) fit in the low 16 bits, the high halves
+                        // are multiplied by the zero high half of the coefficient
+                        crv[q] = _mm_srai_epi32( _mm_add_epi32( _mm_madd_epi16( _mm_sub_epi32( r32, y32 ), ccr ), 
+                                                                cdelta ), CV_YCRCB_SHIFT );
+                        cbv[q] = _mm_srai_epi32( _mm_add_epi32( _mm_madd_epi16( _mm_sub_epi32( b32, y32 ), ccb ), 
+                                                                cdelta ), CV_YCRCB_SHIFT );
+                    }
+                    // saturate to uchar as cvCvtColor does
+                    __m128i cr16 = _mm_min_epi16( _mm_max_epi16( _mm_packs_epi32( crv[0], crv[1] ), zero ), max16 );
+                    __m128i cb16 = _mm_min_epi16( _mm_max_epi16( _mm_packs_epi32( cbv[0], cbv[1] ), zero ), max16 );
+                    _mm_store_si128( (__m128i*)( cr32 + half * 8 ), _mm_unpacklo_epi16( cr16, zero ) );
+                    _mm_store_si128( (__m128i*)( cr32 + half * 8 + 4 ), _mm_unpackhi_epi16( cr16, zero ) );
+                    _mm_store_si128( (__m128i*)( cb32 + half * 8 ), _mm_unpacklo_epi16( cb16, zero ) );
+                    _mm_store_si128( (__m128i*)( cb32 + half * 8 + 4 ), _mm_unpackhi_epi16( cb16, zero ) );
+                }
+                // The ellipse test is evaluated in double with the same operation
+                // order as the scalar loop below (the row tail of cvSkinColorCrCb)
+                // so that borderline pixels agree.
+                for( int i = 0; i < 16; i += 2 )
+                {
+                    __m128d dcb = _mm_sub_pd( _mm_cvtepi32_pd( _mm_loadl_epi64( (const __m128i*)( cb32 + i ) ) ), vCx );
+                    __m128d dcr = _mm_sub_pd( _mm_cvtepi32_pd( _mm_loadl_epi64( (const __m128i*)( cr32 + i ) ) ), vCy );
+                    __m128d x = _mm_add_pd( _mm_mul_pd( vcos, dcb ), _mm_mul_pd( vsin, dcr ) );
+                    __m128d y = _mm_add_pd( _mm_mul_pd( vnsin, dcb ), _mm_mul_pd( vcos, dcr ) );
+                    x = _mm_sub_pd( x, vecx );
+                    y = _mm_sub_pd( y, vecy );
+                    __m128d distort = _mm_add_pd( _mm_div_pd( _mm_mul_pd( x, x ), va2 ), 
+                                                  _mm_div_pd( _mm_mul_pd( y, y ), vb2 ) );
+                    int inside = _mm_movemask_pd( _mm_cmple_pd( distort, vone ) );
+                    dst[col + i]     = (uchar)( inside & 1 );
+                    dst[col + i + 1] = (uchar)( ( inside >> 1 ) & 1 );
+                    if( distrow )
+                        _mm_storeu_pd( distrow + col + i, distort );
+                }
+            }
+        }
+#endif
+        for( ; col < width; col++ )
+        {
+            int Cr, Cb;
+            icvBGR2CrCb( src + col * cn, Cr, Cb );
+            double x = cos_t * (Cb - Cx) + sin_t * (Cr - Cy);
+            double y = nsin_t * (Cb - Cx) + cos_t * (Cr - Cy);
+            double distort = (x-ecx) * (x-ecx) / a2 + (y-ecy) * (y-ecy) / b2;
+            dst[col] = distort <= 1 ? 1 : 0;
+            if( distrow )
+                distrow[col] = distort;
+        }
 
-            if( Y < Kl )
-                Cr_Y = 154 - (Kl - Y) * 10 / ( Kl - Ymin );
-            else if( Kh < Y )
-                Cr_Y = 154 + (Y - Kh) * 22 / ( Ymax - Kh );
+        if( dist )
+        {
+            if( CV_MAT_DEPTH(dist->type) == CV_64F )
+                memcpy( dist->data.ptr + dist->step * row, distrow, width * sizeof(double) );
             else
-                Cr_Y = 108;
-
-            double x = cos(theta) * (Cb - Cx) + sin(theta) * (Cr - Cy);
-            double y = -1 * sin(theta) * (Cb - Cx) + cos(theta) * (Cr - Cy);
-
-            double distort = pow(x-ecx,2) / pow(a,2) + pow(y-ecy,2) / pow(b,2);
-            if( dist )
-                cvmSet( dist, row, col, distort );
-
-            if( distort <= 1 )
             {
-                mask->imageData[mask->widthStep * row + col] = 1;
+                float* drow = (float*)( dist->data.ptr + dist->step * row );
+                for( col = 0; col < width; col++ )
+                    drow[col] = (float)distrow[col];
             }
         }
     }
+    if( distrow )
+        cvFree( &distrow );
     __END__;
 }
 
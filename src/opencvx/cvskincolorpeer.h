@@ -17,6 +17,8 @@
 
 #include "cv.h"
 #include "cvaux.h"
+#include <algorithm>
+#include "cvsimd.h"
 using namespace std;
 
 void cvSkinColorPeer( const IplImage* img, IplImage* mask );
@@ -39,23 +41,51 @@ void cvSkinColorPeer( const IplImage* img, IplImage* mask )
 {
     int x, y;
     uchar r, g, b;
-    cvSet( mask, cvScalarAll(0) );
+    CV_FUNCNAME( "cvSkinColorPeer" );
+    __BEGIN__;
+    CV_ASSERT( img->width == mask->width && img->height == mask->height );
+    CV_ASSERT( img->depth == IPL_DEPTH_8U && img->nChannels == 3 );
+    CV_ASSERT( mask->depth == IPL_DEPTH_8U && mask->nChannels == 1 );
+
     for( y = 0; y < img->height; y++ )
     {
-        for( x = 0; x < img->width; x++ )
+        const uchar* src = (const uchar*)( img->imageData + img->widthStep * y );
+        uchar* dst = (uchar*)( mask->imageData + mask->widthStep * y );
+        x = 0;
+#if CV_SIMD_SSE2
+        // With R>G and R>B, max{R,G,B} is R, and R-G>15 already implies
+        // both R>G and max-min>15. What remains is five saturating
+        // subtractions which are non-zero exactly when the rule holds.
+        const __m128i t95 = _mm_set1_epi8( 95 );
+        const __m128i t40 = _mm_set1_epi8( 40 );
+        const __m128i t20 = _mm_set1_epi8( 20 );
+        const __m128i t15 = _mm_set1_epi8( 15 );
+        const __m128i one = _mm_set1_epi8( 1 );
+        const __m128i zero = _mm_setzero_si128();
+        for( ; x <= img->width - 16; x += 16 )
         {
-            b = img->imageData[img->widthStep * y + x * 3];
-            g = img->imageData[img->widthStep * y + x * 3 + 1];
-            r = img->imageData[img->widthStep * y + x * 3 + 2];
-
-            if( r > 95 && g > 40 && b > 20 && 
-                max( r, max( g, b ) ) - min( r, min( g, b ) ) > 15 &&
-                abs( r - g ) > 15 && r > g && r > b )
-            {
-                mask->imageData[mask->widthStep * y + x] = 1;
-            }
+            __m128i vb, vg, vr, m;
+            icvLoadDeinterleaveBGR( src + x * 3, vb, vg, vr );
+            m = _mm_min_epu8( _mm_subs_epu8( vr, t95 ), _mm_subs_epu8( vg, t40 ) );
+            m = _mm_min_epu8( m, _mm_subs_epu8( vb, t20 ) );
+            m = _mm_min_epu8( m, _mm_subs_epu8( vr, vb ) );
+            m = _mm_min_epu8( m, _mm_subs_epu8( _mm_subs_epu8( vr, vg ), t15 ) );
+            _mm_storeu_si128( (__m128i*)( dst + x ), 
+                              _mm_andnot_si128( _mm_cmpeq_epi8( m, zero ), one ) );
+        }
+#endif
+        for( ; x < img->width; x++ )
+        {
+            b = src[x * 3];
+            g = src[x * 3 + 1];
+            r = src[x * 3 + 2];
+
+            dst[x] = ( r > 95 && g > 40 && b > 20 && 
+                       max( r, max( g, b ) ) - min( r, min( g, b ) ) > 15 &&
+                       abs( r - g ) > 15 && r > g && r > b ) ? 1 : 0;
         }
     }
+    __END__;
 }
 
 
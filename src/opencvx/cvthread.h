@@ -0,0 +1,163 @@
+/** @file
+ * Minimal worker thread
+ *
+ * Small wrapper over pthreads (POSIX) and CreateThread (Windows) to run
+ * one function in the background and join it later, and a mutex.
+ *
+ * Example)
+ * <code>
+ * icvThread thread;
+ * if( icvStartThread( &thread, work, arg ) )
+ * {
+ *     // ... do something else ...
+ *     icvJoinThread( &thread );
+ * }
+ * </code>
+ *
+ * The MIT License
+ *
+ * Copyright (c) OpenALPR contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CV_THREAD_INCLUDED
+#define CV_THREAD_INCLUDED
+
+#include <stddef.h>
+
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64)
+#include <windows.h>
+typedef HANDLE icvThread;
+typedef CRITICAL_SECTION icvMutex;
+#else
+#include <pthread.h>
+typedef pthread_t icvThread;
+typedef pthread_mutex_t icvMutex;
+#endif
+
+typedef void (*icvThreadFunc)( void* arg );
+
+typedef struct icvThreadStart {
+    icvThreadFunc func;
+    void* arg;
+} icvThreadStart;
+
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64)
+inline DWORD WINAPI icvThreadMain( LPVOID _start )
+#else
+inline void* icvThreadMain( void* _start )
+#endif
+{
+    icvThreadStart start = *(icvThreadStart*)_start;
+    delete (icvThreadStart*)_start;
+    start.func( start.arg );
+    return 0;
+}
+
+/**
+ * Run func( arg ) in a new thread
+ *
+ * @param thread  [out]
+ * @param func
+ * @param arg
+ * @return bool   false if the thread could not be created
+ */
+inline bool icvStartThread( icvThread* thread, icvThreadFunc func, void* arg )
+{
+    icvThreadStart* start = new icvThreadStart;
+    start->func = func;
+    start->arg = arg;
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64)
+    *thread = CreateThread( NULL, 0, icvThreadMain, start, 0, NULL );
+    if( *thread != NULL ) return true;
+#else
+    if( pthread_create( thread, NULL, icvThreadMain, start ) == 0 ) return true;
+#endif
+    delete start;
+    return false;
+}
+
+/**
+ * Wait until a thread started by icvStartThread returns
+ *
+ * @param thread
+ */
+inline void icvJoinThread( icvThread* thread )
+{
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64)
+    WaitForSingleObject( *thread, INFINITE );
+    CloseHandle( *thread );
+#else
+    pthread_join( *thread, NULL );
+#endif
+}
+
+/**
+ * Let a thread started by icvStartThread release itself when it returns.
+ * It can not be joined afterwards
+ *
+ * @param thread
+ */
+inline void icvDetachThread( icvThread* thread )
+{
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64)
+    CloseHandle( *thread );
+#else
+    pthread_detach( *thread );
+#endif
+}
+
+inline void icvInitMutex( icvMutex* mutex )
+{
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64)
+    InitializeCriticalSection( mutex );
+#else
+    pthread_mutex_init( mutex, NULL );
+#endif
+}
+
+inline void icvDestroyMutex( icvMutex* mutex )
+{
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64)
+    DeleteCriticalSection( mutex );
+#else
+    pthread_mutex_destroy( mutex );
+#endif
+}
+
+inline void icvLockMutex( icvMutex* mutex )
+{
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64)
+    EnterCriticalSection( mutex );
+#else
+    pthread_mutex_lock( mutex );
+#endif
+}
+
+inline void icvUnlockMutex( icvMutex* mutex )
+{
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64)
+    LeaveCriticalSection( mutex );
+#else
+    pthread_mutex_unlock( mutex );
+#endif
+}
+
+
+#endif
@@ -21,6 +21,7 @@
 #include "cvopening.h"
 #include "cvclosing.h"
 #include "cvsandwichfill.h"
+#include "cvrunmask.h"
 
 
 #endif
@@ -0,0 +1,554 @@
+/** @file
+ * Serve crops of cached source images over a Unix domain socket
+ *
+ * Tools that crop many rectangles from the same large images pay for the
+ * decode of every source again and again. cropdaemon keeps the decoded
+ * sources in a least recently used cache bounded by --cache-mb and answers
+ * crop requests from any number of clients, one thread per connection.
+ * SIGINT or SIGTERM closes the open connections, waits for their threads
+ * and exits.
+ *
+ * A request is one JSON line (see icjson.h):
+ *
+ *   {"path":"/data/a.jpg","x":10.5,"y":20,"width":120,"height":40,
+ *    "angle":5,"shear_x":0,"shear_y":0,"out_width":240,"out_height":80,
+ *    "format":"png","quality":3,"frame":0}
+ *
+ * x, y, width, height and angle form the CvRect32f and shear_x, shear_y the
+ * shear passed to cvCropImageROI unchanged, so a crop is pixel for pixel
+ * what imageclipper saves. Only path, x, y, width and height are required.
+ * out_width and out_height resize the crop afterwards. frame (1-based) takes
+ * a frame of a video instead of an image. The answer is one JSON line,
+ * followed by the encoded image when "bytes" is given:
+ *
+ *   {"ok":true,"bytes":5123,"width":240,"height":80,"cached":true}
+ *   {"ok":false,"error":"cannot decode /data/a.jpg"}
+ *
+ * {"cmd":"stats"} returns the cache counters. A source is decoded again
+ * when its modification time changes.
+ *
+ * --metrics file exports the decode, cache, crop and encode counters and
+ * latencies (see icmetrics.h) and prints a summary when the daemon is
+ * stopped by SIGINT or SIGTERM.
+ *
+ * Usage: cropdaemon [--cache-mb 512] [--metrics file] [--metrics-interval 10]
+ *                   socket_path
+ *
+ * The MIT License
+ *
+ * Copyright (c) OpenALPR contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "cv.h"
+#include "cxcore.h"
+#include "highgui.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <string>
+#include <sstream>
+#include <list>
+#include <map>
+using namespace std;
+#include "icjson.h"
+#include "icmetrics.h"
+#include "opencvx/cvrect32f.h"
+#include "opencvx/cvcropimageroi.h"
+#include "opencvx/cvthread.h"
+
+typedef struct CropSource {
+    string key;          // real path, and #frame for a video frame
+    IplImage* img;
+    time_t mtime;
+    size_t bytes;
+    int refs;            // requests using img right now
+    bool dropped;        // out of the cache, freed with the last reference
+} CropSource;
+
+typedef struct CropCache {
+    list<CropSource*> lru;   // most recently used first
+    map<string, list<CropSource*>::iterator> index;
+    size_t bytes;
+    size_t capacity;
+    long hits;
+    long misses;
+    icvMutex mutex;
+} CropCache;
+
+typedef struct CropConnection {
+    int fd;              // closed by main after the join
+    CropCache* cache;
+    icvThread thread;
+    bool threaded;
+    volatile bool done;  // set under the cache mutex
+} CropConnection;
+
+static const char* socket_path = NULL;
+static volatile sig_atomic_t stop_requested = 0;
+static int stop_pipe[2] = { -1, -1 };
+
+// takes the cache mutex held
+void icvCacheDrop( CropCache* cache, CropSource* src )
+{
+    map<string, list<CropSource*>::iterator>::iterator it = cache->index.find( src->key );
+    cache->lru.erase( it->second );
+    cache->index.erase( it );
+    cache->bytes -= src->bytes;
+    if( src->refs > 0 )
+    {
+        src->dropped = true;
+        return;
+    }
+    cvReleaseImage( &src->img );
+    delete src;
+}
+
+// takes the cache mutex held
+void icvCacheEvict( CropCache* cache )
+{
+    while( cache->bytes > cache->capacity && !cache->lru.empty() )
+        icvCacheDrop( cache, cache->lru.back() );
+}
+
+IplImage* icvDecodeSource( const string& path, int frame )
+{
+    if( frame <= 0 ) return cvLoadImage( path.c_str() );
+    CvCapture* cap = cvCaptureFromFile( path.c_str() );
+    if( !cap ) return NULL;
+    if( frame > 1 ) cvSetCaptureProperty( cap, CV_CAP_PROP_POS_FRAMES, frame - 1 );
+    IplImage* img = cvQueryFrame( cap );
+    if( img ) img = cvCloneImage( img ); // the capture owns its frame
+    cvReleaseCapture( &cap );
+    return img;
+}
+
+/**
+ * Get a decoded source from the cache, decoding it on a miss. The decode
+ * runs without the mutex held so other requests go on meanwhile
+ *
+ * @param cache
+ * @param path
+ * @param frame   0 for an image, 1-based frame number for a video
+ * @param cached  [out] true on a hit
+ * @param error   [out]
+ * @return CropSource*  NULL on error. Give it back with icvCacheRelease
+ */
+CropSource* icvCacheAcquire( CropCache* cache, const string& path, int frame, bool* cached, string& error )
+{
+    char real[PATH_MAX];
+    struct stat st;
+    if( !realpath( path.c_str(), real ) || stat( real, &st ) != 0 )
+    {
+        error = path + " does not exist";
+        return NULL;
+    }
+    stringstream key;
+    key << real;
+    if( frame > 0 ) key << "#" << frame;
+
+    icvLockMutex( &cache->mutex );
+    map<string, list<CropSource*>::iterator>::iterator it = cache->index.find( key.str() );
+    if( it != cache->index.end() && (*it->second)->mtime == st.st_mtime )
+    {
+        CropSource* src = *it->second;
+        cache->lru.splice( cache->lru.begin(), cache->lru, it->second );
+        src->refs++;
+        cache->hits++;
+        icMetricsCount( IC_CACHE_HITS );
+        icvUnlockMutex( &cache->mutex );
+        *cached = true;
+        return src;
+    }
+    cache->misses++;
+    icvUnlockMutex( &cache->mutex );
+    icMetricsCount( IC_CACHE_MISSES );
+
+    int64 start = icMetricsStart();
+    IplImage* img = icvDecodeSource( real, frame );
+    if( !img )
+    {
+        error = "cannot decode " + path;
+        return NULL;
+    }
+    icMetricsObserve( IC_STAGE_DECODE, start );
+    icMetricsCount( IC_IMAGES_DECODED );
+    CropSource* src = new CropSource;
+    src->key = key.str();
+    src->img = img;
+    src->mtime = st.st_mtime;
+    src->bytes = img->imageSize;
+    src->refs = 1;
+    src->dropped = false;
+
+    icvLockMutex( &cache->mutex );
+    it = cache->index.find( src->key );
+    if( it != cache->index.end() ) // stale, or decoded by another request meanwhile
+        icvCacheDrop( cache, *it->second );
+    cache->lru.push_front( src );
+    cache->index[src->key] = cache->lru.begin();
+    cache->bytes += src->bytes;
+    icvCacheEvict( cache );
+    icMetricsGauge( IC_CACHE_BYTES, cache->bytes );
+    icvUnlockMutex( &cache->mutex );
+    *cached = false;
+    return src;
+}
+
+void icvCacheRelease( CropCache* cache, CropSource* src )
+{
+    icvLockMutex( &cache->mutex );
+    if( --src->refs == 0 && src->dropped )
+    {
+        cvReleaseImage( &src->img );
+        delete src;
+    }
+    icvUnlockMutex( &cache->mutex );
+}
+
+bool icvWriteAll( int fd, const void* data, size_t size )
+{
+    const char* p = (const char*)data;
+    while( size > 0 )
+    {
+        ssize_t n = write( fd, p, size );
+        if( n < 0 && errno == EINTR ) continue;
+        if( n <= 0 ) return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+/**
+ * Crop as requested and encode the crop
+ *
+ * @return CvMat*  the encoded bytes, NULL on error
+ */
+CvMat* icvServeCrop( CropCache* cache, const IcJsonObject& req, CvSize* size, bool* cached, string& error )
+{
+    static const char* formats[] = { "bmp", "dib", "jpeg", "jpg", "jpe", "png", "pbm", "pgm",
+                                     "ppm", "sr", "ras", "tiff", "tif", "exr", "jp2", NULL };
+    string path, format = "png";
+    double x, y, width, height, angle = 0, shear_x = 0, shear_y = 0;
+    int frame = 0, quality = -1;
+    CvSize out_size = cvSize( 0, 0 );
+    if( !icJsonString( req, "path", &path ) ||
+        !icJsonReal( req, "x", &x ) || !icJsonReal( req, "y", &y ) ||
+        !icJsonReal( req, "width", &width ) || !icJsonReal( req, "height", &height ) )
+    {
+        error = "path, x, y, width and height are required";
+        return NULL;
+    }
+    icJsonReal( req, "angle", &angle );
+    icJsonReal( req, "shear_x", &shear_x );
+    icJsonReal( req, "shear_y", &shear_y );
+    icJsonInt( req, "frame", &frame );
+    icJsonInt( req, "quality", &quality );
+    icJsonInt( req, "out_width", &out_size.width );
+    icJsonInt( req, "out_height", &out_size.height );
+    icJsonString( req, "format", &format );
+
+    int f;
+    for( f = 0; formats[f] && format != formats[f]; f++ );
+    if( !formats[f] )
+    {
+        error = "the image type " + format + " is not supported";
+        return NULL;
+    }
+    // cvCropImageROI asserts a non-empty rectangle
+    CvRect32f rect32f = cvRect32f( x, y, width, height, angle );
+    CvRect rect = cvRectFromRect32f( rect32f );
+    if( rect.width <= 0 || rect.height <= 0 || out_size.width < 0 || out_size.height < 0 )
+    {
+        error = "empty rectangle";
+        return NULL;
+    }
+
+    CropSource* src = icvCacheAcquire( cache, path, frame, cached, error );
+    if( !src ) return NULL;
+    int64 start = icMetricsStart();
+    IplImage* crop = cvCreateImage( cvSize( rect.width, rect.height ), src->img->depth, src->img->nChannels );
+    cvCropImageROI( src->img, crop, rect32f, cvPoint2D32f( shear_x, shear_y ) );
+    icvCacheRelease( cache, src );
+
+    if( out_size.width == 0 ) out_size.width = rect.width;
+    if( out_size.height == 0 ) out_size.height = rect.height;
+    if( out_size.width != rect.width || out_size.height != rect.height )
+    {
+        IplImage* resized = cvCreateImage( out_size, crop->depth, crop->nChannels );
+        bool shrink = out_size.width < rect.width && out_size.height < rect.height;
+        cvResize( crop, resized, shrink ? CV_INTER_AREA : CV_INTER_LINEAR );
+        cvReleaseImage( &crop );
+        crop = resized;
+    }
+    icMetricsObserve( IC_STAGE_CROP, start );
+
+    int params[] = { 0, 0, 0 };
+    if( quality >= 0 && ( format == "jpg" || format == "jpeg" || format == "jpe" ) )
+        params[0] = CV_IMWRITE_JPEG_QUALITY, params[1] = quality;
+    else if( quality >= 0 && format == "png" )
+        params[0] = CV_IMWRITE_PNG_COMPRESSION, params[1] = quality;
+    start = icMetricsStart();
+    CvMat* encoded = cvEncodeImage( ( "." + format ).c_str(), crop, params[0] ? params : NULL );
+    icMetricsObserve( IC_STAGE_ENCODE, start );
+    *size = cvGetSize( crop );
+    cvReleaseImage( &crop );
+    if( !encoded ) error = "cannot encode " + format;
+    return encoded;
+}
+
+// one request line. false if the client is gone
+bool icvServeRequest( CropConnection* conn, const string& line )
+{
+    IcJsonObject req;
+    CvMat* encoded = NULL;
+    stringstream header;
+    string cmd, error;
+    CvSize size;
+    bool cached = false;
+    int64 start = icMetricsStart();
+
+    if( !icJsonParse( line, req ) )
+        error = "malformed request";
+    else if( icJsonString( req, "cmd", &cmd ) )
+    {
+        if( cmd != "stats" )
+            error = "unknown cmd " + cmd;
+        else
+        {
+            CropCache* cache = conn->cache;
+            icvLockMutex( &cache->mutex );
+            header << "{\"ok\":true,\"sources\":" << cache->lru.size() << ",\"bytes\":" << cache->bytes
+                   << ",\"capacity\":" << cache->capacity << ",\"hits\":" << cache->hits
+                   << ",\"misses\":" << cache->misses << "}\n";
+            icvUnlockMutex( &cache->mutex );
+        }
+    }
+    else
+        encoded = icvServeCrop( conn->cache, req, &size, &cached, error );
+
+    if( encoded )
+        header << "{\"ok\":true,\"bytes\":" << encoded->cols * encoded->rows
+               << ",\"width\":" << size.width << ",\"height\":" << size.height
+               << ",\"cached\":" << ( cached ? "true" : "false" ) << "}\n";
+    else if( !error.empty() )
+        header << "{\"ok\":false,\"error\":" << icJsonQuote( error ) << "}\n";
+
+    string head = header.str();
+    bool ok = icvWriteAll( conn->fd, head.data(), head.size() );
+    if( encoded )
+    {
+        ok = ok && icvWriteAll( conn->fd, encoded->data.ptr, encoded->cols * encoded->rows );
+        if( ok )
+        {
+            icMetricsCount( IC_CROPS_SAVED );
+            icMetricsCount( IC_BYTES_WRITTEN, encoded->cols * encoded->rows );
+        }
+        else
+            icMetricsCount( IC_WRITE_ERRORS );
+        cvReleaseMat( &encoded );
+    }
+    icMetricsObserve( IC_STAGE_REQUEST, start );
+    return ok;
+}
+
+void icvServeConnection( void* _conn )
+{
+    CropConnection* conn = (CropConnection*)_conn;
+    string pending;
+    char buf[4096];
+    icMetricsGaugeAdd( IC_CONNECTIONS, 1 );
+    for( ;; )
+    {
+        ssize_t n = read( conn->fd, buf, sizeof( buf ) );
+        if( n < 0 && errno == EINTR ) continue;
+        if( n <= 0 ) break;
+        pending.append( buf, n );
+        size_t start = 0, end;
+        bool alive = true;
+        while( alive && ( end = pending.find( '\n', start ) ) != string::npos )
+        {
+            string line = pending.substr( start, end - start );
+            start = end + 1;
+            if( line.find_first_not_of( " \t\r" ) != string::npos )
+                alive = icvServeRequest( conn, line );
+        }
+        pending.erase( 0, start );
+        if( !alive ) break;
+    }
+    icMetricsGaugeAdd( IC_CONNECTIONS, -1 );
+    icMetricsThreadExit();
+    icvLockMutex( &conn->cache->mutex );
+    conn->done = true;
+    icvUnlockMutex( &conn->cache->mutex );
+}
+
+// join the finished connections, or all of them when shutting down
+void icvReapConnections( list<CropConnection*>& connections, CropCache* cache, bool all )
+{
+    list<CropConnection*>::iterator it = connections.begin();
+    while( it != connections.end() )
+    {
+        CropConnection* conn = *it;
+        icvLockMutex( &cache->mutex );
+        bool done = conn->done;
+        icvUnlockMutex( &cache->mutex );
+        if( !done && !all )
+        {
+            ++it;
+            continue;
+        }
+        if( !done ) shutdown( conn->fd, SHUT_RDWR ); // read and write fail, the thread returns
+        if( conn->threaded ) icvJoinThread( &conn->thread );
+        close( conn->fd );
+        delete conn;
+        it = connections.erase( it );
+    }
+}
+
+// any thread may take the signal, so the main loop is woken through a pipe
+void icvRequestStop( int )
+{
+    stop_requested = 1;
+    if( stop_pipe[1] >= 0 )
+    {
+        ssize_t n = write( stop_pipe[1], "x", 1 );
+        (void)n;
+    }
+}
+
+void usage( const char* com )
+{
+    fprintf( stderr, "Usage: %s [--cache-mb 512] [--metrics file] [--metrics-interval 10]\n"
+             "                  socket_path\n", com );
+}
+
+int main( int argc, char** argv )
+{
+    double cache_mb = 512, metrics_interval = 10;
+    const char* metrics = NULL;
+    for( int i = 1; i < argc; i++ )
+    {
+        if( !strcmp( argv[i], "--cache-mb" ) && i + 1 < argc )
+            cache_mb = atof( argv[++i] );
+        else if( !strcmp( argv[i], "--metrics" ) && i + 1 < argc )
+            metrics = argv[++i];
+        else if( !strcmp( argv[i], "--metrics-interval" ) && i + 1 < argc )
+            metrics_interval = atof( argv[++i] );
+        else if( argv[i][0] != '-' && !socket_path )
+            socket_path = argv[i];
+        else
+        {
+            usage( argv[0] );
+            return 1;
+        }
+    }
+    struct sockaddr_un addr;
+    if( !socket_path || strlen( socket_path ) >= sizeof( addr.sun_path ) )
+    {
+        usage( argv[0] );
+        return 1;
+    }
+
+    // a socket left by a daemon that was killed
+    struct stat st;
+    if( lstat( socket_path, &st ) == 0 && S_ISSOCK( st.st_mode ) )
+        unlink( socket_path );
+    int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+    memset( &addr, 0, sizeof( addr ) );
+    addr.sun_family = AF_UNIX;
+    strcpy( addr.sun_path, socket_path );
+    if( fd < 0 || bind( fd, (struct sockaddr*)&addr, sizeof( addr ) ) != 0 || listen( fd, 16 ) != 0 )
+    {
+        fprintf( stderr, "Cannot listen on %s: %s\n", socket_path, strerror( errno ) );
+        return 1;
+    }
+    if( pipe( stop_pipe ) != 0 )
+    {
+        fprintf( stderr, "pipe: %s\n", strerror( errno ) );
+        return 1;
+    }
+    fcntl( stop_pipe[1], F_SETFL, O_NONBLOCK );
+    struct sigaction sa;
+    memset( &sa, 0, sizeof( sa ) );
+    sa.sa_handler = icvRequestStop;
+    sigaction( SIGINT, &sa, NULL );
+    sigaction( SIGTERM, &sa, NULL );
+    signal( SIGPIPE, SIG_IGN );
+    if( metrics && !icStartMetrics( metrics, metrics_interval ) )
+        fprintf( stderr, "Cannot export metrics to %s\n", metrics );
+
+    CropCache cache;
+    cache.bytes = 0;
+    cache.capacity = (size_t)( cache_mb * 1024 * 1024 );
+    cache.hits = cache.misses = 0;
+    icvInitMutex( &cache.mutex );
+    fprintf( stderr, "Listening on %s\n", socket_path );
+
+    list<CropConnection*> connections;
+    while( !stop_requested )
+    {
+        struct pollfd fds[2] = { { fd, POLLIN, 0 }, { stop_pipe[0], POLLIN, 0 } };
+        int ready = poll( fds, 2, 1000 );
+        icvReapConnections( connections, &cache, false );
+        if( ready < 0 && errno != EINTR )
+        {
+            fprintf( stderr, "poll: %s\n", strerror( errno ) );
+            break;
+        }
+        if( ready <= 0 || !( fds[0].revents & POLLIN ) ) continue;
+        int client = accept( fd, NULL, NULL );
+        if( client < 0 )
+        {
+            if( errno == EINTR || errno == ECONNABORTED ) continue;
+            fprintf( stderr, "accept: %s\n", strerror( errno ) );
+            break;
+        }
+        CropConnection* conn = new CropConnection;
+        conn->fd = client;
+        conn->cache = &cache;
+        conn->done = false;
+        conn->threaded = icvStartThread( &conn->thread, icvServeConnection, conn );
+        if( !conn->threaded ) icvServeConnection( conn );
+        connections.push_back( conn );
+    }
+    close( fd );
+    unlink( socket_path );
+
+    // nothing may touch the cache or the metrics after this
+    icvReapConnections( connections, &cache, true );
+    icStopMetrics( cerr );
+    while( !cache.lru.empty() )
+        icvCacheDrop( &cache, cache.lru.back() );
+    icvDestroyMutex( &cache.mutex );
+    close( stop_pipe[0] );
+    close( stop_pipe[1] );
+    return stop_requested ? 0 : 1;
+}
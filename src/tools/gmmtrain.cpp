@@ -0,0 +1,231 @@
+/** @file
+ * Train a GMM color model from images or annotated crops
+ *
+ * Pixels are taken from every image of the given directories, or from
+ * the rectangles of imageclipper annotation files (the .txt files written
+ * next to the crops, "name.ext<TAB>x<TAB>y<TAB>w<TAB>h" per line). They
+ * are converted to RGB as cvSkinColorGmm does, reservoir sampled down to
+ * --max-samples, and fitted with cvTrainGmmEM. The model is written with
+ * cvSaveGmmModel.
+ *
+ * Usage: gmmtrain [-k components] [--full] [--step n] [--max-samples n]
+ *                 [-o model.xml] <directory | annotation.txt>...
+ *
+ * The MIT License
+ *
+ * Copyright (c) OpenALPR contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "cv.h"
+#include "cxcore.h"
+#include "highgui.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+#include "filesystem.h"
+#include "opencvx/cvgmmem.h"
+
+typedef struct GmmSampler {
+    int max_samples;
+    int step;             // take every step-th pixel in both directions
+    long seen;            // pixels offered so far
+    vector<float> rgb;    // up to max_samples * 3
+    CvRNG rng;
+} GmmSampler;
+
+/**
+ * Offer the pixels of rect of an image to the reservoir
+ */
+void icvGmmSampleImage( GmmSampler* s, const IplImage* img, CvRect rect )
+{
+    rect.x = MAX( rect.x, 0 );
+    rect.y = MAX( rect.y, 0 );
+    rect.width  = MIN( rect.width,  img->width  - rect.x );
+    rect.height = MIN( rect.height, img->height - rect.y );
+    for( int y = rect.y; y < rect.y + rect.height; y += s->step )
+    {
+        const uchar* row = (const uchar*)( img->imageData + img->widthStep * y );
+        for( int x = rect.x; x < rect.x + rect.width; x += s->step )
+        {
+            const uchar* bgr = row + x * img->nChannels;
+            long slot = s->seen++;
+            if( slot >= s->max_samples )
+            {
+                slot = (long)( cvRandReal( &s->rng ) * s->seen );
+                if( slot >= s->max_samples ) continue;
+            }
+            else
+            {
+                s->rgb.resize( s->rgb.size() + 3 );
+            }
+            float* dst = &s->rgb[slot * 3];
+            if( img->nChannels >= 3 )
+            {
+                dst[0] = bgr[2];
+                dst[1] = bgr[1];
+                dst[2] = bgr[0];
+            }
+            else
+            {
+                dst[0] = dst[1] = dst[2] = bgr[0];
+            }
+        }
+    }
+}
+
+/**
+ * Sample the rectangles listed in an annotation file
+ *
+ * Images are looked up in the parent of the directory of the file, where
+ * imageclipper reads them from. Video lines (with a frame number) are skipped.
+ */
+int icvGmmSampleAnnotations( GmmSampler* s, const string& txtfile )
+{
+    ifstream in( txtfile.c_str() );
+    string imgdir = filesystem::dirname( filesystem::dirname( filesystem::realpath( txtfile ) ) );
+    string line;
+    int count = 0;
+    while( getline( in, line ) )
+    {
+        vector<string> fields;
+        stringstream ss( line );
+        string field;
+        while( getline( ss, field, '\t' ) )
+            fields.push_back( field );
+        if( fields.size() != 5 ) continue;
+        IplImage* img = cvLoadImage( ( imgdir + "/" + fields[0] ).c_str(), 1 );
+        if( !img )
+        {
+            fprintf( stderr, "%s: cannot load %s.\n", txtfile.c_str(), fields[0].c_str() );
+            continue;
+        }
+        icvGmmSampleImage( s, img, cvRect( atoi( fields[1].c_str() ), atoi( fields[2].c_str() ),
+                                           atoi( fields[3].c_str() ), atoi( fields[4].c_str() ) ) );
+        cvReleaseImage( &img );
+        count++;
+    }
+    return count;
+}
+
+void usage( const char* com )
+{
+    fprintf( stderr, "Usage: %s [-k components] [--full] [--step n] [--max-samples n]\n"
+             "                [-o model.xml] <directory | annotation.txt>...\n", com );
+}
+
+int main( int argc, char** argv )
+{
+    int K = 8;
+    int covtype = CV_GMM_DIAGONAL;
+    const char* output = "gmm.xml";
+    GmmSampler sampler;
+    sampler.max_samples = 200000;
+    sampler.step = 1;
+    sampler.seen = 0;
+    sampler.rng = cvRNG( 0xffffffff );
+    vector<string> inputs;
+
+    for( int i = 1; i < argc; i++ )
+    {
+        if( !strcmp( argv[i], "-k" ) && i + 1 < argc )
+            K = atoi( argv[++i] );
+        else if( !strcmp( argv[i], "--full" ) )
+            covtype = CV_GMM_FULL;
+        else if( !strcmp( argv[i], "--step" ) && i + 1 < argc )
+            sampler.step = MAX( atoi( argv[++i] ), 1 );
+        else if( !strcmp( argv[i], "--max-samples" ) && i + 1 < argc )
+            sampler.max_samples = atoi( argv[++i] );
+        else if( !strcmp( argv[i], "-o" ) && i + 1 < argc )
+            output = argv[++i];
+        else if( argv[i][0] == '-' )
+        {
+            usage( argv[0] );
+            return 1;
+        }
+        else
+            inputs.push_back( argv[i] );
+    }
+    if( inputs.empty() || K <= 0 || sampler.max_samples < K )
+    {
+        usage( argv[0] );
+        return 1;
+    }
+
+    vector<string> imtypes;
+    imtypes.push_back( "bmp" );
+    imtypes.push_back( "jpeg" );
+    imtypes.push_back( "jpg" );
+    imtypes.push_back( "png" );
+    imtypes.push_back( "ppm" );
+    imtypes.push_back( "tif" );
+    imtypes.push_back( "tiff" );
+    imtypes.push_back( "" ); // match_extensions skips the last one
+
+    int sources = 0;
+    for( size_t i = 0; i < inputs.size(); i++ )
+    {
+        if( filesystem::is_dir( inputs[i] ) )
+        {
+            vector<string> files = filesystem::filelist( inputs[i], imtypes, "file" );
+            for( size_t j = 0; j < files.size(); j++ )
+            {
+                IplImage* img = cvLoadImage( files[j].c_str(), 1 );
+                if( !img ) continue;
+                icvGmmSampleImage( &sampler, img, cvRect( 0, 0, img->width, img->height ) );
+                cvReleaseImage( &img );
+                sources++;
+            }
+        }
+        else
+        {
+            sources += icvGmmSampleAnnotations( &sampler, inputs[i] );
+        }
+    }
+
+    int N = (int)( sampler.rgb.size() / 3 );
+    if( N < K )
+    {
+        fprintf( stderr, "Only %d pixels found in %d images, %d components need more.\n",
+                 N, sources, K );
+        return 1;
+    }
+
+    // N x 3 interleaved to 3 x N
+    CvMat rgb = cvMat( N, 3, CV_32FC1, &sampler.rgb[0] );
+    CvMat* samples = cvCreateMat( 3, N, CV_32FC1 );
+    cvTranspose( &rgb, samples );
+
+    CvGmmModel* gmm = cvCreateGmmModel( 3, K, covtype );
+    double loglik = cvTrainGmmEM( samples, gmm,
+                                  cvTermCriteria( CV_TERMCRIT_ITER + CV_TERMCRIT_EPS, 200, 1e-5 ),
+                                  cvRNG( 0x12345 ) );
+    cvSaveGmmModel( output, gmm );
+    printf( "%s: K = %d, %s covariances, %d of %ld pixels from %d images, log likelihood = %g\n",
+            output, K, covtype == CV_GMM_FULL ? "full" : "diagonal", N, sampler.seen, sources, loglik );
+
+    cvReleaseGmmModel( &gmm );
+    cvReleaseMat( &samples );
+    return 0;
+}
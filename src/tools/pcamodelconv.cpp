@@ -0,0 +1,84 @@
+/** @file
+ * Convert the PCA subspace xml files into the binary model format
+ *
+ * The particle filter tracker with the PCA DIFFS observation model maps
+ * pcamodel.bin (see cvLoadPcaDiffsModel) instead of parsing the xml
+ * files when it exists in the data directory.
+ *
+ * Usage: pcamodelconv [pcaval.xml pcavec.xml pcaavg.xml [pcamodel.bin]]
+ *
+ * The MIT License
+ *
+ * Copyright (c) OpenALPR contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "cv.h"
+#include "cxcore.h"
+#include <stdio.h>
+#include <math.h>
+#include "opencvx/cvpcadiffs.h"
+
+/**
+ * Load a matrix saved by cvSave, or exit
+ */
+CvMat* icvLoadMatOrDie( const char* filename )
+{
+    CvMat* mat = (CvMat*)cvLoad( filename );
+    if( mat == NULL || !CV_IS_MAT(mat) ) {
+        fprintf( stderr, "%s is not loadable.\n", filename );
+        exit( 1 );
+    }
+    return mat;
+}
+
+int main( int argc, char** argv )
+{
+    const char* pcaval   = argc > 1 ? argv[1] : "pcaval.xml";
+    const char* pcavec   = argc > 2 ? argv[2] : "pcavec.xml";
+    const char* pcaavg   = argc > 3 ? argv[3] : "pcaavg.xml";
+    const char* pcamodel = argc > 4 ? argv[4] : "pcamodel.bin";
+    if( argc != 1 && argc != 4 && argc != 5 ) {
+        fprintf( stderr, "Usage: %s [pcaval.xml pcavec.xml pcaavg.xml [pcamodel.bin]]\n", argv[0] );
+        return 1;
+    }
+
+    CvMat* eigenvalues  = icvLoadMatOrDie( pcaval );
+    CvMat* eigenvectors = icvLoadMatOrDie( pcavec );
+    CvMat* eigenavg     = icvLoadMatOrDie( pcaavg );
+    CvPcaDiffsModel* model = cvCreatePcaDiffsModel( eigenavg, eigenvalues, eigenvectors );
+    cvSavePcaDiffsModel( pcamodel, model );
+
+    // read back through the mapping and compare with what was written
+    CvPcaDiffsModel* mapped = cvLoadPcaDiffsModel( pcamodel );
+    if( mapped == NULL ||
+        cvNorm( model->avg, mapped->avg, CV_L1 ) != 0 ||
+        ( model->M > 0 && cvNorm( model->eigenvectors, mapped->eigenvectors, CV_L1 ) != 0 ) ) {
+        fprintf( stderr, "%s could not be verified.\n", pcamodel );
+        return 1;
+    }
+    printf( "%s: D = %d, M = %d, eigenvalues = %d\n", pcamodel, model->D, model->M, model->nEig );
+
+    cvReleasePcaDiffsModel( &mapped );
+    cvReleasePcaDiffsModel( &model );
+    cvReleaseMat( &eigenvalues );
+    cvReleaseMat( &eigenvectors );
+    cvReleaseMat( &eigenavg );
+    return 0;
+}
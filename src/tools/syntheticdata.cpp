@@ -0,0 +1,276 @@
+/** @file
+ * Generate synthetic images and videos with plate-like rectangles
+ *
+ * Real plates can not be shipped, so throughput tests of the directory,
+ * video and save paths run on generated data. Every image or video gets
+ * light rectangles with dark glyph strokes on a textured background, and
+ * their positions are written as ground truth in the annotation format
+ * imageclipper itself writes (imgdir/imageclipper/name.txt, one
+ * "name.ext<TAB>[frame<TAB>]x<TAB>y<TAB>w<TAB>h" line per rectangle), so
+ * the output can also be fed to gmmtrain.
+ *
+ * Everything is derived from --seed: image i is drawn from its own
+ * generator seeded with seed + i, so the same command gives the same
+ * pixels and the same annotations.
+ *
+ * Usage: syntheticdata [--images n] [--videos n] [--frames n]
+ *                      [--size WxH] [--format jpg] [--plates n]
+ *                      [--seed n] [-o outdir]
+ *
+ * The MIT License
+ *
+ * Copyright (c) OpenALPR contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "cv.h"
+#include "cxcore.h"
+#include "highgui.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <string>
+#include <vector>
+using namespace std;
+#include "filesystem.h"
+
+typedef struct SyntheticPlate {
+    CvRect rect;
+    CvPoint2D32f pos;       // sub-pixel position of the top left corner
+    CvPoint2D32f velocity;  // pixels per frame
+    CvScalar color;         // plate background
+    int glyphs;
+    unsigned int style;     // seed of the glyph shapes, fixed per plate
+} SyntheticPlate;
+
+/**
+ * A plate with the 4.5:1 aspect of a license plate, 8% to 25% of the
+ * image width, fully inside the image
+ */
+SyntheticPlate icvRandomPlate( CvRNG* rng, CvSize size )
+{
+    SyntheticPlate plate;
+    int w = cvRound( size.width * ( 0.08 + 0.17 * cvRandReal( rng ) ) );
+    w = MAX( MIN( w, size.width - 2 ), 9 );
+    int h = MAX( MIN( cvRound( w / 4.5 ), size.height - 2 ), 2 );
+    plate.rect = cvRect( cvRandInt( rng ) % ( size.width - w ), cvRandInt( rng ) % ( size.height - h ), w, h );
+    plate.pos = cvPoint2D32f( plate.rect.x, plate.rect.y );
+    double speed = 1 + 4 * cvRandReal( rng ), dir = 2 * CV_PI * cvRandReal( rng );
+    plate.velocity = cvPoint2D32f( speed * cos( dir ), speed * sin( dir ) );
+    int v = 200 + cvRandInt( rng ) % 56;
+    plate.color = CV_RGB( v, v - cvRandInt( rng ) % 20, v - cvRandInt( rng ) % 40 );
+    plate.glyphs = 5 + cvRandInt( rng ) % 4;
+    plate.style = cvRandInt( rng );
+    return plate;
+}
+
+/**
+ * Smooth noise with a couple of gradients and boxes, so that the plates
+ * are not the only structure in the image
+ */
+void icvDrawBackground( CvRNG* rng, IplImage* img )
+{
+    cvRandArr( rng, img, CV_RAND_UNI, cvScalarAll(40), cvScalarAll(160) );
+    cvSmooth( img, img, CV_GAUSSIAN, 7, 7 );
+    for( int i = 0; i < 6; i++ )
+    {
+        CvPoint pt1 = cvPoint( cvRandInt( rng ) % img->width, cvRandInt( rng ) % img->height );
+        CvPoint pt2 = cvPoint( pt1.x + cvRandInt( rng ) % ( img->width / 3 + 1 ),
+                               pt1.y + cvRandInt( rng ) % ( img->height / 3 + 1 ) );
+        cvRectangle( img, pt1, pt2, CV_RGB( cvRandInt( rng ) % 256, cvRandInt( rng ) % 256,
+                                            cvRandInt( rng ) % 256 ), CV_FILLED );
+    }
+}
+
+/**
+ * Plate body, border and glyph strokes. The glyphs depend only on the
+ * plate, so a moving plate keeps its text
+ */
+void icvDrawPlate( IplImage* img, const SyntheticPlate* plate )
+{
+    CvRect r = plate->rect;
+    CvRNG glyph_rng = cvRNG( plate->style );
+    cvRectangle( img, cvPoint( r.x, r.y ), cvPoint( r.x + r.width - 1, r.y + r.height - 1 ),
+                 plate->color, CV_FILLED );
+    cvRectangle( img, cvPoint( r.x, r.y ), cvPoint( r.x + r.width - 1, r.y + r.height - 1 ),
+                 CV_RGB(20, 20, 20), MAX( 1, r.height / 12 ) );
+    int margin = MAX( 1, r.height / 6 );
+    int pitch = ( r.width - 2 * margin ) / plate->glyphs;
+    int stroke = MAX( 1, pitch / 6 );
+    for( int g = 0; g < plate->glyphs && pitch > 2; g++ )
+    {
+        int x0 = r.x + margin + g * pitch + stroke, x1 = x0 + pitch - 2 * stroke;
+        int y0 = r.y + margin, y1 = r.y + r.height - 1 - margin;
+        int ym = ( y0 + y1 ) / 2;
+        unsigned int shape = cvRandInt( &glyph_rng );
+        // seven segment like glyph: a random subset of the strokes
+        CvPoint seg[7][2] = {
+            { cvPoint( x0, y0 ), cvPoint( x1, y0 ) }, { cvPoint( x0, ym ), cvPoint( x1, ym ) },
+            { cvPoint( x0, y1 ), cvPoint( x1, y1 ) }, { cvPoint( x0, y0 ), cvPoint( x0, ym ) },
+            { cvPoint( x1, y0 ), cvPoint( x1, ym ) }, { cvPoint( x0, ym ), cvPoint( x0, y1 ) },
+            { cvPoint( x1, ym ), cvPoint( x1, y1 ) } };
+        for( int s = 0; s < 7; s++ )
+            if( shape & ( 1 << s ) )
+                cvLine( img, seg[s][0], seg[s][1], CV_RGB(15, 15, 15), stroke );
+    }
+}
+
+/**
+ * Move a plate one frame, bouncing off the image borders
+ */
+void icvMovePlate( SyntheticPlate* plate, CvSize size )
+{
+    float maxx = (float)( size.width - plate->rect.width );
+    float maxy = (float)( size.height - plate->rect.height );
+    plate->pos.x += plate->velocity.x;
+    plate->pos.y += plate->velocity.y;
+    if( plate->pos.x < 0 || plate->pos.x > maxx )
+    {
+        plate->velocity.x = -plate->velocity.x;
+        plate->pos.x = MAX( 0.f, MIN( plate->pos.x, maxx ) );
+    }
+    if( plate->pos.y < 0 || plate->pos.y > maxy )
+    {
+        plate->velocity.y = -plate->velocity.y;
+        plate->pos.y = MAX( 0.f, MIN( plate->pos.y, maxy ) );
+    }
+    plate->rect.x = cvRound( plate->pos.x );
+    plate->rect.y = cvRound( plate->pos.y );
+}
+
+void icvWriteAnnotation( ofstream& meta, const string& name, int frame, CvRect r )
+{
+    meta << name << "\t";
+    if( frame > 0 ) meta << frame << "\t";
+    meta << r.x << "\t" << r.y << "\t" << r.width << "\t" << r.height << endl;
+}
+
+void usage( const char* com )
+{
+    fprintf( stderr, "Usage: %s [--images n] [--videos n] [--frames n]\n"
+             "                     [--size WxH] [--format jpg] [--plates n]\n"
+             "                     [--seed n] [-o outdir]\n", com );
+}
+
+int main( int argc, char** argv )
+{
+    int images = 100, videos = 0, frames = 300, max_plates = 2;
+    unsigned int seed = 12345;
+    CvSize size = cvSize( 1280, 720 );
+    string format = "jpg";
+    string outdir = "synthetic";
+
+    for( int i = 1; i < argc; i++ )
+    {
+        if( !strcmp( argv[i], "--images" ) && i + 1 < argc )
+            images = atoi( argv[++i] );
+        else if( !strcmp( argv[i], "--videos" ) && i + 1 < argc )
+            videos = atoi( argv[++i] );
+        else if( !strcmp( argv[i], "--frames" ) && i + 1 < argc )
+            frames = atoi( argv[++i] );
+        else if( !strcmp( argv[i], "--plates" ) && i + 1 < argc )
+            max_plates = atoi( argv[++i] );
+        else if( !strcmp( argv[i], "--seed" ) && i + 1 < argc )
+            seed = (unsigned int)strtoul( argv[++i], NULL, 10 );
+        else if( !strcmp( argv[i], "--format" ) && i + 1 < argc )
+            format = argv[++i];
+        else if( !strcmp( argv[i], "-o" ) && i + 1 < argc )
+            outdir = argv[++i];
+        else if( !strcmp( argv[i], "--size" ) && i + 1 < argc &&
+                 sscanf( argv[++i], "%dx%d", &size.width, &size.height ) == 2 )
+            ;
+        else
+        {
+            usage( argv[0] );
+            return 1;
+        }
+    }
+    if( size.width < 32 || size.height < 32 || max_plates < 1 || images < 0 || videos < 0 || frames < 1 )
+    {
+        usage( argv[0] );
+        return 1;
+    }
+    filesystem::r_mkdir( outdir + "/imageclipper" );
+    IplImage* img = cvCreateImage( size, IPL_DEPTH_8U, 3 );
+    int plates_written = 0;
+    char name[64];
+
+    for( int i = 0; i < images; i++ )
+    {
+        CvRNG rng = cvRNG( (int64)seed + i );
+        sprintf( name, "synthetic_%06d", i );
+        string file = string( name ) + "." + format;
+        icvDrawBackground( &rng, img );
+        ofstream meta( ( outdir + "/imageclipper/" + name + ".txt" ).c_str() );
+        int n = 1 + cvRandInt( &rng ) % max_plates;
+        for( int p = 0; p < n; p++ )
+        {
+            SyntheticPlate plate = icvRandomPlate( &rng, size );
+            icvDrawPlate( img, &plate );
+            icvWriteAnnotation( meta, file, 0, plate.rect );
+            plates_written++;
+        }
+        if( !cvSaveImage( ( outdir + "/" + file ).c_str(), img ) )
+        {
+            fprintf( stderr, "Cannot write %s/%s.\n", outdir.c_str(), file.c_str() );
+            return 1;
+        }
+    }
+
+    // MJPG keeps every frame a key frame, so seeking in the video is cheap
+    IplImage* background = cvCreateImage( size, IPL_DEPTH_8U, 3 );
+    for( int v = 0; v < videos; v++ )
+    {
+        CvRNG rng = cvRNG( (int64)seed + images + v );
+        sprintf( name, "synthetic_video_%03d", v );
+        string file = string( name ) + ".avi";
+        CvVideoWriter* writer = cvCreateVideoWriter( ( outdir + "/" + file ).c_str(),
+                                                     CV_FOURCC('M','J','P','G'), 30, size, 1 );
+        if( !writer )
+        {
+            fprintf( stderr, "Cannot write %s/%s.\n", outdir.c_str(), file.c_str() );
+            return 1;
+        }
+        icvDrawBackground( &rng, background );
+        vector<SyntheticPlate> plates( 1 + cvRandInt( &rng ) % max_plates );
+        for( size_t p = 0; p < plates.size(); p++ )
+            plates[p] = icvRandomPlate( &rng, size );
+        ofstream meta( ( outdir + "/imageclipper/" + name + ".txt" ).c_str() );
+        for( int f = 1; f <= frames; f++ ) // imageclipper counts frames from 1
+        {
+            cvCopy( background, img );
+            for( size_t p = 0; p < plates.size(); p++ )
+            {
+                if( f > 1 ) icvMovePlate( &plates[p], size );
+                icvDrawPlate( img, &plates[p] );
+                icvWriteAnnotation( meta, file, f, plates[p].rect );
+                plates_written++;
+            }
+            cvWriteFrame( writer, img );
+        }
+        cvReleaseVideoWriter( &writer );
+    }
+
+    printf( "%s: %d images, %d videos of %d frames, %dx%d, %d plates annotated\n", outdir.c_str(),
+            images, videos, frames, size.width, size.height, plates_written );
+    cvReleaseImage( &background );
+    cvReleaseImage( &img );
+    return 0;
+}